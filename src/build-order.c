@@ -341,7 +341,7 @@ size_t dependencies_listed_but_not_depended_on (const char* dstdir, struct packa
 
 #else
 
-size_t dependencies_listed_but_not_depended_on (struct package_metadata_struct* pkginfo, struct package_metadata_struct* dbpkginfo)
+size_t dependencies_listed_but_not_depended_on (struct package_metadata_struct* pkginfo, const struct package_metadata_struct* dbpkginfo)
 {
   struct dependencies_listed_but_not_depended_on_struct data = {0, NULL};
   if (dbpkginfo) {
@@ -351,7 +351,6 @@ size_t dependencies_listed_but_not_depended_on (struct package_metadata_struct*
     //check optional dependencies
     data.dependencies = dbpkginfo->optionaldependencies;
     iterate_packages_in_list(pkginfo->optionaldependencies, dependencies_listed_but_not_depended_on_iteration, &data);
-    sorted_unique_list_clear(data.dependencies);
     //check build dependencies
     data.dependencies = dbpkginfo->builddependencies;
     iterate_packages_in_list(pkginfo->builddependencies, dependencies_listed_but_not_depended_on_iteration, &data);
@@ -69,10 +69,10 @@ size_t dependencies_listed_but_not_depended_on (const char* dstdir, struct packa
 //!get number of dependency packages specified that are currently not installed for a specific package
 /*!
   \param  pkginfo               package information from build recipe
-  \param  dbpkginfo             package information from database for same package as pkginfo
+  \param  dbpkginfo             package information from database for same package as pkginfo (not modified)
   \return number of dependencies specified in build information that are not currently installed
 */
-size_t dependencies_listed_but_not_depended_on (struct package_metadata_struct* pkginfo, struct package_metadata_struct* dbpkginfo);
+size_t dependencies_listed_but_not_depended_on (struct package_metadata_struct* pkginfo, const struct package_metadata_struct* dbpkginfo);
 #endif
 
 #ifdef __cplusplus
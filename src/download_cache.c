@@ -1,32 +1,153 @@
 #include "download_cache.h"
+#include "memory_buffer.h"
 
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sqlite3.h>
+#include <zstd.h>
+#include <zdict.h>
 
 #define DB_SQL_CACHE_CREATE \
   "CREATE TABLE cache (" \
   " url TEXT NOT NULL," \
   " responsecode INTEGER," \
   " status TEXT," \
-  " data TEXT," \
+  " data BLOB," \
   " actualurl TEXT," \
   " mimetype TEXT," \
   " created INTEGER," \
+  " etag TEXT," \
+  " lastmodified TEXT," \
+  " compression INTEGER," \
+  " host TEXT," \
+  " errorclass INTEGER," \
+  " failures INTEGER," \
+  " expires INTEGER," \
   " PRIMARY KEY(url)" \
   ");"
-#define DB_SQL_CACHE_ADD "INSERT INTO cache (url, actualurl, data, mimetype, responsecode, status, created) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7)"
-#define DB_SQL_CACHE_GET "SELECT responsecode, status, data, actualurl, mimetype, created FROM cache WHERE url = ?"
+#define DB_SQL_CACHE_CREATE_HOST_INDEX "CREATE INDEX IF NOT EXISTS cache_host ON cache (host)"
+#define DB_SQL_DICTIONARY_CREATE \
+  "CREATE TABLE IF NOT EXISTS dictionary (" \
+  " id INTEGER NOT NULL," \
+  " data BLOB NOT NULL," \
+  " created INTEGER," \
+  " PRIMARY KEY(id)" \
+  ");"
+#define DB_SQL_CACHE_UPGRADE_ETAG "ALTER TABLE cache ADD COLUMN etag TEXT"
+#define DB_SQL_CACHE_UPGRADE_LASTMODIFIED "ALTER TABLE cache ADD COLUMN lastmodified TEXT"
+#define DB_SQL_CACHE_UPGRADE_COMPRESSION "ALTER TABLE cache ADD COLUMN compression INTEGER"
+#define DB_SQL_CACHE_UPGRADE_HOST "ALTER TABLE cache ADD COLUMN host TEXT"
+#define DB_SQL_CACHE_UPGRADE_ERRORCLASS "ALTER TABLE cache ADD COLUMN errorclass INTEGER"
+#define DB_SQL_CACHE_UPGRADE_FAILURES "ALTER TABLE cache ADD COLUMN failures INTEGER"
+#define DB_SQL_CACHE_UPGRADE_EXPIRES "ALTER TABLE cache ADD COLUMN expires INTEGER"
+#define DB_SQL_CACHE_ADD "INSERT OR REPLACE INTO cache (url, actualurl, data, mimetype, responsecode, status, created, etag, lastmodified, compression, host, errorclass, failures, expires) VALUES (?1, ?2, ?3, ?4, ?5, ?6, ?7, ?8, ?9, ?10, ?11, ?12, ?13, ?14)"
+#define DB_SQL_CACHE_GET "SELECT responsecode, status, data, actualurl, mimetype, created, etag, lastmodified, compression, errorclass, expires FROM cache WHERE url = ?"
+#define DB_SQL_CACHE_GET_FAILURES "SELECT failures FROM cache WHERE url = ? AND errorclass > 0"
+//only DNS (1), connect (2) and timeout without any data received (3) errors mean the entire host is unreachable
+#define DB_SQL_CACHE_GET_HOST_FAILURE "SELECT errorclass, responsecode, status FROM cache WHERE host = ?1 AND errorclass BETWEEN 1 AND 3 AND expires > ?2 ORDER BY expires DESC LIMIT 1"
+#define DB_SQL_CACHE_SAMPLES "SELECT data, compression FROM cache WHERE data IS NOT NULL ORDER BY created DESC LIMIT ?"
+#define DB_SQL_DICTIONARY_GET "SELECT data FROM dictionary ORDER BY created DESC LIMIT 1"
+#define DB_SQL_DICTIONARY_ADD "INSERT OR REPLACE INTO dictionary (id, data, created) VALUES (?1, ?2, ?3)"
 #define DB_SQL_CACHE_DEL "DELETE FROM cache WHERE url = ?"
-#define DB_SQL_CACHE_PURGE "DELETE FROM cache WHERE created <= ?"
+#define DB_SQL_CACHE_REFRESH "UPDATE cache SET created = ?2 WHERE url = ?1"
+#define DB_SQL_CACHE_PURGE "DELETE FROM cache WHERE CASE WHEN errorclass > 0 THEN created <= ?2 ELSE created <= ?1 AND ((etag IS NULL AND lastmodified IS NULL) OR created <= ?2) END"
+
+//number of seconds expired entries that can be revalidated (ETag or Last-Modified known) and failed downloads (to remember the number of consecutive failures) are kept
+#define DOWNLOADCACHE_REVALIDATE_LIFETIME (30 * 24 * 60 * 60)
+
+//number of seconds a failed download is cached after the first failure (doubles with each consecutive failure, up to the cache expiration or the maximum if entries don't expire)
+#define DOWNLOADCACHE_FAILURE_LIFETIME (15 * 60)
+#define DOWNLOADCACHE_FAILURE_MAX_LIFETIME (24 * 60 * 60)
+
+//values of the compression column (NULL in entries created by older versions means no compression)
+#define DOWNLOADCACHE_COMPRESSION_NONE 0
+#define DOWNLOADCACHE_COMPRESSION_ZSTD 1
+
+//zstd compression level used for cached page data
+#define DOWNLOADCACHE_COMPRESSION_LEVEL 9
+
+//size of the trained compression dictionary and limits for the cache entries used to train it
+#define DOWNLOADCACHE_DICTIONARY_SIZE (112 * 1024)
+#define DOWNLOADCACHE_DICTIONARY_MIN_SAMPLES 64
+#define DOWNLOADCACHE_DICTIONARY_MAX_SAMPLES 2048
+#define DOWNLOADCACHE_DICTIONARY_MAX_SAMPLE_SIZE (128 * 1024)
+
+const char* download_error_class_name (int errorclass)
+{
+  switch (errorclass) {
+    case DOWNLOAD_ERROR_NONE:
+      return "none";
+    case DOWNLOAD_ERROR_DNS:
+      return "DNS";
+    case DOWNLOAD_ERROR_CONNECT:
+      return "connect";
+    case DOWNLOAD_ERROR_TIMEOUT:
+      return "timeout";
+    case DOWNLOAD_ERROR_HTTP_CLIENT:
+      return "HTTP client";
+    case DOWNLOAD_ERROR_HTTP_SERVER:
+      return "HTTP server";
+    case DOWNLOAD_ERROR_TRANSFER_TIMEOUT:
+      return "transfer timeout";
+    default:
+      return "other";
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
 
 struct downloadcachedb {
   sqlite3* db;
   int isnew;
   unsigned long expiration;
+  ZSTD_CDict* cdict;
+  ZSTD_DDict* ddict;
 };
 
+static char* downloadcache_decompress (ZSTD_DCtx* dctx, const ZSTD_DDict* ddict, const void* data, size_t datalen)
+{
+  struct memory_buffer* buf;
+  unsigned long long len;
+  size_t n;
+  if ((len = ZSTD_getFrameContentSize(data, datalen)) == ZSTD_CONTENTSIZE_ERROR || len == ZSTD_CONTENTSIZE_UNKNOWN || (size_t)len != len)
+    return NULL;
+  if ((buf = memory_buffer_create()) == NULL)
+    return NULL;
+  //decompress into buffer with room for null-terminator
+  if (memory_buffer_grow(buf, (size_t)len + 1) == 0) {
+    memory_buffer_free(buf);
+    return NULL;
+  }
+  if (ddict && ZSTD_getDictID_fromFrame(data, datalen) != 0)
+    n = ZSTD_decompress_usingDDict(dctx, buf->data, (size_t)len, data, datalen, ddict);
+  else
+    n = ZSTD_decompressDCtx(dctx, buf->data, (size_t)len, data, datalen);
+  if (ZSTD_isError(n) || n != (size_t)len) {
+    //corrupt data or compressed with an unknown dictionary
+    memory_buffer_free(buf);
+    return NULL;
+  }
+  buf->data[len] = 0;
+  return memory_buffer_free_to_allocated_string(buf);
+}
+
+static void downloadcachedb_load_dictionary (struct downloadcachedb* handle)
+{
+  sqlite3_stmt* qry;
+  const void* dict;
+  int dictlen;
+  if (sqlite3_prepare_v3(handle->db, DB_SQL_DICTIONARY_GET, -1, 0, &qry, NULL) != SQLITE_OK)
+    return;
+  if (sqlite3_step(qry) == SQLITE_ROW && (dict = sqlite3_column_blob(qry, 0)) != NULL && (dictlen = sqlite3_column_bytes(qry, 0)) > 0) {
+    ZSTD_freeCDict(handle->cdict);
+    ZSTD_freeDDict(handle->ddict);
+    handle->cdict = ZSTD_createCDict(dict, dictlen, DOWNLOADCACHE_COMPRESSION_LEVEL);
+    handle->ddict = ZSTD_createDDict(dict, dictlen);
+  }
+  sqlite3_finalize(qry);
+}
+
 struct downloadcachedb* downloadcachedb_create (const char* filename, unsigned long expiration)
 {
   struct downloadcachedb* handle;
@@ -34,6 +155,8 @@ struct downloadcachedb* downloadcachedb_create (const char* filename, unsigned l
     return NULL;
   if ((handle = (struct downloadcachedb*)malloc(sizeof(struct downloadcachedb))) == NULL)
     return NULL;
+  handle->cdict = NULL;
+  handle->ddict = NULL;
   //create temporary database
   if (sqlite3_open_v2((!filename ? "" : filename), &handle->db, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX /*| SQLITE_OPEN_SHAREDCACHE*/, NULL) != SQLITE_OK) {
     free(handle);
@@ -49,9 +172,21 @@ struct downloadcachedb* downloadcachedb_create (const char* filename, unsigned l
       free(handle);
       return NULL;
     }
+    //add columns missing in cache databases created by older versions (errors mean the column already exists)
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_ETAG, NULL, NULL, NULL);
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_LASTMODIFIED, NULL, NULL, NULL);
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_COMPRESSION, NULL, NULL, NULL);
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_HOST, NULL, NULL, NULL);
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_ERRORCLASS, NULL, NULL, NULL);
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_FAILURES, NULL, NULL, NULL);
+    sqlite3_exec(handle->db, DB_SQL_CACHE_UPGRADE_EXPIRES, NULL, NULL, NULL);
   } else {
     handle->isnew = 1;
   }
+  sqlite3_exec(handle->db, DB_SQL_CACHE_CREATE_HOST_INDEX, NULL, NULL, NULL);
+  //load compression dictionary
+  sqlite3_exec(handle->db, DB_SQL_DICTIONARY_CREATE, NULL, NULL, NULL);
+  downloadcachedb_load_dictionary(handle);
   handle->expiration = expiration;
   return handle;
 }
@@ -62,6 +197,8 @@ void downloadcachedb_free (struct downloadcachedb* handle)
     if (handle->db) {
       sqlite3_close(handle->db);
     }
+    ZSTD_freeCDict(handle->cdict);
+    ZSTD_freeDDict(handle->ddict);
     free(handle);
   }
 }
@@ -84,6 +221,7 @@ int downloadcachedb_purge (struct downloadcachedb* handle)
   if (sqlite3_prepare_v3(handle->db, DB_SQL_CACHE_PURGE, -1, 0, &qry, NULL) != SQLITE_OK)
     return -2;
   sqlite3_bind_int64(qry, 1, time(NULL) - handle->expiration);
+  sqlite3_bind_int64(qry, 2, time(NULL) - DOWNLOADCACHE_REVALIDATE_LIFETIME);
   if (sqlite3_step(qry) != SQLITE_DONE)
     result = -1;
   else
@@ -94,6 +232,94 @@ int downloadcachedb_purge (struct downloadcachedb* handle)
   return result;
 }
 
+int downloadcachedb_train_dictionary (struct downloadcachedb* handle)
+{
+  sqlite3_stmt* qry;
+  ZSTD_DCtx* dctx;
+  struct memory_buffer* samples;
+  size_t* samplesizes;
+  unsigned int numsamples;
+  const char* data;
+  char* decompressed;
+  size_t datalen;
+  void* dict;
+  size_t dictlen;
+  int result = 1;
+  if (!handle)
+    return -3;
+  if (handle->cdict)
+    return 1;
+  if ((samplesizes = (size_t*)malloc(DOWNLOADCACHE_DICTIONARY_MAX_SAMPLES * sizeof(size_t))) == NULL)
+    return -1;
+  if ((samples = memory_buffer_create()) == NULL || (dctx = ZSTD_createDCtx()) == NULL) {
+    memory_buffer_free(samples);
+    free(samplesizes);
+    return -1;
+  }
+  //collect the most recent cache entries as samples
+  numsamples = 0;
+  if (sqlite3_prepare_v3(handle->db, DB_SQL_CACHE_SAMPLES, -1, 0, &qry, NULL) != SQLITE_OK) {
+    result = -2;
+  } else {
+    sqlite3_bind_int(qry, 1, DOWNLOADCACHE_DICTIONARY_MAX_SAMPLES);
+    while (sqlite3_step(qry) == SQLITE_ROW) {
+      decompressed = NULL;
+      if (sqlite3_column_int(qry, 1) == DOWNLOADCACHE_COMPRESSION_ZSTD) {
+        if ((decompressed = downloadcache_decompress(dctx, NULL, sqlite3_column_blob(qry, 0), sqlite3_column_bytes(qry, 0))) == NULL)
+          continue;
+        data = decompressed;
+        datalen = strlen(decompressed);
+      } else {
+        data = (const char*)sqlite3_column_blob(qry, 0);
+        datalen = sqlite3_column_bytes(qry, 0);
+      }
+      if (datalen > DOWNLOADCACHE_DICTIONARY_MAX_SAMPLE_SIZE)
+        datalen = DOWNLOADCACHE_DICTIONARY_MAX_SAMPLE_SIZE;
+      if (data && datalen > 0) {
+        if (memory_buffer_append_buf(samples, data, datalen) == 0) {
+          //memory allocation error, don't train with incomplete data
+          numsamples = 0;
+          free(decompressed);
+          break;
+        }
+        samplesizes[numsamples++] = datalen;
+      }
+      free(decompressed);
+    }
+    sqlite3_finalize(qry);
+  }
+  ZSTD_freeDCtx(dctx);
+  //train dictionary and store it in the database
+  if (result > 0 && numsamples >= DOWNLOADCACHE_DICTIONARY_MIN_SAMPLES) {
+    if ((dict = malloc(DOWNLOADCACHE_DICTIONARY_SIZE)) == NULL) {
+      result = -1;
+    } else {
+      dictlen = ZDICT_trainFromBuffer(dict, DOWNLOADCACHE_DICTIONARY_SIZE, samples->data, samplesizes, numsamples);
+      if (ZDICT_isError(dictlen)) {
+        //not enough usable sample data
+        free(dict);
+      } else if (sqlite3_prepare_v3(handle->db, DB_SQL_DICTIONARY_ADD, -1, 0, &qry, NULL) != SQLITE_OK) {
+        free(dict);
+        result = -2;
+      } else {
+        sqlite3_bind_int64(qry, 1, ZDICT_getDictID(dict, dictlen));
+        sqlite3_bind_blob(qry, 2, dict, dictlen, free);
+        sqlite3_bind_int64(qry, 3, time(NULL));
+        if (sqlite3_step(qry) != SQLITE_DONE)
+          result = -1;
+        else
+          result = 0;
+        sqlite3_finalize(qry);
+        if (result == 0)
+          downloadcachedb_load_dictionary(handle);
+      }
+    }
+  }
+  memory_buffer_free(samples);
+  free(samplesizes);
+  return result;
+}
+
 ////////////////////////////////////////////////////////////////////////
 
 struct downloadcache {
@@ -102,6 +328,11 @@ struct downloadcache {
   sqlite3_stmt* db_add;
   sqlite3_stmt* db_get;
   sqlite3_stmt* db_del;
+  sqlite3_stmt* db_refresh;
+  sqlite3_stmt* db_getfailures;
+  sqlite3_stmt* db_gethostfailure;
+  ZSTD_CCtx* cctx;
+  ZSTD_DCtx* dctx;
 };
 
 #define PREP_SQL(var,sql) \
@@ -110,6 +341,25 @@ struct downloadcache {
     return NULL; \
   }
 
+static void* downloadcache_compress (struct downloadcache* handle, const char* data, size_t datalen, size_t* compressedlen)
+{
+  void* result;
+  size_t n;
+  n = ZSTD_compressBound(datalen);
+  if ((result = malloc(n)) == NULL)
+    return NULL;
+  if (handle->masterdb->cdict)
+    n = ZSTD_compress_usingCDict(handle->cctx, result, n, data, datalen, handle->masterdb->cdict);
+  else
+    n = ZSTD_compressCCtx(handle->cctx, result, n, data, datalen, DOWNLOADCACHE_COMPRESSION_LEVEL);
+  if (ZSTD_isError(n)) {
+    free(result);
+    return NULL;
+  }
+  *compressedlen = n;
+  return result;
+}
+
 struct downloadcache* downloadcache_create (struct downloadcachedb* masterdb)
 {
   struct downloadcache* handle;
@@ -119,10 +369,22 @@ struct downloadcache* downloadcache_create (struct downloadcachedb* masterdb)
     return NULL;
   handle->masterdb = masterdb;
   handle->db = masterdb->db;
+  //create compression contexts
+  handle->cctx = ZSTD_createCCtx();
+  handle->dctx = ZSTD_createDCtx();
+  if (!handle->cctx || !handle->dctx) {
+    ZSTD_freeCCtx(handle->cctx);
+    ZSTD_freeDCtx(handle->dctx);
+    free(handle);
+    return NULL;
+  }
   //prepare SQL statements
   PREP_SQL(db_add, DB_SQL_CACHE_ADD)
   PREP_SQL(db_get, DB_SQL_CACHE_GET)
   PREP_SQL(db_del, DB_SQL_CACHE_DEL)
+  PREP_SQL(db_refresh, DB_SQL_CACHE_REFRESH)
+  PREP_SQL(db_getfailures, DB_SQL_CACHE_GET_FAILURES)
+  PREP_SQL(db_gethostfailure, DB_SQL_CACHE_GET_HOST_FAILURE)
   return handle;
 }
 
@@ -135,26 +397,77 @@ void downloadcache_free (struct downloadcache* handle)
       sqlite3_finalize(handle->db_add);
       sqlite3_finalize(handle->db_get);
       sqlite3_finalize(handle->db_del);
+      sqlite3_finalize(handle->db_refresh);
+      sqlite3_finalize(handle->db_getfailures);
+      sqlite3_finalize(handle->db_gethostfailure);
     }
+    ZSTD_freeCCtx(handle->cctx);
+    ZSTD_freeDCtx(handle->dctx);
     free(handle);
   }
 }
 
-int downloadcache_add (struct downloadcache* handle, const char* url, const char* data, struct download_info_struct* info)
+int downloadcache_add (struct downloadcache* handle, const char* url, const char* host, const char* data, struct download_info_struct* info, const char* etag, const char* lastmodified)
 {
+  void* compresseddata = NULL;
+  size_t compressedlen;
+  size_t datalen;
+  int i;
+  int failures = 0;
+  unsigned long lifetime = 0;
+  unsigned long maxlifetime;
+  time_t now = time(NULL);
   int result = 0;
   if (!handle)
     return -1;
+  if (info && info->errorclass != DOWNLOAD_ERROR_NONE) {
+    //get number of consecutive failures so far
+    sqlite3_bind_text(handle->db_getfailures, 1, url, -1, SQLITE_STATIC);
+    if (sqlite3_step(handle->db_getfailures) == SQLITE_ROW)
+      failures = sqlite3_column_int(handle->db_getfailures, 0);
+    sqlite3_clear_bindings(handle->db_getfailures);
+    sqlite3_reset(handle->db_getfailures);
+    failures++;
+    //determine how long to cache the failure (don't keep the data returned with the error)
+    maxlifetime = (handle->masterdb->expiration ? handle->masterdb->expiration : DOWNLOADCACHE_FAILURE_MAX_LIFETIME);
+    lifetime = DOWNLOADCACHE_FAILURE_LIFETIME;
+    for (i = 1; i < failures && lifetime < maxlifetime; i++)
+      lifetime *= 2;
+    if (lifetime > maxlifetime)
+      lifetime = maxlifetime;
+    data = NULL;
+  }
   sqlite3_bind_text(handle->db_add, 1, url, -1, SQLITE_STATIC);
   sqlite3_bind_text(handle->db_add, 2, (info && info->actualurl ? *info->actualurl : NULL), -1, SQLITE_STATIC);
-  sqlite3_bind_text(handle->db_add, 3, data, -1, SQLITE_STATIC);
+  //store data compressed unless compression doesn't make it smaller
+  datalen = (data ? strlen(data) : 0);
+  if (datalen > 0 && (compresseddata = downloadcache_compress(handle, data, datalen, &compressedlen)) != NULL) {
+    if (compressedlen < datalen) {
+      sqlite3_bind_blob(handle->db_add, 3, compresseddata, compressedlen, free);
+      sqlite3_bind_int(handle->db_add, 10, DOWNLOADCACHE_COMPRESSION_ZSTD);
+    } else {
+      free(compresseddata);
+      compresseddata = NULL;
+    }
+  }
+  if (!compresseddata) {
+    sqlite3_bind_text(handle->db_add, 3, data, -1, SQLITE_STATIC);
+    sqlite3_bind_int(handle->db_add, 10, DOWNLOADCACHE_COMPRESSION_NONE);
+  }
   sqlite3_bind_text(handle->db_add, 4, (info && info->mimetype ? *info->mimetype : NULL), -1, SQLITE_STATIC);
   sqlite3_bind_int64(handle->db_add, 5, (info ? info->responsecode : -1));
   sqlite3_bind_text(handle->db_add, 6, (info && info->status ? *info->status : NULL), -1, SQLITE_STATIC);
-  sqlite3_bind_int64(handle->db_add, 7, time(NULL));
-  sqlite3_step(handle->db_add);
+  sqlite3_bind_int64(handle->db_add, 7, now);
+  sqlite3_bind_text(handle->db_add, 8, etag, -1, SQLITE_STATIC);
+  sqlite3_bind_text(handle->db_add, 9, lastmodified, -1, SQLITE_STATIC);
+  sqlite3_bind_text(handle->db_add, 11, host, -1, SQLITE_STATIC);
+  if (failures > 0) {
+    sqlite3_bind_int(handle->db_add, 12, info->errorclass);
+    sqlite3_bind_int(handle->db_add, 13, failures);
+    sqlite3_bind_int64(handle->db_add, 14, now + lifetime);
+  }
   if (sqlite3_step(handle->db_add) != SQLITE_DONE) {
-    //creation of database record failed, assuming the reason is another thread just created the entry
+    //creation of database record failed
     result = 1;
   }
   sqlite3_clear_bindings(handle->db_add);
@@ -162,45 +475,67 @@ int downloadcache_add (struct downloadcache* handle, const char* url, const char
   return result;
 }
 
-char* downloadcache_get (struct downloadcache* handle, const char* url, struct download_info_struct* info)
+char* downloadcache_get (struct downloadcache* handle, const char* url, struct download_info_struct* info, char** etag, char** lastmodified)
 {
   const char* dbdata;
   time_t cache_time = 0;
   int cache_expired = 0;
+  int cache_failure = 0;
   char* result = NULL;
+  if (etag)
+    *etag = NULL;
+  if (lastmodified)
+    *lastmodified = NULL;
   if (!handle)
     return NULL;
   if (info) {
     info->cached = 0;
     info->responsecode = -1;
+    info->errorclass = DOWNLOAD_ERROR_NONE;
   }
   sqlite3_bind_text(handle->db_get, 1, url, -1, SQLITE_STATIC);
   if (sqlite3_step(handle->db_get) == SQLITE_ROW) {
-    if (handle->masterdb->expiration && (cache_time = sqlite3_column_int64(handle->db_get, 5)) > 0 && cache_time > 0 && cache_time <= time(NULL) - handle->masterdb->expiration) {
+    if (sqlite3_column_int(handle->db_get, 9) != DOWNLOAD_ERROR_NONE) {
+      //failed download, only report it until it expires (expired failures are kept to count consecutive failures)
+      cache_failure = (sqlite3_column_int64(handle->db_get, 10) > time(NULL));
+    } else if (handle->masterdb->expiration && (cache_time = sqlite3_column_int64(handle->db_get, 5)) > 0 && cache_time <= time(NULL) - (time_t)handle->masterdb->expiration) {
       cache_expired = 1;
+      //keep expired entry if it can be revalidated
+      if (etag && lastmodified && sqlite3_column_type(handle->db_get, 2) != SQLITE_NULL && (sqlite3_column_type(handle->db_get, 6) != SQLITE_NULL || sqlite3_column_type(handle->db_get, 7) != SQLITE_NULL)) {
+        cache_expired = 0;
+        if ((dbdata = (char*)sqlite3_column_text(handle->db_get, 6)) != NULL)
+          *etag = strdup(dbdata);
+        if ((dbdata = (char*)sqlite3_column_text(handle->db_get, 7)) != NULL)
+          *lastmodified = strdup(dbdata);
+      }
+    } else if (sqlite3_column_int(handle->db_get, 8) == DOWNLOADCACHE_COMPRESSION_ZSTD) {
+      //remove entries that can't be decompressed
+      if (sqlite3_column_type(handle->db_get, 2) != SQLITE_NULL && (result = downloadcache_decompress(handle->dctx, handle->masterdb->ddict, sqlite3_column_blob(handle->db_get, 2), sqlite3_column_bytes(handle->db_get, 2))) == NULL)
+        cache_expired = 1;
     } else if ((dbdata = (char*)sqlite3_column_text(handle->db_get, 2)) != NULL) {
       result = strdup(dbdata);
-      if (info) {
-        info->cached = 1;
-        info->responsecode = sqlite3_column_int64(handle->db_get, 0);
-        if (info->status) {
-          if (*info->status)
-            free(*info->status);
-          dbdata = (char*)sqlite3_column_text(handle->db_get, 1);
-          *info->status = (dbdata ? strdup(dbdata) : NULL);
-        }
-        if (info->actualurl) {
-          if (*info->actualurl)
-            free(*info->actualurl);
-          dbdata = (char*)sqlite3_column_text(handle->db_get, 3);
-          *info->actualurl = (dbdata ? strdup(dbdata) : NULL);
-        }
-        if (info->mimetype) {
-          if (*info->mimetype)
-            free(*info->mimetype);
-          dbdata = (char*)sqlite3_column_text(handle->db_get, 4);
-          *info->mimetype = (dbdata ? strdup(dbdata) : NULL);
-        }
+    }
+    if ((result || cache_failure) && info) {
+      info->cached = 1;
+      info->responsecode = sqlite3_column_int64(handle->db_get, 0);
+      info->errorclass = sqlite3_column_int(handle->db_get, 9);
+      if (info->status) {
+        if (*info->status)
+          free(*info->status);
+        dbdata = (char*)sqlite3_column_text(handle->db_get, 1);
+        *info->status = (dbdata ? strdup(dbdata) : NULL);
+      }
+      if (info->actualurl) {
+        if (*info->actualurl)
+          free(*info->actualurl);
+        dbdata = (char*)sqlite3_column_text(handle->db_get, 3);
+        *info->actualurl = (dbdata ? strdup(dbdata) : NULL);
+      }
+      if (info->mimetype) {
+        if (*info->mimetype)
+          free(*info->mimetype);
+        dbdata = (char*)sqlite3_column_text(handle->db_get, 4);
+        *info->mimetype = (dbdata ? strdup(dbdata) : NULL);
       }
     }
   }
@@ -216,3 +551,44 @@ char* downloadcache_get (struct downloadcache* handle, const char* url, struct d
   }
   return result;
 }
+
+int downloadcache_refresh (struct downloadcache* handle, const char* url)
+{
+  int result = 0;
+  if (!handle)
+    return -1;
+  sqlite3_bind_text(handle->db_refresh, 1, url, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(handle->db_refresh, 2, time(NULL));
+  if (sqlite3_step(handle->db_refresh) != SQLITE_DONE || sqlite3_changes(handle->db) == 0)
+    result = 1;
+  sqlite3_clear_bindings(handle->db_refresh);
+  sqlite3_reset(handle->db_refresh);
+  return result;
+}
+
+int downloadcache_get_host_failure (struct downloadcache* handle, const char* host, struct download_info_struct* info)
+{
+  const char* dbdata;
+  int result = DOWNLOAD_ERROR_NONE;
+  if (!handle || !host)
+    return DOWNLOAD_ERROR_NONE;
+  sqlite3_bind_text(handle->db_gethostfailure, 1, host, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(handle->db_gethostfailure, 2, time(NULL));
+  if (sqlite3_step(handle->db_gethostfailure) == SQLITE_ROW) {
+    result = sqlite3_column_int(handle->db_gethostfailure, 0);
+    if (info) {
+      info->cached = 1;
+      info->responsecode = sqlite3_column_int64(handle->db_gethostfailure, 1);
+      info->errorclass = result;
+      if (info->status) {
+        if (*info->status)
+          free(*info->status);
+        dbdata = (char*)sqlite3_column_text(handle->db_gethostfailure, 2);
+        *info->status = (dbdata ? strdup(dbdata) : NULL);
+      }
+    }
+  }
+  sqlite3_clear_bindings(handle->db_gethostfailure);
+  sqlite3_reset(handle->db_gethostfailure);
+  return result;
+}
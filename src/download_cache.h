@@ -9,10 +9,21 @@
 extern "C" {
 #endif
 
+//!error classes of failed downloads
+#define DOWNLOAD_ERROR_NONE             0       //!< no error
+#define DOWNLOAD_ERROR_DNS              1       //!< host name could not be resolved
+#define DOWNLOAD_ERROR_CONNECT          2       //!< connection to host could not be established
+#define DOWNLOAD_ERROR_TIMEOUT          3       //!< timed out before any data was received from the host
+#define DOWNLOAD_ERROR_HTTP_CLIENT      4       //!< HTTP client error (4xx response code)
+#define DOWNLOAD_ERROR_HTTP_SERVER      5       //!< HTTP server error (5xx response code)
+#define DOWNLOAD_ERROR_OTHER            6       //!< other error
+#define DOWNLOAD_ERROR_TRANSFER_TIMEOUT 7       //!< transfer timed out after data was received (only affects this URL)
+
 //!data structure for receiving download information
 struct download_info_struct {
   int cached;                   //!< cached (non-zero if content was cached, otherwise zero)
   long responsecode;            //!< HTTP response code
+  int errorclass;               //!< class of error if the download failed (one of the DOWNLOAD_ERROR_* values), if cached is non-zero this is a recent failure that was not retried
   char** status;                //!< pointer that will (if not NULL) receive status information or error message
   char** actualurl;             //!< pointer that will (if not NULL) receive the actual URL (can be different, e.g. because of redirections)
   char** mimetype;              //!< pointer that will (if not NULL) receive the MIME type
@@ -20,6 +31,15 @@ struct download_info_struct {
 
 
 
+//!get the name of an error class
+/*!
+  \param  errorclass            error class (one of the DOWNLOAD_ERROR_* values)
+  \return name of the error class
+*/
+const char* download_error_class_name (int errorclass);
+
+
+
 //!data structure for download cache database handle
 struct downloadcachedb;
 
@@ -44,13 +64,20 @@ void downloadcachedb_free (struct downloadcachedb* handle);
 */
 int downloadcachedb_is_new (struct downloadcachedb* handle);
 
-//!purge cache (remove all expired entries)
+//!purge cache (remove all expired entries, except entries that can be revalidated using ETag or Last-Modified and failed downloads which are kept up to 30 days)
 /*!
   \param  handle                download cache handle
   \return number of entries deleted or negative on error
 */
 int downloadcachedb_purge (struct downloadcachedb* handle);
 
+//!train a zstd compression dictionary from the most recent cache entries and store it in the cache database (does nothing if there already is a dictionary or if there are not enough entries), must not be called while download cache handles created from it are in use
+/*!
+  \param  handle                download cache handle
+  \return zero if a dictionary was created, positive if no dictionary was created or negative on error
+*/
+int downloadcachedb_train_dictionary (struct downloadcachedb* handle);
+
 
 
 //!data structure for download cache handle
@@ -70,28 +97,51 @@ struct downloadcache* downloadcache_create (struct downloadcachedb* masterdb);
 */
 void downloadcache_free (struct downloadcache* handle);
 
-//!create cache entry
+//!create cache entry (data is stored compressed with zstd, using the compression dictionary if there is one)
 /*!
+  failed downloads (info->errorclass not DOWNLOAD_ERROR_NONE) are stored without data and expire sooner, the time they are kept doubles with each consecutive failure
   \param  handle                download cache handle
   \param  url                   URL used to fetch the data
+  \param  host                  host name and port of the URL as host:port (used to skip other URLs of hosts that recently failed, may be NULL)
   \param  data                  web page data
   \param  info                  structure with status information about the downloaded file
   \param  responsecode          HTTP responce code
   \param  status                status information or error message
   \param  actualurl             actual URL reported by page (can be different, e.g. because of redirections)
   \param  mimetype              MIME type
+  \param  etag                  value of ETag header (or NULL if none)
+  \param  lastmodified          value of Last-Modified header (or NULL if none)
   \return zero on success or non-zero on error
 */
-int downloadcache_add (struct downloadcache* handle, const char* url, const char* data, struct download_info_struct* info);
+int downloadcache_add (struct downloadcache* handle, const char* url, const char* host, const char* data, struct download_info_struct* info, const char* etag, const char* lastmodified);
 
 //!get cache entry
 /*!
   \param  handle                download cache handle
   \param  url                   URL
   \param  info                  structure that will receive status information about the downloaded file
-  \return web page data or NULL if unable to get page
+  \param  etag                  pointer that will receive the ETag of an expired entry that can be revalidated (may be NULL, caller must free)
+  \param  lastmodified          pointer that will receive the Last-Modified value of an expired entry that can be revalidated (may be NULL, caller must free)
+  \return web page data or NULL if unable to get page or if entry is expired (expired entries are only kept if etag and lastmodified are not NULL and the entry can be revalidated), for a recent failure NULL is returned with info->cached set and info->errorclass not DOWNLOAD_ERROR_NONE
+*/
+char* downloadcache_get (struct downloadcache* handle, const char* url, struct download_info_struct* info, char** etag, char** lastmodified);
+
+//!mark cache entry as fresh again (after the server reported it wasn't modified)
+/*!
+  \param  handle                download cache handle
+  \param  url                   URL
+  \return zero on success or non-zero on error
+*/
+int downloadcache_refresh (struct downloadcache* handle, const char* url);
+
+//!check if a host recently failed to resolve, connect or respond in time
+/*!
+  \param  handle                download cache handle
+  \param  host                  host name and port as host:port
+  \param  info                  structure that will receive the status information of the failure (only modified if a failure was found)
+  \return error class of the failure or DOWNLOAD_ERROR_NONE if the host didn't fail recently
 */
-char* downloadcache_get (struct downloadcache* handle, const char* url, struct download_info_struct* info);
+int downloadcache_get_host_failure (struct downloadcache* handle, const char* host, struct download_info_struct* info);
 
 #ifdef __cplusplus
 }
@@ -5,6 +5,8 @@
 #include <string.h>
 #include <ctype.h>
 #include <unistd.h>
+#include <time.h>
+#include <pthread.h>
 #ifdef STATIC
 #define CURL_STATICLIB 1
 #endif
@@ -12,6 +14,10 @@
 
 #define HEADER_CONTENTTYPE      "Content-Type:"
 #define HEADER_CONTENTTYPE_LEN  13
+#define HEADER_ETAG             "ETag:"
+#define HEADER_ETAG_LEN         5
+#define HEADER_LASTMODIFIED     "Last-Modified:"
+#define HEADER_LASTMODIFIED_LEN 14
 
 ////////////////////////////////////////////////////////////////////////
 
@@ -19,8 +25,27 @@ struct process_download_header_struct {
   size_t linenumber;
   char* firstline;
   char* mimetype;
+  char* etag;
+  char* lastmodified;
 };
 
+//get header value (without leading and trailing spaces) as newly allocated string
+static char* get_header_value (const char* data, size_t datalen, size_t namelen)
+{
+  char* result;
+  size_t beginpos = namelen;
+  size_t endpos = datalen;
+  while (beginpos < endpos && isspace(data[beginpos]))
+    beginpos++;
+  while (endpos > beginpos && isspace(data[endpos - 1]))
+    endpos--;
+  if (endpos == beginpos || (result = (char*)malloc(endpos - beginpos + 1)) == NULL)
+    return NULL;
+  memcpy(result, data + beginpos, endpos - beginpos);
+  result[endpos - beginpos] = 0;
+  return result;
+}
+
 static size_t process_download_header (void* data, size_t size, size_t nitems, void* userdata)
 {
   struct process_download_header_struct* info = (struct process_download_header_struct*)userdata;
@@ -52,6 +77,14 @@ static size_t process_download_header (void* data, size_t size, size_t nitems, v
       memcpy(info->mimetype, (char*)data + beginpos, fullmimetypelen);
       info->mimetype[fullmimetypelen] = 0;
     }
+  } else if (nitems >= HEADER_ETAG_LEN && strncasecmp(data, HEADER_ETAG, HEADER_ETAG_LEN) == 0) {
+    //keep ETag (from the last response in case of redirections)
+    free(info->etag);
+    info->etag = get_header_value((char*)data, nitems, HEADER_ETAG_LEN);
+  } else if (nitems >= HEADER_LASTMODIFIED_LEN && strncasecmp(data, HEADER_LASTMODIFIED, HEADER_LASTMODIFIED_LEN) == 0) {
+    //keep Last-Modified
+    free(info->lastmodified);
+    info->lastmodified = get_header_value((char*)data, nitems, HEADER_LASTMODIFIED_LEN);
   }
   return nitems;
 }
@@ -79,6 +112,26 @@ void downloader_global_cleanup ()
   curl_global_cleanup();
 }
 
+//set cURL options used for all downloads
+static void downloader_set_curl_options (CURL* curl_handle, const char* useragent)
+{
+  curl_easy_setopt(curl_handle, CURLOPT_VERBOSE, 0L);                               //hide output
+  curl_easy_setopt(curl_handle, CURLOPT_NOPROGRESS, 1L);                            //hide progress indicator
+  curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);                        //follow redirections
+  curl_easy_setopt(curl_handle, CURLOPT_MAXREDIRS, 20L);                            //maximum number of redirections to follow
+  curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYPEER, 0L);                        //don't verify the SSL peer
+  curl_easy_setopt(curl_handle, CURLOPT_SSL_VERIFYHOST, 0L);                        //don't verify the SSL host
+  //curl_easy_setopt(curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);         //avoid GnuTLS errors
+  curl_easy_setopt(curl_handle, CURLOPT_CONNECTTIMEOUT, 240L);                      //connection timeout in seconds
+  curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT, 120L);                             //download timeout in seconds
+  curl_easy_setopt(curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);                         //enable keepalive probes
+  curl_easy_setopt(curl_handle, CURLOPT_HEADERFUNCTION, process_download_header);   //set header processing callback function
+  curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, process_download_data);      //set incoming data callback function
+  curl_easy_setopt(curl_handle, CURLOPT_DIRLISTONLY, 1L);                           //only list filenames in FTP directory listings
+  if (useragent)
+    curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, useragent);                    //set the user agent
+}
+
 struct downloader* downloader_create (const char* useragent, struct downloadcachedb* cachedb, struct commonoutput_stuct* output)
 {
   struct downloader* handle;
@@ -88,21 +141,7 @@ struct downloader* downloader_create (const char* useragent, struct downloadcach
   handle->output = output;
   //inialize cURL handle
   handle->curl_handle = curl_easy_init();
-  curl_easy_setopt(handle->curl_handle, CURLOPT_VERBOSE, 0L);                               //hide output
-  curl_easy_setopt(handle->curl_handle, CURLOPT_NOPROGRESS, 1L);                            //hide progress indicator
-  curl_easy_setopt(handle->curl_handle, CURLOPT_FOLLOWLOCATION, 1L);                        //follow redirections
-  curl_easy_setopt(handle->curl_handle, CURLOPT_MAXREDIRS, 20L);                            //maximum number of redirections to follow
-  curl_easy_setopt(handle->curl_handle, CURLOPT_SSL_VERIFYPEER, 0L);                        //don't verify the SSL peer
-  curl_easy_setopt(handle->curl_handle, CURLOPT_SSL_VERIFYHOST, 0L);                        //don't verify the SSL host
-  //curl_easy_setopt(handle->curl_handle, CURLOPT_SSLVERSION, CURL_SSLVERSION_SSLv3);         //avoid GnuTLS errors
-  curl_easy_setopt(handle->curl_handle, CURLOPT_CONNECTTIMEOUT, 240L);                      //connection timeout in seconds
-  curl_easy_setopt(handle->curl_handle, CURLOPT_TIMEOUT, 120L);                             //download timeout in seconds
-  curl_easy_setopt(handle->curl_handle, CURLOPT_TCP_KEEPALIVE, 1L);                         //enable keepalive probes
-  curl_easy_setopt(handle->curl_handle, CURLOPT_HEADERFUNCTION, process_download_header);   //set header processing callback function
-  curl_easy_setopt(handle->curl_handle, CURLOPT_WRITEFUNCTION, process_download_data);      //set incoming data callback function
-  curl_easy_setopt(handle->curl_handle, CURLOPT_DIRLISTONLY, 1L);                           //only list filenames in FTP directory listings
-  if (useragent)
-    curl_easy_setopt(handle->curl_handle, CURLOPT_USERAGENT, useragent);                    //set the user agent
+  downloader_set_curl_options(handle->curl_handle, useragent);
   return handle;
 };
 
@@ -118,11 +157,9 @@ void downloader_free (struct downloader* handle)
 
 const char* custom_mimetype_ftp_listing = "FTP simple list";
 
-char* downloader_get_file (struct downloader* handle, const char* url, struct download_info_struct* info)
+//initialize/clean up data in download information
+static void download_info_reset (struct download_info_struct* info)
 {
-  char* data;
-  struct process_download_header_struct headerinfo = {0, NULL, NULL};
-  //initialize/clean up data
   if (info->status) {
     free(*info->status);
     *info->status = NULL;
@@ -137,62 +174,92 @@ char* downloader_get_file (struct downloader* handle, const char* url, struct do
   }
   info->cached = 1;
   info->responsecode = -1;
-  //try to get from cache
-  if ((data = downloadcache_get(handle->cache, url, info)) == NULL && info->responsecode == -1) {
-    //not found in cache, download
-    CURLcode curlstatus;
-    struct memory_buffer* buf;
-    info->cached = 0;
-    headerinfo.linenumber = 0;
-    if ((buf = memory_buffer_create()) == NULL)
-      return NULL;
-    //protocol specific settings
-    if (info->mimetype) {
-      struct Curl_URL* urlhandle;
-      char* urlscheme = NULL;
-      urlhandle = curl_url();
-      curl_url_set(urlhandle, CURLUPART_URL, url, 0);
-      curl_url_get(urlhandle, CURLUPART_SCHEME, &urlscheme, 0);
-      if (urlscheme) {
-        if (strcmp(urlscheme, "ftp") == 0 || strcmp(urlscheme, "ftps") == 0 || strcmp(urlscheme, "sftp") == 0)
-          headerinfo.mimetype = strdup(custom_mimetype_ftp_listing);
-      }
-      curl_free(urlscheme);
-      curl_url_cleanup(urlhandle);
-    }
-    //download
-    curl_easy_setopt(handle->curl_handle, CURLOPT_URL, url);
-    curl_easy_setopt(handle->curl_handle, CURLOPT_HEADERDATA, &headerinfo);
-    curl_easy_setopt(handle->curl_handle, CURLOPT_WRITEDATA, buf);
-    if ((curlstatus = curl_easy_perform(handle->curl_handle)) != CURLE_OK) {
-      //commonoutput_printf(handle->output, 0, "Error: %s - URL: %s\n", curl_easy_strerror(curlstatus), url);
-      //memory_buffer_free(buf);
-      memory_buffer_append_printf(buf, "libcurl error %i: %s", (int)curlstatus, curl_easy_strerror(curlstatus));
-      free(headerinfo.firstline);
-      headerinfo.firstline = memory_buffer_free_to_allocated_string(buf);
-      data = NULL;
-    } else {
-      if (info->actualurl) {
-        data = NULL;
-        if (curl_easy_getinfo(handle->curl_handle, CURLINFO_EFFECTIVE_URL, &data) == CURLE_OK)
-          *info->actualurl = (data ? strdup(data) : NULL);
-      }
-      curl_easy_getinfo(handle->curl_handle, CURLINFO_RESPONSE_CODE, &info->responsecode);
-      data = memory_buffer_free_to_allocated_string(buf);
-    }
-    //store results
-    if (info->status)
-      *info->status = headerinfo.firstline;
-    else
-      free(headerinfo.firstline);
-    if (info->mimetype)
-      *info->mimetype = headerinfo.mimetype;
-    else
-      free(headerinfo.mimetype);
-    //add to cache
-    downloadcache_add(handle->cache, url, data, info);
+  info->errorclass = DOWNLOAD_ERROR_NONE;
+}
+
+//get MIME type for protocols that return a file listing instead of a web page (returns NULL for other protocols, caller must free the result)
+static char* get_url_listing_mimetype (const char* url)
+{
+  struct Curl_URL* urlhandle;
+  char* urlscheme = NULL;
+  char* result = NULL;
+  urlhandle = curl_url();
+  curl_url_set(urlhandle, CURLUPART_URL, url, 0);
+  curl_url_get(urlhandle, CURLUPART_SCHEME, &urlscheme, 0);
+  if (urlscheme) {
+    if (strcmp(urlscheme, "ftp") == 0 || strcmp(urlscheme, "ftps") == 0 || strcmp(urlscheme, "sftp") == 0)
+      result = strdup(custom_mimetype_ftp_listing);
   }
-  //return requested information
+  curl_free(urlscheme);
+  curl_url_cleanup(urlhandle);
+  return result;
+}
+
+//get host name and port of URL as host:port (returns NULL if none, caller must free the result)
+static char* get_url_host (const char* url)
+{
+  struct Curl_URL* urlhandle;
+  char* urlhost = NULL;
+  char* urlport = NULL;
+  char* result = NULL;
+  urlhandle = curl_url();
+  if (curl_url_set(urlhandle, CURLUPART_URL, url, 0) == CURLUE_OK && curl_url_get(urlhandle, CURLUPART_HOST, &urlhost, 0) == CURLUE_OK && curl_url_get(urlhandle, CURLUPART_PORT, &urlport, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+    if ((result = (char*)malloc(strlen(urlhost) + strlen(urlport) + 2)) != NULL)
+      sprintf(result, "%s:%s", urlhost, urlport);
+  }
+  curl_free(urlhost);
+  curl_free(urlport);
+  curl_url_cleanup(urlhandle);
+  return result;
+}
+
+//determine the class of error of a download
+static int get_download_error_class (CURL* curl_handle, CURLcode curlstatus, long responsecode)
+{
+  curl_off_t downloaded = 0;
+  long headersize = 0;
+  switch (curlstatus) {
+    case CURLE_OK:
+      if (responsecode >= 500)
+        return DOWNLOAD_ERROR_HTTP_SERVER;
+      if (responsecode >= 400)
+        return DOWNLOAD_ERROR_HTTP_CLIENT;
+      return DOWNLOAD_ERROR_NONE;
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_RESOLVE_PROXY:
+      return DOWNLOAD_ERROR_DNS;
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_SSL_CONNECT_ERROR:
+      return DOWNLOAD_ERROR_CONNECT;
+    case CURLE_OPERATION_TIMEDOUT:
+      //only consider the host unreachable if nothing was received, a slow transfer of a single URL doesn't affect other URLs on the same host
+      curl_easy_getinfo(curl_handle, CURLINFO_SIZE_DOWNLOAD_T, &downloaded);
+      curl_easy_getinfo(curl_handle, CURLINFO_HEADER_SIZE, &headersize);
+      return (downloaded > 0 || headersize > 0 ? DOWNLOAD_ERROR_TRANSFER_TIMEOUT : DOWNLOAD_ERROR_TIMEOUT);
+    default:
+      return DOWNLOAD_ERROR_OTHER;
+  }
+}
+
+//get URL from cache, returns non-zero if the cached result (or a recent failure of the host) should be used, otherwise etag and lastmodified may be set for revalidation (caller must free them)
+static int downloader_get_cached (struct downloadcache* cache, const char* url, const char* host, struct download_info_struct* info, char** data, char** etag, char** lastmodified)
+{
+  if ((*data = downloadcache_get(cache, url, info, etag, lastmodified)) != NULL || info->responsecode != -1 || info->errorclass != DOWNLOAD_ERROR_NONE)
+    return 1;
+  //don't try hosts that recently couldn't be resolved, connected to or timed out
+  if (downloadcache_get_host_failure(cache, host, info) != DOWNLOAD_ERROR_NONE) {
+    free(*etag);
+    free(*lastmodified);
+    *etag = NULL;
+    *lastmodified = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+//determine what to return for downloaded or cached data
+static char* downloader_check_result (char* data, struct download_info_struct* info)
+{
   if (info->responsecode >= 400) {
     //don't return result in case of HTTP error
     free(data);
@@ -207,6 +274,123 @@ char* downloader_get_file (struct downloader* handle, const char* url, struct do
   return data;
 }
 
+//get request headers to only download the data if it was modified since it was cached (returns NULL if none, free with curl_slist_free_all())
+static struct curl_slist* get_conditional_request_headers (const char* etag, const char* lastmodified)
+{
+  struct curl_slist* headers = NULL;
+  struct memory_buffer* buf;
+  if ((!etag && !lastmodified) || (buf = memory_buffer_create()) == NULL)
+    return NULL;
+  if (etag)
+    headers = curl_slist_append(headers, memory_buffer_get(memory_buffer_set_printf(buf, "If-None-Match: %s", etag)));
+  if (lastmodified)
+    headers = curl_slist_append(headers, memory_buffer_get(memory_buffer_set_printf(buf, "If-Modified-Since: %s", lastmodified)));
+  memory_buffer_free(buf);
+  return headers;
+}
+
+//store the results of a finished download in the download information and in the cache (buf is freed)
+static char* downloader_finish_download (CURL* curl_handle, CURLcode curlstatus, struct memory_buffer* buf, struct process_download_header_struct* headerinfo, struct downloadcache* cache, const char* url, const char* host, struct download_info_struct* info)
+{
+  char* data;
+  long responsecode = -1;
+  //use cached data if it was not modified
+  if (curlstatus == CURLE_OK && curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &responsecode) == CURLE_OK && responsecode == 304 && downloadcache_refresh(cache, url) == 0) {
+    memory_buffer_free(buf);
+    free(headerinfo->firstline);
+    free(headerinfo->mimetype);
+    free(headerinfo->etag);
+    free(headerinfo->lastmodified);
+    headerinfo->firstline = NULL;
+    headerinfo->mimetype = NULL;
+    headerinfo->etag = NULL;
+    headerinfo->lastmodified = NULL;
+    download_info_reset(info);
+    data = downloadcache_get(cache, url, info, NULL, NULL);
+    return downloader_check_result(data, info);
+  }
+  if (curlstatus != CURLE_OK) {
+    //replace partially received data with the error message
+    memory_buffer_set_printf(buf, "libcurl error %i: %s", (int)curlstatus, curl_easy_strerror(curlstatus));
+    free(headerinfo->firstline);
+    headerinfo->firstline = memory_buffer_free_to_allocated_string(buf);
+    data = NULL;
+  } else {
+    if (info->actualurl) {
+      char* effectiveurl = NULL;
+      if (curl_easy_getinfo(curl_handle, CURLINFO_EFFECTIVE_URL, &effectiveurl) == CURLE_OK)
+        *info->actualurl = (effectiveurl ? strdup(effectiveurl) : NULL);
+    }
+    curl_easy_getinfo(curl_handle, CURLINFO_RESPONSE_CODE, &info->responsecode);
+    data = memory_buffer_free_to_allocated_string(buf);
+  }
+  info->errorclass = get_download_error_class(curl_handle, curlstatus, info->responsecode);
+  //store results
+  if (info->status)
+    *info->status = headerinfo->firstline;
+  else
+    free(headerinfo->firstline);
+  if (info->mimetype)
+    *info->mimetype = headerinfo->mimetype;
+  else
+    free(headerinfo->mimetype);
+  headerinfo->firstline = NULL;
+  headerinfo->mimetype = NULL;
+  //add to cache
+  downloadcache_add(cache, url, host, data, info, headerinfo->etag, headerinfo->lastmodified);
+  free(headerinfo->etag);
+  free(headerinfo->lastmodified);
+  headerinfo->etag = NULL;
+  headerinfo->lastmodified = NULL;
+  return downloader_check_result(data, info);
+}
+
+char* downloader_get_file (struct downloader* handle, const char* url, struct download_info_struct* info)
+{
+  char* data;
+  char* host;
+  char* etag;
+  char* lastmodified;
+  CURLcode curlstatus;
+  struct memory_buffer* buf;
+  struct curl_slist* headers;
+  struct process_download_header_struct headerinfo = {0, NULL, NULL, NULL, NULL};
+  //initialize/clean up data
+  download_info_reset(info);
+  //try to get from cache
+  host = get_url_host(url);
+  if (downloader_get_cached(handle->cache, url, host, info, &data, &etag, &lastmodified)) {
+    free(host);
+    return downloader_check_result(data, info);
+  }
+  //not found in cache (or expired), download
+  info->cached = 0;
+  if ((buf = memory_buffer_create()) == NULL) {
+    free(host);
+    free(etag);
+    free(lastmodified);
+    return NULL;
+  }
+  //protocol specific settings
+  if (info->mimetype)
+    headerinfo.mimetype = get_url_listing_mimetype(url);
+  //only download if modified since cached
+  headers = get_conditional_request_headers(etag, lastmodified);
+  free(etag);
+  free(lastmodified);
+  //download
+  curl_easy_setopt(handle->curl_handle, CURLOPT_URL, url);
+  curl_easy_setopt(handle->curl_handle, CURLOPT_HEADERDATA, &headerinfo);
+  curl_easy_setopt(handle->curl_handle, CURLOPT_WRITEDATA, buf);
+  curl_easy_setopt(handle->curl_handle, CURLOPT_HTTPHEADER, headers);
+  curlstatus = curl_easy_perform(handle->curl_handle);
+  curl_easy_setopt(handle->curl_handle, CURLOPT_HTTPHEADER, NULL);
+  curl_slist_free_all(headers);
+  data = downloader_finish_download(handle->curl_handle, curlstatus, buf, &headerinfo, handle->cache, url, host, info);
+  free(host);
+  return data;
+}
+
 static size_t dummy_process_download_header (void* data, size_t size, size_t nitems, void* userdata)
 {
   return nitems;
@@ -243,6 +427,371 @@ long downloader_save_file (struct downloader* handle, const char* url, const cha
 
 ////////////////////////////////////////////////////////////////////////
 
+struct downloader_multi_host;
+
+struct downloader_multi_transfer {
+  char* url;
+  char* host;
+  struct downloader_multi_host* hostinfo;
+  struct download_info_struct* info;
+  downloader_multi_callback_fn callback;
+  void* callbackdata;
+  CURL* curl_handle;
+  struct memory_buffer* buf;
+  struct curl_slist* headers;
+  struct process_download_header_struct headerinfo;
+  struct downloader_multi_transfer* next;
+};
+
+//transfers waiting for a host and information needed to apply the per host limits (only used by download thread)
+struct downloader_multi_host {
+  char* host;
+  unsigned int activetransfers;
+  double nextstart;                     //earliest time the next transfer to this host may be started
+  struct downloader_multi_transfer* waitingfirst;
+  struct downloader_multi_transfer* waitinglast;
+  struct downloader_multi_host* next;
+};
+
+struct downloader_multi {
+  struct downloadcache* cache;
+  struct commonoutput_stuct* output;
+  CURL* curl_handle;                    //handle with common options, duplicated for each transfer
+  CURLM* multi_handle;
+  CURLSH* share_handle;                 //connections, DNS and SSL sessions shared by all transfers
+  unsigned int maxtransfers;
+  unsigned int maxhosttransfers;
+  double hostinterval;                  //minimum number of seconds between starting transfers to the same host
+  unsigned int activetransfers;         //only used by download thread
+  unsigned int waitingtransfers;        //only used by download thread
+  struct downloader_multi_host* hosts;  //only used by download thread
+  struct downloader_multi_transfer* queuefirst;
+  struct downloader_multi_transfer* queuelast;
+  int stop;
+  pthread_mutex_t lock;                 //protects queue and stop flag
+  pthread_t thread;
+};
+
+//get current time in seconds (only used to determine intervals)
+static double get_monotonic_time ()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+}
+
+static void downloader_multi_transfer_free (struct downloader_multi_transfer* transfer)
+{
+  if (transfer->curl_handle)
+    curl_easy_cleanup(transfer->curl_handle);
+  if (transfer->buf)
+    memory_buffer_free(transfer->buf);
+  curl_slist_free_all(transfer->headers);
+  free(transfer->headerinfo.firstline);
+  free(transfer->headerinfo.mimetype);
+  free(transfer->headerinfo.etag);
+  free(transfer->headerinfo.lastmodified);
+  free(transfer->url);
+  free(transfer->host);
+  free(transfer);
+}
+
+//report the result of a transfer to the caller and clean up
+static void downloader_multi_transfer_done (struct downloader_multi_transfer* transfer, char* data)
+{
+  if (transfer->hostinfo)
+    transfer->hostinfo->activetransfers--;
+  (transfer->callback)(transfer->url, data, transfer->info, transfer->callbackdata);
+  downloader_multi_transfer_free(transfer);
+}
+
+//get information about host (created if it doesn't exist yet)
+static struct downloader_multi_host* downloader_multi_get_host (struct downloader_multi* handle, const char* host)
+{
+  struct downloader_multi_host* hostinfo;
+  for (hostinfo = handle->hosts; hostinfo; hostinfo = hostinfo->next) {
+    if (strcmp(hostinfo->host, host) == 0)
+      return hostinfo;
+  }
+  if ((hostinfo = (struct downloader_multi_host*)malloc(sizeof(struct downloader_multi_host))) == NULL)
+    return NULL;
+  if ((hostinfo->host = strdup(host)) == NULL) {
+    free(hostinfo);
+    return NULL;
+  }
+  hostinfo->activetransfers = 0;
+  hostinfo->nextstart = 0;
+  hostinfo->waitingfirst = NULL;
+  hostinfo->waitinglast = NULL;
+  hostinfo->next = handle->hosts;
+  handle->hosts = hostinfo;
+  return hostinfo;
+}
+
+//check if the per host limits allow starting another transfer to a host
+static int downloader_multi_host_can_start (struct downloader_multi* handle, struct downloader_multi_host* hostinfo, double now)
+{
+  if (handle->maxhosttransfers && hostinfo->activetransfers >= handle->maxhosttransfers)
+    return 0;
+  return (now >= hostinfo->nextstart);
+}
+
+//start a transfer
+static void downloader_multi_start_transfer (struct downloader_multi* handle, struct downloader_multi_transfer* transfer)
+{
+  if ((transfer->buf = memory_buffer_create()) == NULL || (transfer->curl_handle = curl_easy_duphandle(handle->curl_handle)) == NULL) {
+    downloader_multi_transfer_done(transfer, NULL);
+    return;
+  }
+  //protocol specific settings
+  if (transfer->info->mimetype)
+    transfer->headerinfo.mimetype = get_url_listing_mimetype(transfer->url);
+  curl_easy_setopt(transfer->curl_handle, CURLOPT_URL, transfer->url);
+  curl_easy_setopt(transfer->curl_handle, CURLOPT_HTTPHEADER, transfer->headers);
+  curl_easy_setopt(transfer->curl_handle, CURLOPT_HEADERDATA, &transfer->headerinfo);
+  curl_easy_setopt(transfer->curl_handle, CURLOPT_WRITEDATA, transfer->buf);
+  curl_easy_setopt(transfer->curl_handle, CURLOPT_PRIVATE, transfer);
+  if (curl_multi_add_handle(handle->multi_handle, transfer->curl_handle) != CURLM_OK) {
+    downloader_multi_transfer_done(transfer, NULL);
+    return;
+  }
+  handle->activetransfers++;
+}
+
+//take new transfers from the queue (results found in cache are reported immediately, the others wait for their host) and start waiting transfers as long as the limits allow it
+static void downloader_multi_start_queued (struct downloader_multi* handle)
+{
+  char* data;
+  char* etag;
+  char* lastmodified;
+  double now;
+  struct downloader_multi_transfer* queued;
+  struct downloader_multi_transfer* transfer;
+  struct downloader_multi_host* hostinfo;
+  //take all new transfers from queue
+  pthread_mutex_lock(&handle->lock);
+  queued = handle->queuefirst;
+  handle->queuefirst = NULL;
+  handle->queuelast = NULL;
+  pthread_mutex_unlock(&handle->lock);
+  while ((transfer = queued) != NULL) {
+    queued = transfer->next;
+    transfer->next = NULL;
+    //try to get from cache
+    download_info_reset(transfer->info);
+    transfer->host = get_url_host(transfer->url);
+    if (downloader_get_cached(handle->cache, transfer->url, transfer->host, transfer->info, &data, &etag, &lastmodified)) {
+      downloader_multi_transfer_done(transfer, downloader_check_result(data, transfer->info));
+      continue;
+    }
+    //not found in cache (or expired), wait for host
+    transfer->info->cached = 0;
+    transfer->headers = get_conditional_request_headers(etag, lastmodified);
+    free(etag);
+    free(lastmodified);
+    if ((hostinfo = downloader_multi_get_host(handle, (transfer->host ? transfer->host : ""))) == NULL) {
+      downloader_multi_transfer_done(transfer, NULL);
+      continue;
+    }
+    if (hostinfo->waitinglast)
+      hostinfo->waitinglast->next = transfer;
+    else
+      hostinfo->waitingfirst = transfer;
+    hostinfo->waitinglast = transfer;
+    handle->waitingtransfers++;
+  }
+  //start waiting transfers
+  now = get_monotonic_time();
+  for (hostinfo = handle->hosts; hostinfo && handle->waitingtransfers > 0 && handle->activetransfers < handle->maxtransfers; hostinfo = hostinfo->next) {
+    while ((transfer = hostinfo->waitingfirst) != NULL && handle->activetransfers < handle->maxtransfers && downloader_multi_host_can_start(handle, hostinfo, now)) {
+      if ((hostinfo->waitingfirst = transfer->next) == NULL)
+        hostinfo->waitinglast = NULL;
+      transfer->next = NULL;
+      handle->waitingtransfers--;
+      transfer->hostinfo = hostinfo;
+      hostinfo->activetransfers++;
+      hostinfo->nextstart = now + handle->hostinterval;
+      downloader_multi_start_transfer(handle, transfer);
+    }
+  }
+}
+
+//determine how many milliseconds to wait for network activity before the per host rate limit allows starting a waiting transfer
+static int downloader_multi_get_wait_time (struct downloader_multi* handle)
+{
+  double now;
+  double wait;
+  int result = 1000;
+  struct downloader_multi_host* hostinfo;
+  if (handle->waitingtransfers == 0 || handle->activetransfers >= handle->maxtransfers)
+    return result;
+  now = get_monotonic_time();
+  for (hostinfo = handle->hosts; hostinfo; hostinfo = hostinfo->next) {
+    if (hostinfo->waitingfirst && (!handle->maxhosttransfers || hostinfo->activetransfers < handle->maxhosttransfers)) {
+      wait = (hostinfo->nextstart - now) * 1000;
+      if (wait < result)
+        result = (wait > 0 ? (int)wait + 1 : 0);
+    }
+  }
+  return result;
+}
+
+//download thread, runs all transfers using a single cURL multi handle
+static void* downloader_multi_thread (struct downloader_multi* handle)
+{
+  int running;
+  int msgsleft;
+  int stop;
+  int queued;
+  char* data;
+  CURL* curl_handle;
+  CURLcode curlstatus;
+  CURLMsg* msg;
+  struct downloader_multi_transfer* transfer;
+  while (1) {
+    downloader_multi_start_queued(handle);
+    curl_multi_perform(handle->multi_handle, &running);
+    //process finished transfers
+    while ((msg = curl_multi_info_read(handle->multi_handle, &msgsleft)) != NULL) {
+      if (msg->msg == CURLMSG_DONE) {
+        curl_handle = msg->easy_handle;
+        curlstatus = msg->data.result;
+        transfer = NULL;
+        curl_easy_getinfo(curl_handle, CURLINFO_PRIVATE, (char**)&transfer);
+        curl_multi_remove_handle(handle->multi_handle, curl_handle);
+        handle->activetransfers--;
+        data = downloader_finish_download(curl_handle, curlstatus, transfer->buf, &transfer->headerinfo, handle->cache, transfer->url, transfer->host, transfer->info);
+        transfer->buf = NULL;
+        downloader_multi_transfer_done(transfer, data);
+      }
+    }
+    //stop when requested and all transfers are done
+    pthread_mutex_lock(&handle->lock);
+    stop = handle->stop;
+    queued = (handle->queuefirst != NULL);
+    pthread_mutex_unlock(&handle->lock);
+    if (stop && !queued && handle->waitingtransfers == 0 && handle->activetransfers == 0)
+      break;
+    //wait for network activity, new transfers or until a waiting transfer can be started
+    if (!queued)
+      curl_multi_poll(handle->multi_handle, NULL, 0, downloader_multi_get_wait_time(handle), NULL);
+  }
+  return NULL;
+}
+
+struct downloader_multi* downloader_multi_create (const char* useragent, struct downloadcachedb* cachedb, unsigned int maxtransfers, unsigned int maxhosttransfers, unsigned int maxhostrate, struct commonoutput_stuct* output)
+{
+  struct downloader_multi* handle;
+  if ((handle = (struct downloader_multi*)malloc(sizeof(struct downloader_multi))) == NULL)
+    return NULL;
+  handle->output = output;
+  handle->maxtransfers = (maxtransfers > 0 ? maxtransfers : 1);
+  handle->maxhosttransfers = maxhosttransfers;
+  handle->hostinterval = (maxhostrate > 0 ? 1.0 / maxhostrate : 0);
+  handle->activetransfers = 0;
+  handle->waitingtransfers = 0;
+  handle->hosts = NULL;
+  handle->queuefirst = NULL;
+  handle->queuelast = NULL;
+  handle->stop = 0;
+  if ((handle->curl_handle = curl_easy_init()) == NULL) {
+    free(handle);
+    return NULL;
+  }
+  if ((handle->multi_handle = curl_multi_init()) == NULL) {
+    curl_easy_cleanup(handle->curl_handle);
+    free(handle);
+    return NULL;
+  }
+  //share connections, DNS cache and SSL sessions between transfers (no locking needed as all transfers run in the download thread)
+  if ((handle->share_handle = curl_share_init()) == NULL) {
+    curl_multi_cleanup(handle->multi_handle);
+    curl_easy_cleanup(handle->curl_handle);
+    free(handle);
+    return NULL;
+  }
+  curl_share_setopt(handle->share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+  curl_share_setopt(handle->share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+  curl_share_setopt(handle->share_handle, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+  downloader_set_curl_options(handle->curl_handle, useragent);
+  curl_easy_setopt(handle->curl_handle, CURLOPT_SHARE, handle->share_handle);
+  handle->cache = downloadcache_create(cachedb);
+  pthread_mutex_init(&handle->lock, NULL);
+  //start download thread
+  if (pthread_create(&handle->thread, NULL, (void*(*)(void*))downloader_multi_thread, handle) != 0) {
+    pthread_mutex_destroy(&handle->lock);
+    downloadcache_free(handle->cache);
+    curl_multi_cleanup(handle->multi_handle);
+    curl_easy_cleanup(handle->curl_handle);
+    curl_share_cleanup(handle->share_handle);
+    free(handle);
+    return NULL;
+  }
+  return handle;
+}
+
+void downloader_multi_free (struct downloader_multi* handle)
+{
+  struct downloader_multi_host* hostinfo;
+  if (!handle)
+    return;
+  //wait for download thread to finish all transfers
+  pthread_mutex_lock(&handle->lock);
+  handle->stop = 1;
+  pthread_mutex_unlock(&handle->lock);
+  curl_multi_wakeup(handle->multi_handle);
+  pthread_join(handle->thread, NULL);
+  //clean up
+  while ((hostinfo = handle->hosts) != NULL) {
+    handle->hosts = hostinfo->next;
+    free(hostinfo->host);
+    free(hostinfo);
+  }
+  pthread_mutex_destroy(&handle->lock);
+  downloadcache_free(handle->cache);
+  curl_multi_cleanup(handle->multi_handle);
+  curl_easy_cleanup(handle->curl_handle);
+  curl_share_cleanup(handle->share_handle);
+  free(handle);
+}
+
+int downloader_multi_get_file (struct downloader_multi* handle, const char* url, struct download_info_struct* info, downloader_multi_callback_fn callback, void* callbackdata)
+{
+  struct downloader_multi_transfer* transfer;
+  if ((transfer = (struct downloader_multi_transfer*)malloc(sizeof(struct downloader_multi_transfer))) == NULL)
+    return -1;
+  if ((transfer->url = strdup(url)) == NULL) {
+    free(transfer);
+    return -1;
+  }
+  transfer->info = info;
+  transfer->callback = callback;
+  transfer->callbackdata = callbackdata;
+  transfer->curl_handle = NULL;
+  transfer->buf = NULL;
+  transfer->host = NULL;
+  transfer->hostinfo = NULL;
+  transfer->headers = NULL;
+  transfer->headerinfo.linenumber = 0;
+  transfer->headerinfo.firstline = NULL;
+  transfer->headerinfo.mimetype = NULL;
+  transfer->headerinfo.etag = NULL;
+  transfer->headerinfo.lastmodified = NULL;
+  transfer->next = NULL;
+  //add to queue and wake up download thread
+  pthread_mutex_lock(&handle->lock);
+  if (handle->queuelast)
+    handle->queuelast->next = transfer;
+  else
+    handle->queuefirst = transfer;
+  handle->queuelast = transfer;
+  pthread_mutex_unlock(&handle->lock);
+  curl_multi_wakeup(handle->multi_handle);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
 #define ISHEXDIGIT(c) ((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f'))
 #define HEXVALUE(c) (unsigned char)(c >= '0' && c <= '9' ? c - '0' : (c >= 'A' && c <= 'F' ? c - 'A' + 10 : (c >= 'a' && c <= 'f' ? c - 'a' + 10 : 0)))
 
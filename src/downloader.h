@@ -60,6 +60,50 @@ long downloader_save_file (struct downloader* handle, const char* url, const cha
 
 
 
+//!data structure for downloader handle that performs multiple simultaneous downloads in a separate thread
+struct downloader_multi;
+
+//!callback function called when a download started with downloader_multi_get_file() is finished
+/*!
+  \param  url                   URL
+  \param  data                  contents of the downloaded file or NULL on error (the callback function must free this)
+  \param  info                  structure with status information about the downloaded file
+  \param  callbackdata          callback data passed to downloader_multi_get_file()
+  \sa     downloader_multi_get_file()
+*/
+typedef void (*downloader_multi_callback_fn)(const char* url, char* data, struct download_info_struct* info, void* callbackdata);
+
+//!create downloader handle for multiple simultaneous downloads (starts the download thread), all downloads share connections, DNS cache and SSL sessions
+/*!
+  \param  useragent             user agent for web client (or NULL to set to default)
+  \param  cachedb               cache database (or NULL to not use caching)
+  \param  maxtransfers          maximum number of simultaneous downloads
+  \param  maxhosttransfers      maximum number of simultaneous downloads from the same host (0 for no limit)
+  \param  maxhostrate           maximum number of downloads started per second for the same host (0 for no limit)
+  \param  output                output to send status information to
+  \return downloader handle or NULL on error
+*/
+struct downloader_multi* downloader_multi_create (const char* useragent, struct downloadcachedb* cachedb, unsigned int maxtransfers, unsigned int maxhosttransfers, unsigned int maxhostrate, struct commonoutput_stuct* output);
+
+//!clean up downloader handle for multiple simultaneous downloads (waits until all queued downloads are finished)
+/*!
+  \param  handle                downloader handle
+*/
+void downloader_multi_free (struct downloader_multi* handle);
+
+//!queue download of file contents to memory
+/*!
+  \param  handle                downloader handle
+  \param  url                   URL
+  \param  info                  structure that will receive status information about the downloaded file (must remain valid until the callback function is called)
+  \param  callback              function called from the download thread when the download is finished (should return quickly)
+  \param  callbackdata          callback data passed to the callback function
+  \return zero on success or non-zero on error (in which case the callback function is not called)
+*/
+int downloader_multi_get_file (struct downloader_multi* handle, const char* url, struct download_info_struct* info, downloader_multi_callback_fn callback, void* callbackdata);
+
+
+
 //!decode URL encoded string
 /*!
   \param  data                  data to URL decode
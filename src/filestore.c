@@ -0,0 +1,216 @@
+#include "filestore.h"
+#include "filesystem.h"
+#include "memory_buffer.h"
+#include "winlibs_common.h"
+#include "sha256.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#define FILESTORE_COPY_BUFFER_SIZE (256 * 1024)
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+static pthread_mutex_t filestore_tempfile_lock = PTHREAD_MUTEX_INITIALIZER;
+static unsigned long filestore_tempfile_counter = 0;
+
+//copy a file (the copy is writable, executable permissions are kept)
+static int copy_file (const char* srcpath, const char* dstpath)
+{
+  int src;
+  int dst;
+  char* buf;
+  ssize_t len;
+  struct stat statbuf;
+  int result = 0;
+  if ((src = open(srcpath, O_RDONLY | O_BINARY)) == -1)
+    return 1;
+  if (fstat(src, &statbuf) != 0 || (dst = open(dstpath, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, (statbuf.st_mode & 0777) | S_IWUSR)) == -1) {
+    close(src);
+    return 2;
+  }
+  if ((buf = (char*)malloc(FILESTORE_COPY_BUFFER_SIZE)) == NULL) {
+    result = 3;
+  } else {
+    while ((len = read(src, buf, FILESTORE_COPY_BUFFER_SIZE)) > 0) {
+      if (write(dst, buf, len) != len) {
+        result = 2;
+        break;
+      }
+    }
+    if (!result && len < 0)
+      result = 1;
+    free(buf);
+  }
+  close(src);
+  if (close(dst) != 0 && !result)
+    result = 2;
+  if (result)
+    unlink(dstpath);
+  return result;
+}
+
+//clone a file if supported by the file system (shares data blocks but unlike a hard link changes to one file don't affect the other)
+static int clone_file (const char* srcpath, const char* dstpath)
+{
+#ifdef FICLONE
+  int src;
+  int dst;
+  int status;
+  struct stat statbuf;
+  if ((src = open(srcpath, O_RDONLY)) != -1) {
+    if (fstat(src, &statbuf) == 0 && (dst = open(dstpath, O_WRONLY | O_CREAT | O_EXCL, (statbuf.st_mode & 0777) | S_IWUSR)) != -1) {
+      status = ioctl(dst, FICLONE, src);
+      close(dst);
+      if (status == 0) {
+        close(src);
+        return 0;
+      }
+      unlink(dstpath);
+    }
+    close(src);
+  }
+#endif
+  return 1;
+}
+
+//create a hard link to a file
+static int link_file (const char* srcpath, const char* dstpath)
+{
+#ifdef _WIN32
+  return (CreateHardLinkA(dstpath, srcpath, NULL) ? 0 : 1);
+#else
+  return (link(srcpath, dstpath) == 0 ? 0 : 1);
+#endif
+}
+
+//make a file read-only (for a hard link this affects all links to the same file)
+static int make_file_read_only (const char* path)
+{
+#ifdef _WIN32
+  DWORD attr;
+  if ((attr = GetFileAttributesA(path)) == INVALID_FILE_ATTRIBUTES)
+    return 1;
+  if (attr & FILE_ATTRIBUTE_READONLY)
+    return 0;
+  return (SetFileAttributesA(path, attr | FILE_ATTRIBUTE_READONLY) ? 0 : 1);
+#else
+  struct stat statbuf;
+  if (stat(path, &statbuf) != 0)
+    return 1;
+  if ((statbuf.st_mode & 0222) == 0)
+    return 0;
+  return (chmod(path, statbuf.st_mode & 0555) == 0 ? 0 : 1);
+#endif
+}
+
+//create a file from a read-only file in the store: clone it if possible, otherwise hard link it (the result is read-only too), or copy it (e.g. if the store is on a different volume)
+static int clone_link_or_copy_file (const char* srcpath, const char* dstpath)
+{
+  if (clone_file(srcpath, dstpath) == 0)
+    return 0;
+  if (link_file(srcpath, dstpath) == 0)
+    return 0;
+  return copy_file(srcpath, dstpath);
+}
+
+char* filestore_get_path (const char* storepath, const char* sha256)
+{
+  int i;
+  struct memory_buffer* path;
+  //only accept valid hashes (the hash is used to build the path)
+  if (!storepath || !sha256)
+    return NULL;
+  for (i = 0; i < 64; i++) {
+    if (!isxdigit((unsigned char)sha256[i]))
+      return NULL;
+  }
+  if (sha256[i])
+    return NULL;
+  //use subfolders based on the first 2 characters of the hash to avoid very large folders
+  path = memory_buffer_create();
+  memory_buffer_set_printf(path, "%s%c%.2s%c%s", storepath, PATH_SEPARATOR, sha256, PATH_SEPARATOR, sha256);
+  return memory_buffer_free_to_allocated_string(path);
+}
+
+int filestore_get_file (const char* storepath, const char* sha256, uint64_t size, const char* dstpath)
+{
+  char* path;
+  struct stat statbuf;
+  char hash[SHA256_HEX_SIZE];
+  int result;
+  if ((path = filestore_get_path(storepath, sha256)) == NULL)
+    return -1;
+  if (stat(path, &statbuf) != 0 || !S_ISREG(statbuf.st_mode) || (uint64_t)statbuf.st_size != size) {
+    free(path);
+    return 1;
+  }
+  //verify the contents (the object may have been damaged or modified through a hard link) and remove it from the store if it doesn't match
+  if (sha256_file(path, hash) != 0 || strcasecmp(hash, sha256) != 0) {
+    fprintf(stderr, "Removing damaged file from file store: %s\n", path);
+    delete_file(path);
+    free(path);
+    return 1;
+  }
+  //make sure the object is still read-only (deleting a hard link to it on Windows requires removing the read-only attribute)
+  make_file_read_only(path);
+  delete_file(dstpath);
+  result = clone_link_or_copy_file(path, dstpath);
+  free(path);
+  return result;
+}
+
+int filestore_add_file (const char* storepath, const char* sha256, const char* srcpath)
+{
+  char* path;
+  char* p;
+  unsigned long counter;
+  struct memory_buffer* temppath;
+  int result = 0;
+  if ((path = filestore_get_path(storepath, sha256)) == NULL)
+    return -1;
+  //nothing to do if the content is already in the store
+  if (file_exists(path)) {
+    free(path);
+    return 0;
+  }
+  if ((p = strrchr(path, PATH_SEPARATOR)) != NULL) {
+    *p = 0;
+    recursive_mkdir(path);
+    *p = PATH_SEPARATOR;
+  }
+  //create under a temporary name and rename it in place (so other processes never see an incomplete file)
+  pthread_mutex_lock(&filestore_tempfile_lock);
+  counter = filestore_tempfile_counter++;
+  pthread_mutex_unlock(&filestore_tempfile_lock);
+  temppath = memory_buffer_create();
+  memory_buffer_set_printf(temppath, "%s.%lu.%lu.tmp", path, (unsigned long)getpid(), counter);
+  //store objects are read-only, so a hard link also makes the file being installed read-only
+  if ((result = clone_link_or_copy_file(srcpath, memory_buffer_get(temppath))) == 0) {
+    make_file_read_only(memory_buffer_get(temppath));
+    if (rename(memory_buffer_get(temppath), path) != 0) {
+      //another process may have added the same content in the mean time
+      if (!file_exists(path))
+        result = 1;
+      delete_file(memory_buffer_get(temppath));
+    }
+  }
+  memory_buffer_free(temppath);
+  free(path);
+  return result;
+}
@@ -0,0 +1,48 @@
+/*
+  header file for functions related to the content-addressed file store (identical files shared between installations)
+*/
+
+#ifndef INCLUDED_FILESTORE_H
+#define INCLUDED_FILESTORE_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//!get path of a file in the file store
+/*!
+  \param  storepath             path of the file store
+  \param  sha256                SHA-256 hash of the file contents as hexadecimal string
+  \return path of file in the store (whether it exists or not) or NULL if the hash is not valid, the caller must free() the result
+*/
+char* filestore_get_path (const char* storepath, const char* sha256);
+
+//!create file from the file store
+/*!
+  The contents of the file in the store are verified first, a damaged file is removed from the store.
+  The file is cloned if supported by the file system, otherwise it is hard linked (the created file is then read-only as all files in the store are) or copied.
+  \param  storepath             path of the file store
+  \param  sha256                SHA-256 hash of the file contents as hexadecimal string
+  \param  size                  size of the file
+  \param  dstpath               path of file to create (will be replaced if it exists)
+  \return 0 on success or non-zero if the file is not in the store or on error
+*/
+int filestore_get_file (const char* storepath, const char* sha256, uint64_t size, const char* dstpath);
+
+//!add file to the file store (nothing is done if the store already contains the same content)
+/*!
+  Files in the store are read-only, if the file is hard linked into the store the source file becomes read-only too.
+  \param  storepath             path of the file store
+  \param  sha256                SHA-256 hash of the file contents as hexadecimal string
+  \param  srcpath               path of the file to add
+  \return 0 on success
+*/
+int filestore_add_file (const char* storepath, const char* sha256, const char* srcpath);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_FILESTORE_H
@@ -5,6 +5,7 @@
 #include <stdlib.h>
 #include <string.h>
 #ifdef _WIN32
+#include <windows.h>
 #include <direct.h>
 #define OS_MKDIR(path) _mkdir(path)
 #else
@@ -79,8 +80,15 @@ int delete_file (const char* path)
 {
   if (!file_exists(path))
     return 1;
-  if (unlink(path) != 0)
-      return -1;
+  if (unlink(path) != 0) {
+#ifdef _WIN32
+    //read-only files (e.g. hard links to the file store) can only be deleted after removing the read-only attribute
+    DWORD attr;
+    if ((attr = GetFileAttributesA(path)) != INVALID_FILE_ATTRIBUTES && (attr & FILE_ATTRIBUTE_READONLY) && SetFileAttributesA(path, attr & ~FILE_ATTRIBUTE_READONLY) && unlink(path) == 0)
+      return 0;
+#endif
+    return -1;
+  }
   return 0;
 }
 
@@ -117,3 +125,17 @@ int write_to_file (const char* path, const char* data)
   fclose(dst);
   return 0;
 }
+
+int get_processor_count ()
+{
+#ifdef _WIN32
+  SYSTEM_INFO sysinfo;
+  GetSystemInfo(&sysinfo);
+  return (sysinfo.dwNumberOfProcessors > 0 ? (int)sysinfo.dwNumberOfProcessors : 1);
+#elif defined(_SC_NPROCESSORS_ONLN)
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return (n > 0 ? (int)n : 1);
+#else
+  return 1;
+#endif
+}
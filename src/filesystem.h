@@ -54,6 +54,12 @@ char* readline_from_file (FILE* f);
 */
 int write_to_file (const char* path, const char* data);
 
+//!get number of processors
+/*!
+  \return number of processors available to the current process (at least 1)
+*/
+int get_processor_count ();
+
 #ifdef __cplusplus
 }
 #endif
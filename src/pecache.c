@@ -0,0 +1,167 @@
+#include "pecache.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+
+////////////////////////////////////////////////////////////////////////
+
+#define PECACHE_VERSION 1
+
+//time to wait for other processes writing to the same cache (e.g. packages being created in parallel)
+#define PECACHE_BUSY_TIMEOUT_MS 30000
+
+static const char* pecache_sql_create[] = {
+  //database version 1
+  "CREATE TABLE dbinfo (" \
+  " version INT NOT NULL," \
+  " created INT NOT NULL" \
+  ");" \
+  "CREATE TABLE pe_imports (" \
+  " sha256 TEXT PRIMARY KEY NOT NULL," \
+  " imports TEXT NOT NULL," \
+  " added INT NOT NULL" \
+  ");"
+};
+
+#define DB_SQL_BEGIN_TRANSACTION "BEGIN IMMEDIATE TRANSACTION;"
+#define DB_SQL_END_TRANSACTION "COMMIT TRANSACTION;"
+#define DB_SQL_ABORT_TRANSACTION "ROLLBACK TRANSACTION;"
+#define DB_SQL_GET_DBVERSION "SELECT MAX(version) FROM dbinfo"
+#define DB_SQL_SET_DBVERSION "INSERT INTO dbinfo (version, created) VALUES (?, strftime('%s','now'))"
+#define DB_SQL_GET_IMPORTS "SELECT imports FROM pe_imports WHERE sha256=?"
+#define DB_SQL_SET_IMPORTS "INSERT OR REPLACE INTO pe_imports (sha256, imports, added) VALUES (?, ?, strftime('%s','now'))"
+
+struct pecache_handle_struct {
+  sqlite3* db;
+  sqlite3_stmt* db_imports_get;
+  sqlite3_stmt* db_imports_set;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static int64_t pecache_get_dbversion (sqlite3* db)
+{
+  int64_t result = 0;
+  sqlite3_stmt* sqlresult;
+  if (sqlite3_prepare_v2(db, DB_SQL_GET_DBVERSION, -1, &sqlresult, NULL) == SQLITE_OK) {
+    if (sqlite3_step(sqlresult) == SQLITE_ROW)
+      result = sqlite3_column_int64(sqlresult, 0);
+    sqlite3_finalize(sqlresult);
+  }
+  return result;
+}
+
+static int pecache_upgrade_database (sqlite3* db)
+{
+  int64_t dbversion;
+  sqlite3_stmt* sqlresult;
+  if (sqlite3_exec(db, DB_SQL_BEGIN_TRANSACTION, NULL, NULL, NULL) != SQLITE_OK)
+    return -1;
+  //check again now that the database is locked (another process may have created it in the meantime)
+  for (dbversion = pecache_get_dbversion(db); dbversion < PECACHE_VERSION; dbversion++) {
+    if (sqlite3_exec(db, pecache_sql_create[dbversion], NULL, NULL, NULL) != SQLITE_OK)
+      break;
+    if (sqlite3_prepare_v2(db, DB_SQL_SET_DBVERSION, -1, &sqlresult, NULL) != SQLITE_OK)
+      break;
+    sqlite3_bind_int64(sqlresult, 1, dbversion + 1);
+    sqlite3_step(sqlresult);
+    sqlite3_finalize(sqlresult);
+  }
+  if (dbversion < PECACHE_VERSION) {
+    sqlite3_exec(db, DB_SQL_ABORT_TRANSACTION, NULL, NULL, NULL);
+    return 1;
+  }
+  return (sqlite3_exec(db, DB_SQL_END_TRANSACTION, NULL, NULL, NULL) == SQLITE_OK ? 0 : 2);
+}
+
+#define PREP_SQL(var,sql) \
+  if (sqlite3_prepare_v3(handle->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &handle->var, NULL) != SQLITE_OK) { \
+    pecache_close(handle); \
+    return NULL; \
+  }
+
+pecache_handle pecache_open (const char* path)
+{
+  struct pecache_handle_struct* handle;
+  if (!path || !*path)
+    return NULL;
+  if ((handle = (struct pecache_handle_struct*)calloc(1, sizeof(struct pecache_handle_struct))) == NULL)
+    return NULL;
+  //open database
+  if (sqlite3_open(path, &handle->db) != SQLITE_OK) {
+    pecache_close(handle);
+    return NULL;
+  }
+  sqlite3_busy_timeout(handle->db, PECACHE_BUSY_TIMEOUT_MS);
+  //create database if it doesn't exist or upgrade to current level if needed
+  if (pecache_get_dbversion(handle->db) < PECACHE_VERSION && pecache_upgrade_database(handle->db) != 0) {
+    pecache_close(handle);
+    return NULL;
+  }
+  //prepare SQL statements
+  PREP_SQL(db_imports_get, DB_SQL_GET_IMPORTS)
+  PREP_SQL(db_imports_set, DB_SQL_SET_IMPORTS)
+  return handle;
+}
+
+#undef PREP_SQL
+
+void pecache_close (pecache_handle handle)
+{
+  if (handle) {
+    if (handle->db) {
+      sqlite3_finalize(handle->db_imports_get);
+      sqlite3_finalize(handle->db_imports_set);
+      sqlite3_close(handle->db);
+    }
+    free(handle);
+  }
+}
+
+char* pecache_get_imports (pecache_handle handle, const char* sha256)
+{
+  const char* imports;
+  char* result = NULL;
+  if (!handle || !sha256 || !*sha256)
+    return NULL;
+  sqlite3_bind_text(handle->db_imports_get, 1, sha256, -1, SQLITE_STATIC);
+  if (sqlite3_step(handle->db_imports_get) == SQLITE_ROW) {
+    if ((imports = (const char*)sqlite3_column_text(handle->db_imports_get, 0)) != NULL)
+      result = strdup(imports);
+  }
+  sqlite3_clear_bindings(handle->db_imports_get);
+  sqlite3_reset(handle->db_imports_get);
+  return result;
+}
+
+int pecache_begin_update (pecache_handle handle)
+{
+  if (!handle)
+    return -1;
+  return (sqlite3_exec(handle->db, DB_SQL_BEGIN_TRANSACTION, NULL, NULL, NULL) == SQLITE_OK ? 0 : 1);
+}
+
+int pecache_set_imports (pecache_handle handle, const char* sha256, const char* imports)
+{
+  int status;
+  if (!handle || !sha256 || !*sha256 || !imports)
+    return -1;
+  sqlite3_bind_text(handle->db_imports_set, 1, sha256, -1, SQLITE_STATIC);
+  sqlite3_bind_text(handle->db_imports_set, 2, imports, -1, SQLITE_STATIC);
+  status = sqlite3_step(handle->db_imports_set);
+  sqlite3_clear_bindings(handle->db_imports_set);
+  sqlite3_reset(handle->db_imports_set);
+  return (status == SQLITE_DONE ? 0 : status);
+}
+
+int pecache_end_update (pecache_handle handle)
+{
+  if (!handle)
+    return -1;
+  if (sqlite3_exec(handle->db, DB_SQL_END_TRANSACTION, NULL, NULL, NULL) != SQLITE_OK) {
+    sqlite3_exec(handle->db, DB_SQL_ABORT_TRANSACTION, NULL, NULL, NULL);
+    return 1;
+  }
+  return 0;
+}
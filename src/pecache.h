@@ -0,0 +1,63 @@
+/*
+  header file for functions related to the cache of DLL imports of PE files (indexed by SHA-256 hash of the file contents)
+*/
+
+#ifndef INCLUDED_PECACHE_H
+#define INCLUDED_PECACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//!handle type used for accessing the PE import cache
+typedef struct pecache_handle_struct* pecache_handle;
+
+//!open PE import cache (created if it doesn't exist yet)
+/*!
+  \param  path                  path of cache database file
+  \return a handle on success or NULL on error
+*/
+pecache_handle pecache_open (const char* path);
+
+//!close PE import cache
+/*!
+  \param  handle                PE import cache handle
+*/
+void pecache_close (pecache_handle handle);
+
+//!get DLL imports of a PE file from the cache
+/*!
+  \param  handle                PE import cache handle
+  \param  sha256                SHA-256 hash of the PE file as hexadecimal string
+  \return newline separated list of imported DLL names (empty string if the file has no imports) or NULL if not in the cache, the caller must free() the result
+*/
+char* pecache_get_imports (pecache_handle handle, const char* sha256);
+
+//!start adding entries to the PE import cache (all entries are written in one transaction)
+/*!
+  \param  handle                PE import cache handle
+  \return 0 on success
+*/
+int pecache_begin_update (pecache_handle handle);
+
+//!add DLL imports of a PE file to the cache
+/*!
+  \param  handle                PE import cache handle
+  \param  sha256                SHA-256 hash of the PE file as hexadecimal string
+  \param  imports               newline separated list of imported DLL names
+  \return 0 on success
+*/
+int pecache_set_imports (pecache_handle handle, const char* sha256, const char* imports);
+
+//!finish adding entries to the PE import cache
+/*!
+  \param  handle                PE import cache handle
+  \return 0 on success
+*/
+int pecache_end_update (pecache_handle handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_PECACHE_H
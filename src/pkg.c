@@ -19,6 +19,20 @@ const char* package_metadata_field_name[] = {
   NULL
 };
 
+static int package_file_info_cmp_path (const char* data1, const char* data2)
+{
+  return strcmp(((struct package_file_info_struct*)data1)->path, ((struct package_file_info_struct*)data2)->path);
+}
+
+static void package_file_info_free (struct package_file_info_struct* fileinfo)
+{
+  if (fileinfo) {
+    free(fileinfo->path);
+    free(fileinfo->sha256);
+    free(fileinfo);
+  }
+}
+
 struct package_metadata_struct* package_metadata_create ()
 {
   int i;
@@ -31,6 +45,7 @@ struct package_metadata_struct* package_metadata_create ()
   pkginfo->folderexclusions = sorted_unique_list_create(strcmp, free);
   pkginfo->filelist = sorted_unique_list_create(strcmp, free);
   pkginfo->folderlist = sorted_unique_list_create(strcmp, free);
+  pkginfo->fileinfo = sorted_unique_list_create(package_file_info_cmp_path, (sorted_unique_free_fn)package_file_info_free);
   pkginfo->dependencies = sorted_unique_list_create(strcmp, free);
   pkginfo->optionaldependencies = sorted_unique_list_create(strcmp, free);
   pkginfo->builddependencies = sorted_unique_list_create(strcmp, free);
@@ -57,6 +72,7 @@ void package_metadata_free (struct package_metadata_struct* pkginfo)
   sorted_unique_list_free(pkginfo->folderexclusions);
   sorted_unique_list_free(pkginfo->filelist);
   sorted_unique_list_free(pkginfo->folderlist);
+  sorted_unique_list_free(pkginfo->fileinfo);
   sorted_unique_list_free(pkginfo->dependencies);
   sorted_unique_list_free(pkginfo->optionaldependencies);
   sorted_unique_list_free(pkginfo->builddependencies);
@@ -65,3 +81,51 @@ void package_metadata_free (struct package_metadata_struct* pkginfo)
     (*(pkginfo->extradata_free_fn))(pkginfo->extradata);
   free(pkginfo);
 }
+
+int package_metadata_set_file_info (struct package_metadata_struct* metadata, const char* path, const char* sha256, uint64_t size)
+{
+  struct package_file_info_struct searchfileinfo;
+  struct package_file_info_struct* fileinfo;
+  if (!metadata || !path || !sha256)
+    return -1;
+  //update existing entry
+  searchfileinfo.path = (char*)path;
+  if ((fileinfo = (struct package_file_info_struct*)sorted_unique_list_search(metadata->fileinfo, (char*)&searchfileinfo)) != NULL) {
+    free(fileinfo->sha256);
+    fileinfo->sha256 = strdup(sha256);
+    fileinfo->size = size;
+    fileinfo->mtime = 0;
+    return 0;
+  }
+  //add new entry
+  if ((fileinfo = (struct package_file_info_struct*)malloc(sizeof(struct package_file_info_struct))) == NULL)
+    return -1;
+  fileinfo->path = strdup(path);
+  fileinfo->sha256 = strdup(sha256);
+  fileinfo->size = size;
+  fileinfo->mtime = 0;
+  sorted_unique_list_add_allocated(metadata->fileinfo, (char*)fileinfo);
+  return 0;
+}
+
+const struct package_file_info_struct* package_metadata_get_file_info (const struct package_metadata_struct* metadata, const char* path)
+{
+  struct package_file_info_struct searchfileinfo;
+  if (!metadata || !path)
+    return NULL;
+  searchfileinfo.path = (char*)path;
+  return (const struct package_file_info_struct*)sorted_unique_list_search(metadata->fileinfo, (char*)&searchfileinfo);
+}
+
+int package_metadata_set_file_mtime (struct package_metadata_struct* metadata, const char* path, int64_t mtime)
+{
+  struct package_file_info_struct searchfileinfo;
+  struct package_file_info_struct* fileinfo;
+  if (!metadata || !path)
+    return -1;
+  searchfileinfo.path = (char*)path;
+  if ((fileinfo = (struct package_file_info_struct*)sorted_unique_list_search(metadata->fileinfo, (char*)&searchfileinfo)) == NULL)
+    return -1;
+  fileinfo->mtime = mtime;
+  return 0;
+}
@@ -41,6 +41,14 @@ extern "C" {
  */
 extern const char* package_metadata_field_name[];
 
+//!data structure for content information of a file in a package
+struct package_file_info_struct {
+  char* path;                   //!< relative path of file (must be first member, used for sorting)
+  char* sha256;                 //!< SHA-256 hash of file contents as hexadecimal string
+  uint64_t size;                //!< file size in bytes
+  int64_t mtime;                //!< modification time of installed file (only known for installed packages, 0 if unknown)
+};
+
 //!data structure for package information
 struct package_metadata_struct {
   char* datafield[PACKAGE_METADATA_TOTAL_FIELDS];
@@ -48,6 +56,7 @@ struct package_metadata_struct {
   sorted_unique_list* folderexclusions;
   sorted_unique_list* filelist;
   sorted_unique_list* folderlist;
+  sorted_unique_list* fileinfo;
   sorted_unique_list* dependencies;
   sorted_unique_list* optionaldependencies;
   sorted_unique_list* builddependencies;
@@ -67,6 +76,33 @@ struct package_metadata_struct* package_metadata_create ();
 //!clean up data structure for package information
 void package_metadata_free (struct package_metadata_struct* metadata);
 
+//!set content information (hash and size) of a file in a package
+/*!
+  \param  metadata              package information
+  \param  path                  relative path of file
+  \param  sha256                SHA-256 hash of file contents as hexadecimal string
+  \param  size                  file size in bytes
+  \return 0 on success
+*/
+int package_metadata_set_file_info (struct package_metadata_struct* metadata, const char* path, const char* sha256, uint64_t size);
+
+//!get content information (hash and size) of a file in a package
+/*!
+  \param  metadata              package information
+  \param  path                  relative path of file
+  \return file content information or NULL if not known
+*/
+const struct package_file_info_struct* package_metadata_get_file_info (const struct package_metadata_struct* metadata, const char* path);
+
+//!set modification time of an installed file in a package (content information must already be set)
+/*!
+  \param  metadata              package information
+  \param  path                  relative path of file
+  \param  mtime                 modification time of installed file (0 if unknown)
+  eturn 0 on success
+*/
+int package_metadata_set_file_mtime (struct package_metadata_struct* metadata, const char* path, int64_t mtime);
+
 #ifdef __cplusplus
 }
 #endif
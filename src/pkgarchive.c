@@ -0,0 +1,172 @@
+#include "pkgarchive.h"
+#include "filesystem.h"
+#include <stdio.h>
+#include <string.h>
+#if defined(_WIN32) && !defined(__MINGW64_VERSION_MAJOR)
+#define strcasecmp stricmp
+#endif
+
+#define CONTAINER_7ZIP  0
+#define CONTAINER_TAR   1
+#define CONTAINER_ZIP   2
+
+#define FILTER_NONE     0
+#define FILTER_ZSTD     1
+#define FILTER_XZ       2
+#define FILTER_GZIP     3
+#define FILTER_BZIP2    4
+#define FILTER_LZ4      5
+
+//list of supported formats (the first one is the default, formats sharing a suffix must be listed longest extension first)
+static const struct package_archive_format_struct package_archive_formats[] = {
+  {"7z",      ".7z",      CONTAINER_7ZIP, FILTER_NONE,  9,  0},
+  {"tar.zst", ".tar.zst", CONTAINER_TAR,  FILTER_ZSTD,  19, 1},
+  {"tar.xz",  ".tar.xz",  CONTAINER_TAR,  FILTER_XZ,    9,  1},
+  {"tar.gz",  ".tar.gz",  CONTAINER_TAR,  FILTER_GZIP,  9,  0},
+  {"tar.bz2", ".tar.bz2", CONTAINER_TAR,  FILTER_BZIP2, 9,  0},
+  {"tar.lz4", ".tar.lz4", CONTAINER_TAR,  FILTER_LZ4,   9,  0},
+  {"tar",     ".tar",     CONTAINER_TAR,  FILTER_NONE,  -1, 0},
+  {"zip",     ".zip",     CONTAINER_ZIP,  FILTER_NONE,  9,  0},
+  {NULL, NULL, 0, 0, 0, 0}
+};
+
+//alternative names accepted for some formats
+static const struct {
+  const char* alias;
+  const char* name;
+} package_archive_format_aliases[] = {
+  {"7zip",    "7z"},
+  {"tzst",    "tar.zst"},
+  {"tar.zstd","tar.zst"},
+  {"txz",     "tar.xz"},
+  {"tgz",     "tar.gz"},
+  {"tbz2",    "tar.bz2"},
+  {NULL, NULL}
+};
+
+const struct package_archive_format_struct* package_archive_get_format (const char* name)
+{
+  size_t i;
+  if (!name || !*name)
+    name = PACKAGE_ARCHIVE_DEFAULT_FORMAT;
+  if (*name == '.')
+    name++;
+  for (i = 0; package_archive_format_aliases[i].alias; i++) {
+    if (strcasecmp(name, package_archive_format_aliases[i].alias) == 0) {
+      name = package_archive_format_aliases[i].name;
+      break;
+    }
+  }
+  for (i = 0; package_archive_formats[i].name; i++) {
+    if (strcasecmp(name, package_archive_formats[i].name) == 0)
+      return &package_archive_formats[i];
+  }
+  return NULL;
+}
+
+const struct package_archive_format_struct* package_archive_get_format_by_index (size_t index)
+{
+  if (index >= sizeof(package_archive_formats) / sizeof(package_archive_formats[0]) - 1)
+    return NULL;
+  return &package_archive_formats[index];
+}
+
+size_t package_archive_extension_length (const char* filename)
+{
+  size_t i;
+  size_t len;
+  size_t extlen;
+  if (!filename)
+    return 0;
+  len = strlen(filename);
+  for (i = 0; package_archive_formats[i].name; i++) {
+    extlen = strlen(package_archive_formats[i].extension);
+    if (len > extlen && strcasecmp(filename + len - extlen, package_archive_formats[i].extension) == 0)
+      return extlen;
+  }
+  return 0;
+}
+
+int package_archive_write_setup (struct archive* a, const struct package_archive_format_struct* format, int level, int threads)
+{
+  int status;
+  char value[16];
+  if (!format)
+    format = package_archive_get_format(NULL);
+  //set archive container format
+  switch (format->container) {
+    case CONTAINER_7ZIP:
+      status = archive_write_set_format_7zip(a);
+      break;
+    case CONTAINER_ZIP:
+      status = archive_write_set_format_zip(a);
+      break;
+    default:
+      status = archive_write_set_format_pax_restricted(a);
+      break;
+  }
+  if (status != ARCHIVE_OK)
+    return 1;
+  //add compression filter
+  switch (format->filter) {
+    case FILTER_ZSTD:
+      status = archive_write_add_filter_zstd(a);
+      break;
+    case FILTER_XZ:
+      status = archive_write_add_filter_xz(a);
+      break;
+    case FILTER_GZIP:
+      status = archive_write_add_filter_gzip(a);
+      break;
+    case FILTER_BZIP2:
+      status = archive_write_add_filter_bzip2(a);
+      break;
+    case FILTER_LZ4:
+      status = archive_write_add_filter_lz4(a);
+      break;
+    default:
+      status = ARCHIVE_OK;
+      break;
+  }
+  //libarchive returns a warning when an external program is used instead of the built-in compressor
+  if (status != ARCHIVE_OK && status != ARCHIVE_WARN)
+    return 2;
+  //set compression level
+  if (level < 0)
+    level = format->defaultlevel;
+  if (level >= 0) {
+    snprintf(value, sizeof(value), "%i", level);
+    if (format->filter != FILTER_NONE)
+      status = archive_write_set_filter_option(a, NULL, "compression-level", value);
+    else
+      status = archive_write_set_format_option(a, NULL, "compression-level", value);
+    if (status != ARCHIVE_OK)
+      return 3;
+  }
+  //set number of compression threads (older libarchive versions don't know this option, so failure is not an error)
+  if (format->threaded) {
+    if (threads <= 0)
+      threads = get_processor_count();
+    snprintf(value, sizeof(value), "%i", threads);
+    archive_write_set_filter_option(a, NULL, "threads", value);
+    archive_clear_error(a);
+  }
+  //don't store the time of creation in the gzip header so the same input results in the same package file
+  if (format->filter == FILTER_GZIP) {
+    archive_write_set_filter_option(a, "gzip", "timestamp", NULL);
+    archive_clear_error(a);
+  }
+  return 0;
+}
+
+void package_archive_read_setup (struct archive* a)
+{
+  archive_read_support_format_7zip(a);
+  archive_read_support_format_tar(a);
+  archive_read_support_format_zip(a);
+  archive_read_support_filter_zstd(a);
+  archive_read_support_filter_xz(a);
+  archive_read_support_filter_gzip(a);
+  archive_read_support_filter_bzip2(a);
+  archive_read_support_filter_lz4(a);
+}
@@ -0,0 +1,72 @@
+/*
+  header file for functions related to the archive format of package files
+*/
+
+#ifndef INCLUDED_PKGARCHIVE_H
+#define INCLUDED_PKGARCHIVE_H
+
+#include <stdlib.h>
+#include <archive.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//!default package file format
+#define PACKAGE_ARCHIVE_DEFAULT_FORMAT "7z"
+
+//!list of supported package file formats (used in help texts)
+#define PACKAGE_ARCHIVE_FORMAT_LIST "7z, tar.zst, tar.xz, tar.gz, tar.bz2, tar.lz4, tar or zip"
+
+//!package file format definition
+struct package_archive_format_struct {
+  const char* name;             //format name as specified by the user
+  const char* extension;        //package file extension (including leading dot)
+  int container;                //archive container format (internal)
+  int filter;                   //compression filter (internal)
+  int defaultlevel;             //default compression level (-1 to use the libarchive default)
+  int threaded;                 //non-zero if the compressor supports multiple threads
+};
+
+//!get package file format by name
+/*!
+  \param  name                  format name (case insensitive, optionally with leading dot), NULL or empty for the default format
+  \return format definition or NULL if not supported
+*/
+const struct package_archive_format_struct* package_archive_get_format (const char* name);
+
+//!get package file format by index
+/*!
+  \param  index                 zero-based index
+  \return format definition or NULL if index is out of range
+*/
+const struct package_archive_format_struct* package_archive_get_format_by_index (size_t index);
+
+//!get length of package file extension at the end of a filename
+/*!
+  \param  filename              package filename
+  \return length of the extension (including leading dot) or 0 if filename doesn't end with a known package file extension
+*/
+size_t package_archive_extension_length (const char* filename);
+
+//!configure archive for writing a package file
+/*!
+  \param  a                     archive created with archive_write_new()
+  \param  format                package file format
+  \param  level                 compression level (negative for the format default)
+  \param  threads               number of compression threads (0 for number of processors), ignored by formats that don't support multiple threads
+  \return 0 on success or non-zero on error (see archive_error_string())
+*/
+int package_archive_write_setup (struct archive* a, const struct package_archive_format_struct* format, int level, int threads);
+
+//!configure archive for reading any supported package file format
+/*!
+  \param  a                     archive created with archive_read_new()
+*/
+void package_archive_read_setup (struct archive* a);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_PKGARCHIVE_H
@@ -9,7 +9,8 @@
 
 ////////////////////////////////////////////////////////////////////////
 
-#define PKGDB_VERSION 2
+#define PKGDB_VERSION 6
+#define PKGDB_BUSY_TIMEOUT_MS 30000
 
 const char* pkgdb_sql_create[] = {
   //database version 1
@@ -62,7 +63,27 @@ const char* pkgdb_sql_create[] = {
   ");" \
   "CREATE INDEX idx_package_category_package ON package_category (package);" \
   "CREATE INDEX idx_package_category_category ON package_category (category);" \
-  "CREATE UNIQUE INDEX idx_package_category_package_category ON package_category (package, category);"
+  "CREATE UNIQUE INDEX idx_package_category_package_category ON package_category (package, category);",
+  //database version 3
+  "CREATE TABLE install_journal (" \
+  " staging TEXT PRIMARY KEY NOT NULL," \
+  " package TEXT," \
+  " state INT NOT NULL," \
+  " created INT NOT NULL" \
+  ");" \
+  "CREATE TABLE install_journal_path (" \
+  " staging TEXT NOT NULL," \
+  " path TEXT NOT NULL," \
+  " FOREIGN KEY(staging) REFERENCES install_journal(staging)" \
+  ");" \
+  "CREATE INDEX idx_install_journal_path_staging ON install_journal_path (staging);",
+  //database version 4
+  "ALTER TABLE package_path ADD COLUMN sha256 TEXT;" \
+  "ALTER TABLE package_path ADD COLUMN size INT;",
+  //database version 5
+  "CREATE INDEX idx_package_path_path_nocase ON package_path (path COLLATE NOCASE);",
+  //database version 6
+  "ALTER TABLE package_path ADD COLUMN mtime INT;"
 };
 
 #define SQL_BEGIN_TRANSACTION "BEGIN TRANSACTION;"
@@ -71,19 +92,31 @@ const char* pkgdb_sql_create[] = {
 #define SQL_GET_DBVERSION "SELECT MAX(version) FROM dbinfo"
 #define SQL_SET_DBVERSION "INSERT INTO dbinfo (version, created) VALUES (?, strftime('%s','now'));"
 #define SQL_GET_PACKAGE_VERSION "SELECT version FROM package WHERE basename=?"
+#define SQL_GET_PACKAGE_INSTALLED "SELECT installed FROM package WHERE basename=?"
+#define SQL_FIND_FILE_PACKAGE "SELECT package FROM package_path WHERE path=? COLLATE NOCASE AND type=0 ORDER BY package LIMIT 1"
 #define SQL_DEL_PACKAGE "DELETE FROM package WHERE basename=?"
 #define SQL_DEL_PACKAGE_PATHS "DELETE FROM package_path WHERE package=?"
 #define SQL_DEL_PACKAGE_DEPENDENCIES "DELETE FROM package_dependency WHERE package=?"
 #define SQL_ADD_PACKAGE "INSERT INTO package (basename, version, name, description, url, downloadurl, downloadsourceurl, category, type, versiondate, licensefile, licensetype, status, installed) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, strftime('%s','now'))"
 #define SQL_ADD_PACKAGE_PATH "INSERT INTO package_path (package, type, path) VALUES (?, ?, ?)"
+#define SQL_ADD_PACKAGE_FILE "INSERT INTO package_path (package, type, path, sha256, size, mtime) VALUES (?, ?, ?, ?, ?, ?)"
 #define SQL_ADD_PACKAGE_DEPENDENCY "INSERT INTO package_dependency (package, type, name) VALUES (?, ?, ?)"
 #define SQL_SELECT_PACKAGE "SELECT basename, version, name, description, url, downloadurl, downloadsourceurl, category, type, versiondate, licensefile, licensetype, status, installed FROM package"
 #define SQL_GET_PACKAGE SQL_SELECT_PACKAGE " WHERE basename=?"
 #define SQL_GET_PACKAGE_DEPENDENCIES "SELECT type, name FROM package_dependency WHERE package=?"
-#define SQL_GET_PACKAGE_PATHS "SELECT type, path FROM package_path WHERE package=?"
+#define SQL_GET_ALL_PACKAGE_DEPENDENCIES "SELECT type, name, package FROM package_dependency ORDER BY package"
+#define SQL_GET_PACKAGE_PATHS "SELECT type, path, sha256, size, mtime FROM package_path WHERE package=?"
 #define SQL_GET_PACKAGE_FILES_OR_FOLDERS "SELECT path FROM package_path WHERE package=? AND type=?"
+#define SQL_GET_PACKAGE_ORPHANED_FOLDERS "SELECT path FROM package_path WHERE package=?1 AND type=?2 AND path NOT IN (SELECT path FROM package_path WHERE package<>?1 AND type=?2)"
 #define SQL_SET_PACKAGE_CATEGORY "INSERT INTO package_category (package, category, created) VALUES (?, ?, strftime('%s','now'))"
 #define SQL_DEL_PACKAGE_CATEGORIES "DELETE FROM package_category WHERE package=?"
+#define SQL_ADD_JOURNAL "INSERT OR REPLACE INTO install_journal (staging, package, state, created) VALUES (?, NULL, 0, strftime('%s','now'))"
+#define SQL_SET_JOURNAL_COMMITTED "UPDATE install_journal SET package=?, state=? WHERE staging=?"
+#define SQL_ADD_JOURNAL_PATH "INSERT INTO install_journal_path (staging, path) VALUES (?, ?)"
+#define SQL_GET_JOURNAL_PATHS "SELECT path FROM install_journal_path WHERE staging=?"
+#define SQL_GET_JOURNAL_PENDING "SELECT staging, package, state FROM install_journal ORDER BY created LIMIT 1"
+#define SQL_DEL_JOURNAL "DELETE FROM install_journal WHERE staging=?"
+#define SQL_DEL_JOURNAL_PATHS "DELETE FROM install_journal_path WHERE staging=?"
 
 #define PACKAGE_DEPENDENCY_TYPE_OPTIONAL         0
 #define PACKAGE_DEPENDENCY_TYPE_MANDATORY        1
@@ -304,6 +337,19 @@ struct pkgdb_handle_struct {
   char* rootpath;
 };
 
+int pkgdb_exists (const char* rootpath)
+{
+  int result;
+  struct memory_buffer* dbpath;
+  if (!rootpath || !*rootpath)
+    return 0;
+  dbpath = memory_buffer_create();
+  memory_buffer_set_printf(dbpath, "%s%c%s%c%s", rootpath, PATH_SEPARATOR, PACKAGE_DATABASE_PATH, PATH_SEPARATOR, PACKAGE_DATABASE_FILE);
+  result = file_exists(memory_buffer_get(dbpath));
+  memory_buffer_free(dbpath);
+  return result;
+}
+
 struct pkgdb_handle_struct* pkgdb_open (const char* rootpath)
 {
   sqlite3* db;
@@ -324,6 +370,8 @@ struct pkgdb_handle_struct* pkgdb_open (const char* rootpath)
     } else {
       int64_t dbversion;
       handle->db = db;
+      //wait instead of failing right away when another process has the database locked
+      sqlite3_busy_timeout(db, PKGDB_BUSY_TIMEOUT_MS);
       //check if database exists
       dbversion = get_sql_int64(db, SQL_GET_DBVERSION, 0);
       if (dbversion < PKGDB_VERSION) {
@@ -396,6 +444,46 @@ size_t pkgdb_add_sorted_unique_list (pkgdb_handle handle, const char* sql, const
   return count;
 }
 
+//add files to package database including their content information (hash and size) and modification time if known
+size_t pkgdb_add_package_files (pkgdb_handle handle, const struct package_metadata_struct* pkginfo)
+{
+  unsigned int i;
+  unsigned int n;
+  const char* path;
+  const struct package_file_info_struct* fileinfo;
+  sqlite3_stmt* sqlresult;
+  size_t count = 0;
+  //add data to database
+  if ((n = sorted_unique_list_size(pkginfo->filelist)) == 0)
+    return 0;
+  if (sqlite3_prepare_v2(handle->db, SQL_ADD_PACKAGE_FILE, -1, &sqlresult, NULL) == SQLITE_OK) {
+    sqlite3_bind_text(sqlresult, 1, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], -1, SQLITE_STATIC);
+    sqlite3_bind_int64(sqlresult, 2, PACKAGE_PATH_TYPE_FILE);
+    for (i = 0; i < n; i++) {
+      if ((path = sorted_unique_list_get(pkginfo->filelist, i)) != NULL) {
+        sqlite3_bind_text(sqlresult, 3, path, -1, SQLITE_STATIC);
+        if ((fileinfo = package_metadata_get_file_info(pkginfo, path)) != NULL) {
+          sqlite3_bind_text(sqlresult, 4, fileinfo->sha256, -1, SQLITE_STATIC);
+          sqlite3_bind_int64(sqlresult, 5, (int64_t)fileinfo->size);
+          if (fileinfo->mtime)
+            sqlite3_bind_int64(sqlresult, 6, fileinfo->mtime);
+          else
+            sqlite3_bind_null(sqlresult, 6);
+        } else {
+          sqlite3_bind_null(sqlresult, 4);
+          sqlite3_bind_null(sqlresult, 5);
+          sqlite3_bind_null(sqlresult, 6);
+        }
+        pkgdb_sql_query_next_row(sqlresult);
+        count++;
+        sqlite3_reset(sqlresult);
+      }
+    }
+    sqlite3_finalize(sqlresult);
+  }
+  return count;
+}
+
 struct set_package_category_callback_struct {
   pkgdb_handle handle;
   const char* package;
@@ -414,7 +502,8 @@ int set_package_category_callback (const char* data, size_t datalen, void* callb
 	return 0;
 }
 
-int pkgdb_install_package (pkgdb_handle handle, const struct package_metadata_struct* pkginfo)
+//add package information to package database (without starting a transaction)
+static int pkgdb_add_package_data (pkgdb_handle handle, const struct package_metadata_struct* pkginfo)
 {
   int i;
   size_t n;
@@ -422,16 +511,12 @@ int pkgdb_install_package (pkgdb_handle handle, const struct package_metadata_st
   struct set_package_category_callback_struct categorydata;
   sqlite3_stmt* sqlresult;
   char* detectedversion;
-  //abort if handle is not set
-  if (!handle)
-    return -1;
   //check if already installed
   if ((detectedversion = get_sql_str_param_str(handle->db, SQL_GET_PACKAGE_VERSION, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME])) != NULL) {
     /////printf("Version already installed: %s\n", detectedversion);
     free(detectedversion);
   }
   //add data to database
-  execute_sql_cmd(handle->db, SQL_BEGIN_TRANSACTION);
   n = 0;
   if ((status = sqlite3_prepare_v2(handle->db, SQL_ADD_PACKAGE, -1, &sqlresult, NULL)) == SQLITE_OK) {
     for (i = 0; i < PACKAGE_METADATA_TOTAL_FIELDS; i++)
@@ -446,26 +531,34 @@ int pkgdb_install_package (pkgdb_handle handle, const struct package_metadata_st
     pkgdb_add_sorted_unique_list(handle, SQL_ADD_PACKAGE_DEPENDENCY, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->optionaldependencies, PACKAGE_DEPENDENCY_TYPE_OPTIONAL);
     pkgdb_add_sorted_unique_list(handle, SQL_ADD_PACKAGE_DEPENDENCY, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->builddependencies, PACKAGE_DEPENDENCY_TYPE_BUILD);
     pkgdb_add_sorted_unique_list(handle, SQL_ADD_PACKAGE_DEPENDENCY, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->optionalbuilddependencies, PACKAGE_DEPENDENCY_TYPE_BUILD_OPTIONAL);
-    pkgdb_add_sorted_unique_list(handle, SQL_ADD_PACKAGE_PATH, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->filelist, PACKAGE_PATH_TYPE_FILE);
+    pkgdb_add_package_files(handle, pkginfo);
     pkgdb_add_sorted_unique_list(handle, SQL_ADD_PACKAGE_PATH, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->folderlist, PACKAGE_PATH_TYPE_FOLDER);
     execute_sql_cmd_param_str(handle->db, SQL_DEL_PACKAGE_CATEGORIES, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
     categorydata.handle = handle;
     categorydata.package = pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME];
     iterate_comma_separated_list_no_alloc(pkginfo->datafield[PACKAGE_METADATA_INDEX_CATEGORY], set_package_category_callback, &categorydata);
   }
-  execute_sql_cmd(handle->db, SQL_END_TRANSACTION);
   return status;
 }
 
-int pkgdb_uninstall_package (pkgdb_handle handle, const char* package)
+int pkgdb_install_package (pkgdb_handle handle, const struct package_metadata_struct* pkginfo)
 {
   int status;
-  int abort = 0;
   //abort if handle is not set
   if (!handle)
     return -1;
-  //remove data from database
+  //add data to database
   execute_sql_cmd(handle->db, SQL_BEGIN_TRANSACTION);
+  status = pkgdb_add_package_data(handle, pkginfo);
+  execute_sql_cmd(handle->db, SQL_END_TRANSACTION);
+  return status;
+}
+
+//remove package information from package database (without starting a transaction)
+static int pkgdb_remove_package_data (pkgdb_handle handle, const char* package)
+{
+  int status = 0;
+  int abort = 0;
   if (!abort && (status = execute_sql_cmd_param_str(handle->db, SQL_DEL_PACKAGE_PATHS, package)) != SQLITE_OK && status != SQLITE_DONE)
     abort = 1;
   if (!abort && (status = execute_sql_cmd_param_str(handle->db, SQL_DEL_PACKAGE_DEPENDENCIES, package)) != SQLITE_OK && status != SQLITE_DONE)
@@ -474,20 +567,79 @@ int pkgdb_uninstall_package (pkgdb_handle handle, const char* package)
     abort = 3;
   if (!abort && (status = execute_sql_cmd_param_str(handle->db, SQL_DEL_PACKAGE, package)) != SQLITE_OK && status != SQLITE_DONE)
     abort = 4;
-  if (abort) {
+  return (abort ? status : 0);
+}
+
+int pkgdb_uninstall_package (pkgdb_handle handle, const char* package, sorted_unique_list* orphanedfolders)
+{
+  int status;
+  //abort if handle is not set
+  if (!handle)
+    return -1;
+  execute_sql_cmd(handle->db, SQL_BEGIN_TRANSACTION);
+  //get folders not used by any other package
+  if (orphanedfolders) {
+    sqlite3_stmt* sqlresult;
+    const char* s;
+    if ((sqlresult = execute_sql_query_param_str_int(handle->db, SQL_GET_PACKAGE_ORPHANED_FOLDERS, &status, package, PACKAGE_PATH_TYPE_FOLDER)) == NULL) {
+      execute_sql_cmd(handle->db, SQL_ABORT_TRANSACTION);
+      return status;
+    }
+    while (status == SQLITE_ROW) {
+      if ((s = (char*)sqlite3_column_text(sqlresult, 0)) != NULL)
+        sorted_unique_list_add(orphanedfolders, s);
+      status = pkgdb_sql_query_next_row(sqlresult);
+    }
+    sqlite3_finalize(sqlresult);
+  }
+  //remove data from database
+  if ((status = pkgdb_remove_package_data(handle, package)) != 0) {
     execute_sql_cmd(handle->db, SQL_ABORT_TRANSACTION);
     return status;
   }
+  //delete package information files (only present if exported with wl-install -x) before committing
+  pkgdb_remove_package_info_files(handle, package);
   execute_sql_cmd(handle->db, SQL_END_TRANSACTION);
   return 0;
 }
 
-struct package_metadata_struct* pkgdb_read_package (pkgdb_handle handle, const char* package)
+static void pkgdb_set_package_fields_from_row (struct package_metadata_struct* pkginfo, sqlite3_stmt* sqlresult)
 {
   int i;
-  int status;
-  uint64_t type;
   const char* s;
+  for (i = 0; i < PACKAGE_METADATA_TOTAL_FIELDS; i++) {
+    s = (char*)sqlite3_column_text(sqlresult, i);
+    if (pkginfo->datafield[i])
+      free(pkginfo->datafield[i]);
+    pkginfo->datafield[i] = (s ? strdup(s) : NULL);
+  }
+  pkginfo->buildok = 1;
+  pkginfo->lastchanged = sqlite3_column_int64(sqlresult, PACKAGE_METADATA_TOTAL_FIELDS);
+}
+
+static void pkgdb_add_package_dependency_from_row (struct package_metadata_struct* pkginfo, sqlite3_stmt* sqlresult)
+{
+  const char* s = (char*)sqlite3_column_text(sqlresult, 1);
+  switch (sqlite3_column_int64(sqlresult, 0)) {
+    case PACKAGE_DEPENDENCY_TYPE_MANDATORY:
+      sorted_unique_list_add(pkginfo->dependencies, s);
+      break;
+    case PACKAGE_DEPENDENCY_TYPE_OPTIONAL:
+      sorted_unique_list_add(pkginfo->optionaldependencies, s);
+      break;
+    case PACKAGE_DEPENDENCY_TYPE_BUILD:
+      sorted_unique_list_add(pkginfo->builddependencies, s);
+      break;
+    case PACKAGE_DEPENDENCY_TYPE_BUILD_OPTIONAL:
+      sorted_unique_list_add(pkginfo->optionalbuilddependencies, s);
+      break;
+  }
+}
+
+static struct package_metadata_struct* pkgdb_read_package_without_paths (pkgdb_handle handle, const char* package)
+{
+  int status;
+  int found = 0;
   sqlite3_stmt* sqlresult;
   struct package_metadata_struct* pkginfo = NULL;
   //abort if handle is not set
@@ -497,47 +649,38 @@ struct package_metadata_struct* pkgdb_read_package (pkgdb_handle handle, const c
   if ((pkginfo = package_metadata_create()) == NULL)
     return NULL;
   //get package information
-  i = 0;
   if ((sqlresult = execute_sql_query_param_str(handle->db, SQL_GET_PACKAGE, &status, package)) != NULL) {
     if (status == SQLITE_ROW) {
-      for (i = 0; i < PACKAGE_METADATA_TOTAL_FIELDS; i++) {
-        s = (char*)sqlite3_column_text(sqlresult, i);
-        if (pkginfo->datafield[i])
-          free(pkginfo->datafield[i]);
-        pkginfo->datafield[i] = (s ? strdup(s) : NULL);
-      }
-      pkginfo->buildok = 1;
-      pkginfo->lastchanged = sqlite3_column_int64(sqlresult, PACKAGE_METADATA_TOTAL_FIELDS);
+      pkgdb_set_package_fields_from_row(pkginfo, sqlresult);
+      found = 1;
     }
     sqlite3_finalize(sqlresult);
   }
-  if (i == 0) {
+  if (!found) {
     package_metadata_free(pkginfo);
     return NULL;
   }
   //get package dependencies
   if ((sqlresult = execute_sql_query_param_str(handle->db, SQL_GET_PACKAGE_DEPENDENCIES, &status, package)) != NULL) {
     while (status == SQLITE_ROW) {
-      type = sqlite3_column_int64(sqlresult, 0);
-      s = (char*)sqlite3_column_text(sqlresult, 1);
-      switch (type) {
-        case PACKAGE_DEPENDENCY_TYPE_MANDATORY:
-          sorted_unique_list_add(pkginfo->dependencies, s);
-          break;
-        case PACKAGE_DEPENDENCY_TYPE_OPTIONAL:
-          sorted_unique_list_add(pkginfo->optionaldependencies, s);
-          break;
-        case PACKAGE_DEPENDENCY_TYPE_BUILD:
-          sorted_unique_list_add(pkginfo->builddependencies, s);
-          break;
-        case PACKAGE_DEPENDENCY_TYPE_BUILD_OPTIONAL:
-          sorted_unique_list_add(pkginfo->optionalbuilddependencies, s);
-          break;
-      }
+      pkgdb_add_package_dependency_from_row(pkginfo, sqlresult);
       status = pkgdb_sql_query_next_row(sqlresult);
     }
     sqlite3_finalize(sqlresult);
   }
+  return pkginfo;
+}
+
+struct package_metadata_struct* pkgdb_read_package (pkgdb_handle handle, const char* package)
+{
+  int status;
+  uint64_t type;
+  const char* s;
+  sqlite3_stmt* sqlresult;
+  struct package_metadata_struct* pkginfo;
+  //get package information and dependencies
+  if ((pkginfo = pkgdb_read_package_without_paths(handle, package)) == NULL)
+    return NULL;
   //get package file and folders
   if ((sqlresult = execute_sql_query_param_str(handle->db, SQL_GET_PACKAGE_PATHS, &status, package)) != NULL) {
     while (status == SQLITE_ROW) {
@@ -546,6 +689,11 @@ struct package_metadata_struct* pkgdb_read_package (pkgdb_handle handle, const c
       switch (type) {
         case PACKAGE_PATH_TYPE_FILE:
           sorted_unique_list_add(pkginfo->filelist, s);
+          if (sqlite3_column_type(sqlresult, 2) != SQLITE_NULL) {
+            package_metadata_set_file_info(pkginfo, s, (char*)sqlite3_column_text(sqlresult, 2), sqlite3_column_int64(sqlresult, 3));
+            if (sqlite3_column_type(sqlresult, 4) != SQLITE_NULL)
+              package_metadata_set_file_mtime(pkginfo, s, sqlite3_column_int64(sqlresult, 4));
+          }
           break;
         case PACKAGE_PATH_TYPE_FOLDER:
           sorted_unique_list_add(pkginfo->folderlist, s);
@@ -596,12 +744,10 @@ struct pkgdb_packages_are_installed_struct {
 
 size_t pkgdb_packages_are_installed_callback (const char* basename, void* callbackdata)
 {
-  struct package_metadata_struct* pkginfo;
-  if ((pkginfo = pkgdb_read_package(((struct pkgdb_packages_are_installed_struct*)callbackdata)->handle, basename)) == NULL) {
+  if (!pkgdb_package_is_installed(((struct pkgdb_packages_are_installed_struct*)callbackdata)->handle, basename)) {
     ((struct pkgdb_packages_are_installed_struct*)callbackdata)->installed = 0;
     return -1;
   }
-  package_metadata_free(pkginfo);
   ((struct pkgdb_packages_are_installed_struct*)callbackdata)->installed++;
   return 0;
 }
@@ -617,6 +763,338 @@ size_t pkgdb_packages_are_installed (pkgdb_handle handle, const char* packagelis
   return data.installed;
 }
 
+int pkgdb_package_is_installed (pkgdb_handle handle, const char* package)
+{
+  return (pkgdb_installed_package_lastchanged(handle, package) != 0);
+}
+
+time_t pkgdb_installed_package_lastchanged (pkgdb_handle handle, const char* package)
+{
+  int status;
+  sqlite3_stmt* sqlresult;
+  time_t result = 0;
+  //abort if handle is not set
+  if (!handle || !package || !*package)
+    return 0;
+  //look up package by primary key
+  if ((sqlresult = execute_sql_query_param_str(handle->db, SQL_GET_PACKAGE_INSTALLED, &status, package)) != NULL) {
+    if (status == SQLITE_ROW)
+      result = sqlite3_column_int64(sqlresult, 0);
+    sqlite3_finalize(sqlresult);
+  }
+  return result;
+}
+
+char* pkgdb_find_file_package (pkgdb_handle handle, const char* path)
+{
+  if (!handle || !path || !*path)
+    return NULL;
+  return get_sql_str_param_str(handle->db, SQL_FIND_FILE_PACKAGE, path);
+}
+
+int pkgdb_export_package_info_files (pkgdb_handle handle, const char* package)
+{
+  struct package_metadata_struct* pkginfo;
+  struct memory_buffer* pkginfopath;
+  struct memory_buffer* filepath;
+  //get package information from database
+  if ((pkginfo = pkgdb_read_package(handle, package)) == NULL)
+    return -1;
+  pkginfopath = memory_buffer_create();
+  filepath = memory_buffer_create();
+  //determine package information path
+  memory_buffer_set_printf(pkginfopath, "%s%s%c%s%c", handle->rootpath, PACKAGE_INFO_PATH, PATH_SEPARATOR, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], PATH_SEPARATOR);
+  //create package information path if needed
+  recursive_mkdir(memory_buffer_get(pkginfopath));
+  //create version file
+  write_to_file(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_VERSION_FILE)), pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+  //create file listing file
+  sorted_unique_list_save_to_file(pkginfo->filelist, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_CONTENT_FILE)));
+  //create folder listing file
+  sorted_unique_list_save_to_file(pkginfo->folderlist, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_FOLDERS_FILE)));
+  //create dependency files
+  sorted_unique_list_save_to_file(pkginfo->dependencies, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_DEPENDENCIES_FILE)));
+  sorted_unique_list_save_to_file(pkginfo->optionaldependencies, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_OPTIONALDEPENDENCIES_FILE)));
+  sorted_unique_list_save_to_file(pkginfo->builddependencies, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_BUILDDEPENDENCIES_FILE)));
+  //clean up
+  memory_buffer_free(pkginfopath);
+  memory_buffer_free(filepath);
+  package_metadata_free(pkginfo);
+  return 0;
+}
+
+void pkgdb_remove_package_info_files (pkgdb_handle handle, const char* package)
+{
+  struct memory_buffer* pkginfopath;
+  struct memory_buffer* filepath;
+  if (!handle || !package || !*package)
+    return;
+  pkginfopath = memory_buffer_create();
+  filepath = memory_buffer_create();
+  //determine package information path
+  memory_buffer_set_printf(pkginfopath, "%s%s%c%s%c", handle->rootpath, PACKAGE_INFO_PATH, PATH_SEPARATOR, package, PATH_SEPARATOR);
+  //delete files (if they exist)
+  unlink(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_VERSION_FILE)));
+  unlink(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_CONTENT_FILE)));
+  unlink(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_FOLDERS_FILE)));
+  unlink(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_DEPENDENCIES_FILE)));
+  unlink(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_OPTIONALDEPENDENCIES_FILE)));
+  unlink(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_BUILDDEPENDENCIES_FILE)));
+  //delete package information folder
+  rmdir(memory_buffer_get(pkginfopath));
+  //clean up
+  memory_buffer_free(pkginfopath);
+  memory_buffer_free(filepath);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+int pkgdb_journal_begin (pkgdb_handle handle, const char* staging)
+{
+  int status;
+  if (!handle || !staging || !*staging)
+    return -1;
+  if ((status = execute_sql_cmd_param_str(handle->db, SQL_ADD_JOURNAL, staging)) != SQLITE_OK && status != SQLITE_DONE)
+    return status;
+  return 0;
+}
+
+struct pkgdb_journal_add_path_struct {
+  pkgdb_handle handle;
+  const char* staging;
+  int status;
+};
+
+static int pkgdb_journal_add_path_callback (const char* data, void* callbackdata)
+{
+  struct pkgdb_journal_add_path_struct* info = (struct pkgdb_journal_add_path_struct*)callbackdata;
+  sqlite3_stmt* sqlresult;
+  if ((info->status = sqlite3_prepare_v2(info->handle->db, SQL_ADD_JOURNAL_PATH, -1, &sqlresult, NULL)) == SQLITE_OK) {
+    sqlite3_bind_text(sqlresult, 1, info->staging, -1, NULL);
+    sqlite3_bind_text(sqlresult, 2, data, -1, NULL);
+    info->status = pkgdb_sql_query_next_row(sqlresult);
+    sqlite3_finalize(sqlresult);
+  }
+  return (info->status == SQLITE_DONE ? 0 : 1);
+}
+
+int pkgdb_journal_commit_package (pkgdb_handle handle, const char* staging, const struct package_metadata_struct* pkginfo, const sorted_unique_list* stalefiles)
+{
+  int status;
+  int abort = 0;
+  sqlite3_stmt* sqlresult;
+  struct pkgdb_journal_add_path_struct addpathdata;
+  if (!handle || !staging || !pkginfo || !pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME])
+    return -1;
+  //replace package information and mark journal entry as committed in a single transaction
+  execute_sql_cmd(handle->db, SQL_BEGIN_TRANSACTION);
+  if (pkgdb_remove_package_data(handle, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME]) != 0)
+    abort = 1;
+  if (!abort && (status = pkgdb_add_package_data(handle, pkginfo)) != SQLITE_OK && status != SQLITE_DONE)
+    abort = 2;
+  if (!abort && stalefiles) {
+    addpathdata.handle = handle;
+    addpathdata.staging = staging;
+    addpathdata.status = SQLITE_DONE;
+    if (sorted_unique_list_compare_lists(stalefiles, NULL, NULL, pkgdb_journal_add_path_callback, NULL, &addpathdata) != 0)
+      abort = 3;
+  }
+  if (!abort) {
+    if ((status = sqlite3_prepare_v2(handle->db, SQL_SET_JOURNAL_COMMITTED, -1, &sqlresult, NULL)) == SQLITE_OK) {
+      sqlite3_bind_text(sqlresult, 1, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], -1, NULL);
+      sqlite3_bind_int64(sqlresult, 2, PKGDB_JOURNAL_STATE_COMMITTED);
+      sqlite3_bind_text(sqlresult, 3, staging, -1, NULL);
+      status = pkgdb_sql_query_next_row(sqlresult);
+      sqlite3_finalize(sqlresult);
+    }
+    if (status != SQLITE_DONE || sqlite3_changes(handle->db) != 1)
+      abort = 4;
+  }
+  if (abort) {
+    execute_sql_cmd(handle->db, SQL_ABORT_TRANSACTION);
+    return abort;
+  }
+  if ((status = execute_sql_cmd(handle->db, SQL_END_TRANSACTION)) != SQLITE_OK && status != SQLITE_DONE)
+    return status;
+  return 0;
+}
+
+int pkgdb_journal_end (pkgdb_handle handle, const char* staging)
+{
+  int status;
+  int abort = 0;
+  if (!handle || !staging)
+    return -1;
+  execute_sql_cmd(handle->db, SQL_BEGIN_TRANSACTION);
+  if ((status = execute_sql_cmd_param_str(handle->db, SQL_DEL_JOURNAL_PATHS, staging)) != SQLITE_OK && status != SQLITE_DONE)
+    abort = 1;
+  if (!abort && (status = execute_sql_cmd_param_str(handle->db, SQL_DEL_JOURNAL, staging)) != SQLITE_OK && status != SQLITE_DONE)
+    abort = 2;
+  if (abort) {
+    execute_sql_cmd(handle->db, SQL_ABORT_TRANSACTION);
+    return status;
+  }
+  execute_sql_cmd(handle->db, SQL_END_TRANSACTION);
+  return 0;
+}
+
+char* pkgdb_journal_get_pending (pkgdb_handle handle, char** package, int* state)
+{
+  int status;
+  sqlite3_stmt* sqlresult;
+  const char* s;
+  char* result = NULL;
+  if (package)
+    *package = NULL;
+  if (!handle)
+    return NULL;
+  if ((sqlresult = execute_sql_query(handle->db, SQL_GET_JOURNAL_PENDING, &status, NULL)) != NULL) {
+    if (status == SQLITE_ROW && (s = (char*)sqlite3_column_text(sqlresult, 0)) != NULL) {
+      result = strdup(s);
+      if (package && (s = (char*)sqlite3_column_text(sqlresult, 1)) != NULL)
+        *package = strdup(s);
+      if (state)
+        *state = sqlite3_column_int(sqlresult, 2);
+    }
+    sqlite3_finalize(sqlresult);
+  }
+  return result;
+}
+
+int pkgdb_journal_iterate_stale_files (pkgdb_handle handle, const char* staging, pkgdb_file_folder_callback_fn callback, void* callbackdata)
+{
+  int status;
+  sqlite3_stmt* sqlresult;
+  const char* s;
+  int abort = 0;
+  //abort if handle is not set
+  if (!handle)
+    return 0;
+  //get list of files
+  if ((sqlresult = execute_sql_query_param_str(handle->db, SQL_GET_JOURNAL_PATHS, &status, staging)) == NULL)
+    return -1;
+  while (!abort && status == SQLITE_ROW) {
+    if ((s = (char*)sqlite3_column_text(sqlresult, 0)) != NULL)
+      abort = (*callback)(handle, s, callbackdata);
+    status = pkgdb_sql_query_next_row(sqlresult);
+  }
+  sqlite3_finalize(sqlresult);
+  return abort;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+struct pkgdb_snapshot_struct {
+  sorted_unique_list* packages;
+};
+
+static int pkgdb_snapshot_cmp_basename (const char* data1, const char* data2)
+{
+  return strcmp(((struct package_metadata_struct*)data1)->datafield[PACKAGE_METADATA_INDEX_BASENAME], ((struct package_metadata_struct*)data2)->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
+}
+
+pkgdb_snapshot pkgdb_snapshot_create (pkgdb_handle handle)
+{
+  int status;
+  const char* s;
+  sqlite3_stmt* sqlresult;
+  struct package_metadata_struct* pkginfo;
+  struct pkgdb_snapshot_struct* snapshot;
+  //abort if handle is not set
+  if (!handle)
+    return NULL;
+  if ((snapshot = (struct pkgdb_snapshot_struct*)malloc(sizeof(struct pkgdb_snapshot_struct))) == NULL)
+    return NULL;
+  if ((snapshot->packages = sorted_unique_list_create(pkgdb_snapshot_cmp_basename, (sorted_unique_free_fn)package_metadata_free)) == NULL) {
+    free(snapshot);
+    return NULL;
+  }
+  //read all packages in one go
+  execute_sql_cmd(handle->db, SQL_BEGIN_TRANSACTION);
+  if ((sqlresult = execute_sql_query(handle->db, SQL_SELECT_PACKAGE, &status, NULL)) != NULL) {
+    while (status == SQLITE_ROW) {
+      if ((pkginfo = package_metadata_create()) != NULL) {
+        pkgdb_set_package_fields_from_row(pkginfo, sqlresult);
+        if (pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME])
+          sorted_unique_list_add_allocated(snapshot->packages, (char*)pkginfo);
+        else
+          package_metadata_free(pkginfo);
+      }
+      status = pkgdb_sql_query_next_row(sqlresult);
+    }
+    sqlite3_finalize(sqlresult);
+  }
+  //read all dependencies in one go (sorted by package so lookups only happen when the package changes)
+  if ((sqlresult = execute_sql_query(handle->db, SQL_GET_ALL_PACKAGE_DEPENDENCIES, &status, NULL)) != NULL) {
+    pkginfo = NULL;
+    while (status == SQLITE_ROW) {
+      if ((s = (char*)sqlite3_column_text(sqlresult, 2)) != NULL) {
+        if (!pkginfo || strcmp(pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], s) != 0)
+          pkginfo = (struct package_metadata_struct*)pkgdb_snapshot_get_package(snapshot, s);
+        if (pkginfo)
+          pkgdb_add_package_dependency_from_row(pkginfo, sqlresult);
+      }
+      status = pkgdb_sql_query_next_row(sqlresult);
+    }
+    sqlite3_finalize(sqlresult);
+  }
+  execute_sql_cmd(handle->db, SQL_END_TRANSACTION);
+  return snapshot;
+}
+
+void pkgdb_snapshot_free (pkgdb_snapshot snapshot)
+{
+  if (snapshot) {
+    sorted_unique_list_free(snapshot->packages);
+    free(snapshot);
+  }
+}
+
+int pkgdb_snapshot_refresh_package (pkgdb_snapshot snapshot, pkgdb_handle handle, const char* package)
+{
+  struct package_metadata_struct* pkginfo;
+  struct package_metadata_struct searchpkginfo;
+  if (!snapshot || !package || !*package)
+    return -1;
+  //remove old entry
+  searchpkginfo.datafield[PACKAGE_METADATA_INDEX_BASENAME] = (char*)package;
+  sorted_unique_list_remove(snapshot->packages, (char*)&searchpkginfo);
+  //add current entry
+  if ((pkginfo = pkgdb_read_package_without_paths(handle, package)) == NULL)
+    return 0;
+  return (sorted_unique_list_add_allocated(snapshot->packages, (char*)pkginfo) == 0 ? 1 : -1);
+}
+
+size_t pkgdb_snapshot_count (pkgdb_snapshot snapshot)
+{
+  if (!snapshot)
+    return 0;
+  return sorted_unique_list_size(snapshot->packages);
+}
+
+const struct package_metadata_struct* pkgdb_snapshot_get_index (pkgdb_snapshot snapshot, size_t index)
+{
+  if (!snapshot)
+    return NULL;
+  return (const struct package_metadata_struct*)sorted_unique_list_get(snapshot->packages, index);
+}
+
+const struct package_metadata_struct* pkgdb_snapshot_get_package (pkgdb_snapshot snapshot, const char* package)
+{
+  struct package_metadata_struct searchpkginfo;
+  if (!snapshot || !package || !*package)
+    return NULL;
+  searchpkginfo.datafield[PACKAGE_METADATA_INDEX_BASENAME] = (char*)package;
+  return (const struct package_metadata_struct*)sorted_unique_list_search(snapshot->packages, (char*)&searchpkginfo);
+}
+
+int pkgdb_snapshot_package_is_installed (pkgdb_snapshot snapshot, const char* package)
+{
+  return (pkgdb_snapshot_get_package(snapshot, package) != NULL);
+}
+
+////////////////////////////////////////////////////////////////////////
+
 sqlite3* pkgdb_get_sqlite3_handle (pkgdb_handle handle)
 {
   return (handle ? handle->db : NULL);
@@ -24,6 +24,13 @@ typedef struct pkgdb_handle_struct* pkgdb_handle;
 */
 pkgdb_handle pkgdb_open (const char* rootpath);
 
+//!check if a package database exists (to avoid creating one with pkgdb_open() when only reading)
+/*!
+  \param  rootpath              package install location
+  \return non-zero if the package database file exists
+*/
+int pkgdb_exists (const char* rootpath);
+
 //!close handle for writing to package database
 /*!
   \param  handle                database handle
@@ -45,13 +52,14 @@ const char* pkgdb_get_rootpath (pkgdb_handle handle);
 */
 int pkgdb_install_package (pkgdb_handle handle, const struct package_metadata_struct* pkginfo);
 
-//!remove package from package database
+//!remove package from package database (and package information files if they were exported) in a single transaction
 /*!
   \param  handle                database handle
   \param  package               package name
+  \param  orphanedfolders       list that will receive the folders of the package not used by any other package (may be NULL)
   \return 0 on success
 */
-int pkgdb_uninstall_package (pkgdb_handle handle, const char* package);
+int pkgdb_uninstall_package (pkgdb_handle handle, const char* package, sorted_unique_list* orphanedfolders);
 
 //!read package information from package database
 /*!
@@ -110,6 +118,154 @@ typedef int (*pkgdb_package_callback_fn)(pkgdb_handle handle, const struct packa
 */
 size_t pkgdb_packages_are_installed (pkgdb_handle handle, const char* packagelist);
 
+//!check if package is installed
+/*!
+  \param  handle                database handle
+  \param  package               package name
+  \return non-zero if package is installed, zero if not
+*/
+int pkgdb_package_is_installed (pkgdb_handle handle, const char* package);
+
+//!check when the package was installed
+/*!
+  \param  handle                database handle
+  \param  package               package name
+  \return timestamp of last installation or update or 0 if not installed
+*/
+time_t pkgdb_installed_package_lastchanged (pkgdb_handle handle, const char* package);
+
+//!find installed package containing a file
+/*!
+  \param  handle                database handle
+  \param  path                  path of file (relative to install path, using forward slashes, case insensitive)
+  \return name of the package or NULL if the file doesn't belong to any installed package, the caller must free() the result
+*/
+char* pkgdb_find_file_package (pkgdb_handle handle, const char* path);
+
+//!export package information from package database as files in PACKAGE_INFO_PATH (for use by legacy tools)
+/*!
+  \param  handle                database handle
+  \param  package               package name
+  \return 0 on success
+*/
+int pkgdb_export_package_info_files (pkgdb_handle handle, const char* package);
+
+//!remove package information files exported in PACKAGE_INFO_PATH (if any)
+/*!
+  \param  handle                database handle
+  \param  package               package name
+*/
+void pkgdb_remove_package_info_files (pkgdb_handle handle, const char* package);
+
+
+//!install journal state: package is being extracted to the staging folder (nothing changed yet, roll back by deleting the staging folder)
+#define PKGDB_JOURNAL_STATE_STAGING   0
+//!install journal state: package information was committed to the database (roll forward by moving the staged files in place)
+#define PKGDB_JOURNAL_STATE_COMMITTED 1
+
+//!add install journal entry for a new staging folder
+/*!
+  \param  handle                database handle
+  \param  staging               name of staging folder (relative to PACKAGE_STAGING_PATH)
+  \return 0 on success
+*/
+int pkgdb_journal_begin (pkgdb_handle handle, const char* staging);
+
+//!replace package information in package database and mark install journal entry as committed in a single transaction
+/*!
+  \param  handle                database handle
+  \param  staging               name of staging folder (relative to PACKAGE_STAGING_PATH)
+  \param  pkginfo               package information
+  \param  stalefiles            files of the previously installed version that must be deleted (may be NULL)
+  \return 0 on success
+*/
+int pkgdb_journal_commit_package (pkgdb_handle handle, const char* staging, const struct package_metadata_struct* pkginfo, const sorted_unique_list* stalefiles);
+
+//!remove install journal entry after the installation was completed or rolled back
+/*!
+  \param  handle                database handle
+  \param  staging               name of staging folder (relative to PACKAGE_STAGING_PATH)
+  \return 0 on success
+*/
+int pkgdb_journal_end (pkgdb_handle handle, const char* staging);
+
+//!get the oldest install journal entry that was not completed
+/*!
+  \param  handle                database handle
+  \param  package               pointer that will receive the package name (NULL if not yet committed), the caller must free this value
+  \param  state                 pointer that will receive the journal state (PKGDB_JOURNAL_STATE_*)
+  \return name of staging folder or NULL if there are no pending entries, the caller must free the result
+*/
+char* pkgdb_journal_get_pending (pkgdb_handle handle, char** package, int* state);
+
+//!iterate through files to be deleted when completing a committed install journal entry
+/*!
+  \param  handle                database handle
+  \param  staging               name of staging folder (relative to PACKAGE_STAGING_PATH)
+  \param  callback              callback function to call for each file
+  \param  callbackdata          user data to pass to the file callback function
+  \return 0 if all files were iterated, -1 on error or exit code of callback function
+*/
+int pkgdb_journal_iterate_stale_files (pkgdb_handle handle, const char* staging, pkgdb_file_folder_callback_fn callback, void* callbackdata);
+
+
+//!handle type used for in-memory snapshot of installed packages (including dependencies but without files and folders)
+typedef struct pkgdb_snapshot_struct* pkgdb_snapshot;
+
+//!load in-memory snapshot of all installed packages and their dependencies from package database
+/*!
+  \param  handle                database handle
+  \return snapshot handle on success or NULL on error, the caller must free the result with pkgdb_snapshot_free()
+*/
+pkgdb_snapshot pkgdb_snapshot_create (pkgdb_handle handle);
+
+//!clean up in-memory snapshot of installed packages
+/*!
+  \param  snapshot              snapshot handle
+*/
+void pkgdb_snapshot_free (pkgdb_snapshot snapshot);
+
+//!reload the information of one package in in-memory snapshot of installed packages (e.g. after it was installed or uninstalled)
+/*!
+  \param  snapshot              snapshot handle
+  \param  handle                database handle
+  \param  package               package name
+  \return 1 if the package is installed, 0 if it is not installed or negative on error
+*/
+int pkgdb_snapshot_refresh_package (pkgdb_snapshot snapshot, pkgdb_handle handle, const char* package);
+
+//!get number of packages in in-memory snapshot of installed packages
+/*!
+  \param  snapshot              snapshot handle
+  \return number of installed packages
+*/
+size_t pkgdb_snapshot_count (pkgdb_snapshot snapshot);
+
+//!get package from in-memory snapshot of installed packages by index
+/*!
+  \param  snapshot              snapshot handle
+  \param  index                 zero-based index (packages are sorted by name)
+  \return package information (without files and folders) or NULL if index is out of range
+*/
+const struct package_metadata_struct* pkgdb_snapshot_get_index (pkgdb_snapshot snapshot, size_t index);
+
+//!get package from in-memory snapshot of installed packages by name
+/*!
+  \param  snapshot              snapshot handle
+  \param  package               package name
+  \return package information (without files and folders) or NULL if not installed
+*/
+const struct package_metadata_struct* pkgdb_snapshot_get_package (pkgdb_snapshot snapshot, const char* package);
+
+//!check if package is installed using in-memory snapshot of installed packages
+/*!
+  \param  snapshot              snapshot handle
+  \param  package               package name
+  \return non-zero if package is installed, zero if not
+*/
+int pkgdb_snapshot_package_is_installed (pkgdb_snapshot snapshot, const char* package);
+
+
 
 //!get sqlite3 handleSQL query with 1 string parameter
 /*!
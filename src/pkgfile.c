@@ -646,179 +646,3 @@ int insert_package_by_dependency (struct package_info_list_struct** packagelist,
 */
   return 0;
 }
-
-int package_is_installed (const char* installpath, const char* basename)
-{
-  struct stat statbuf;
-  char* fullpath;
-  int result = 0;
-  if (!installpath || !*installpath || !basename || !*basename)
-    return 0;
-  if ((fullpath = (char*)malloc(strlen(installpath) + strlen(basename) + 19)) == NULL)
-    return 0;
-  strcpy(fullpath, installpath);
-  strcat(fullpath, WINLIBS_CHR2STR(PATH_SEPARATOR) "var" WINLIBS_CHR2STR(PATH_SEPARATOR) "lib" WINLIBS_CHR2STR(PATH_SEPARATOR) "packages" WINLIBS_CHR2STR(PATH_SEPARATOR));
-  strcat(fullpath, basename);
-  if (stat(fullpath, &statbuf) == 0 && S_ISDIR(statbuf.st_mode))
-    result = 1;
-  free(fullpath);
-  return result;
-}
-
-/*
-int packages_are_installed (const char* installpath, const char* packagelist)
-{
-  char* deps;
-  char* p;
-  char* q;
-  char c;
-  int result = 0;
-  if (!installpath || !*installpath || !packagelist || !*packagelist)
-    return 0;
-  deps = strdup(packagelist);
-  p = deps;
-  do {
-    q = p;
-    while (*q && *q != ',')
-      q++;
-    c = *q;
-    *q = 0;
-    if (*p) {
-      if (!package_is_installed(installpath, p)) {
-        result = 0;
-        break;
-      }
-      result++;
-    }
-    p = q;
-    if (c)
-      p++;
-  } while (c);
-  free(deps);
-  return result;
-}
-*/
-
-/*
-struct packages_are_installed_struct {
-  const char* installpath;
-  int installed;
-};
-
-int packages_are_installed_callback (const char* basename, void* callbackdata)
-{
-  if (!package_is_installed(((struct packages_are_installed_struct*)callbackdata)->installpath, basename)) {
-    ((struct packages_are_installed_struct*)callbackdata)->installed = 0;
-    return -1;
-  }
-  ((struct packages_are_installed_struct*)callbackdata)->installed++;
-  return 0;
-}
-
-int packages_are_installed (const char* installpath, const char* packagelist)
-{
-  struct packages_are_installed_struct data;
-  if (!installpath || !*installpath)
-    return 0;
-  data.installpath = installpath;
-  data.installed = 1;
-  iterate_packages_in_comma_separated_list(packagelist, packages_are_installed_callback, &data);
-  return data.installed;
-}
-
-char* installed_package_version (const char* installpath, const char* basename)
-{
-  struct stat statbuf;
-  char* fullpath;
-  char* result = NULL;
-  if (!installpath || !*installpath || !basename || !*basename)
-    return NULL;
-  if ((fullpath = (char*)malloc(strlen(installpath) + strlen(basename) + 27)) == NULL)
-    return NULL;
-  strcpy(fullpath, installpath);
-  strcat(fullpath, WINLIBS_CHR2STR(PATH_SEPARATOR) "var" WINLIBS_CHR2STR(PATH_SEPARATOR) "lib" WINLIBS_CHR2STR(PATH_SEPARATOR) "packages" WINLIBS_CHR2STR(PATH_SEPARATOR));
-  strcat(fullpath, basename);
-  if (stat(fullpath, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
-    FILE* f;
-    strcat(fullpath, WINLIBS_CHR2STR(PATH_SEPARATOR) "version");
-    if ((f = fopen(fullpath, "rb")) != NULL) {
-      char buf[64];
-      size_t buflen = fread(buf, 1, sizeof(buf) - 1, f);
-      fclose(f);
-      if (buflen > 0) {
-        char* pos;
-        if ((pos = strchr(buf, '\r')) != 0)
-          *pos = 0;
-        if ((pos = strchr(buf, '\n')) != 0)
-          *pos = 0;
-        buf[buflen] = 0;
-        result = strdup(buf);
-      }
-    }
-  }
-  free(fullpath);
-  return result;
-}
-*/
-
-time_t installed_package_lastchanged (const char* installpath, const char* basename)
-{
-  struct stat statbuf;
-  char* fullpath;
-  time_t result = 0;
-  if (!installpath || !*installpath || !basename || !*basename)
-    return 0;
-  if ((fullpath = (char*)malloc(strlen(installpath) + strlen(basename) + 27)) == NULL)
-    return 0;
-  strcpy(fullpath, installpath);
-  strcat(fullpath, WINLIBS_CHR2STR(PATH_SEPARATOR) "var" WINLIBS_CHR2STR(PATH_SEPARATOR) "lib" WINLIBS_CHR2STR(PATH_SEPARATOR) "packages" WINLIBS_CHR2STR(PATH_SEPARATOR));
-  strcat(fullpath, basename);
-  if (stat(fullpath, &statbuf) == 0 && S_ISDIR(statbuf.st_mode)) {
-    strcat(fullpath, WINLIBS_CHR2STR(PATH_SEPARATOR) "version");
-    if (stat(fullpath, &statbuf) == 0 && S_ISREG(statbuf.st_mode)) {
-      //open file
-      if (statbuf.st_mtime)
-        result = statbuf.st_mtime;
-      if (statbuf.st_ctime > result)
-        result = statbuf.st_ctime;
-    }
-  }
-  free(fullpath);
-  return result;
-}
-
-int packages_remove_missing_from_list (const char* installpath, char* packagelist)
-{
-  char* p;
-  char* q;
-  char c;
-  int result = 0;
-  if (!installpath || !*installpath || !packagelist || !*packagelist)
-    return 0;
-  p = packagelist;
-  do {
-    q = p;
-    while (*q && *q != ',')
-      q++;
-    c = *q;
-    *q = 0;
-    if (!package_is_installed(installpath, p)) {
-      if (c) {
-        strcpy(p, q + 1);
-      } else {
-        if (p == packagelist)
-          *p = 0;
-        else
-          *(p - 1) = 0;
-      }
-      result++;
-    } else {
-      if (c)
-        *q = c;
-      p = q;
-      if (c)
-        p++;
-    }
-  } while (c);
-  return result;
-}
@@ -108,50 +108,6 @@ struct package_info_list_struct* search_packageinfolist_by_basename (struct pack
 */
 int insert_package_by_dependency (struct package_info_list_struct** packagelist, const char* infopath, const char* basename);
 
-//!check if package is installed
-/*!
-  \param  installpath           path where packages are installed
-  \param  basename              name of package
-  \return non-zero if package is installed
-*/
-int package_is_installed (const char* installpath, const char* basename);
-
-//!check if packages are installed
-/*!
-  \param  installpath           path where packages are installed
-  \param  packagelist           comma separated list of package names
-  \return non-zero if all packages are installed
-*/
-/*
-int packages_are_installed (const char* installpath, const char* packagelist);
-*/
-
-//!check which version of package is installed
-/*!
-  \param  installpath           path where packages are installed
-  \param  basename              name of package
-  \return version (caller must free() the result) or NULL if not installed
-*/
-/*
-char* installed_package_version (const char* installpath, const char* basename);
-*/
-
-//!check when the package was installed
-/*!
-  \param  installpath           path where packages are installed
-  \param  basename              name of package
-  \return timestamp of last installation or update or 0 if not installed
-*/
-time_t installed_package_lastchanged (const char* installpath, const char* basename);
-
-//!remove missing packages from comma separated list
-/*!
-  \param  installpath           path where packages are installed
-  \param  packagelist           comma separated list of package names (will be modified)
-  \return number of entries removed from list
-*/
-int packages_remove_missing_from_list (const char* installpath, char* packagelist);
-
 #ifdef __cplusplus
 }
 #endif
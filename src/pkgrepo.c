@@ -0,0 +1,338 @@
+#include "winlibs_common.h"
+#include "pkgrepo.h"
+#include "memory_buffer.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sqlite3.h>
+
+////////////////////////////////////////////////////////////////////////
+
+#define PKGREPO_VERSION 1
+
+//time to wait for other processes writing to the same index (e.g. packages being created in parallel)
+#define PKGREPO_BUSY_TIMEOUT_MS 30000
+
+static const char* pkgrepo_sql_create[] = {
+  //database version 1
+  "CREATE TABLE dbinfo (" \
+  " version INT NOT NULL," \
+  " created INT NOT NULL" \
+  ");" \
+  "CREATE TABLE package (" \
+  " filename TEXT PRIMARY KEY NOT NULL," \
+  " basename TEXT NOT NULL," \
+  " version TEXT," \
+  " name TEXT," \
+  " description TEXT," \
+  " url TEXT," \
+  " downloadurl TEXT," \
+  " downloadsourceurl TEXT," \
+  " category TEXT," \
+  " type TEXT," \
+  " versiondate TEXT," \
+  " licensefile TEXT," \
+  " licensetype TEXT," \
+  " status TEXT," \
+  " architecture TEXT," \
+  " filesize INT NOT NULL," \
+  " filetime INT NOT NULL," \
+  " sha256 TEXT," \
+  " indexed INT NOT NULL" \
+  ");" \
+  "CREATE INDEX idx_package_basename ON package (basename);" \
+  "CREATE TABLE package_dependency (" \
+  " filename TEXT NOT NULL," \
+  " type INT NOT NULL," \
+  " name TEXT NOT NULL," \
+  " FOREIGN KEY(filename) REFERENCES package(filename)" \
+  ");" \
+  "CREATE INDEX idx_package_dependency_filename ON package_dependency (filename);" \
+  "CREATE INDEX idx_package_dependency_name ON package_dependency (name);" \
+  "CREATE TABLE package_path (" \
+  " filename TEXT NOT NULL," \
+  " type INT NOT NULL," \
+  " path TEXT NOT NULL," \
+  " FOREIGN KEY(filename) REFERENCES package(filename)" \
+  ");" \
+  "CREATE INDEX idx_package_path_filename ON package_path (filename);" \
+  "CREATE INDEX idx_package_path_path ON package_path (path);"
+};
+
+#define DB_SQL_BEGIN_TRANSACTION "BEGIN IMMEDIATE TRANSACTION;"
+#define DB_SQL_END_TRANSACTION "COMMIT TRANSACTION;"
+#define DB_SQL_ABORT_TRANSACTION "ROLLBACK TRANSACTION;"
+#define DB_SQL_GET_DBVERSION "SELECT MAX(version) FROM dbinfo"
+#define DB_SQL_SET_DBVERSION "INSERT INTO dbinfo (version, created) VALUES (?, strftime('%s','now'))"
+#define DB_SQL_ADD_PACKAGE "INSERT INTO package (basename, version, name, description, url, downloadurl, downloadsourceurl, category, type, versiondate, licensefile, licensetype, status, filename, architecture, filesize, filetime, sha256, indexed) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, strftime('%s','now'))"
+#define DB_SQL_ADD_PACKAGE_DEPENDENCY "INSERT INTO package_dependency (filename, type, name) VALUES (?, ?, ?)"
+#define DB_SQL_ADD_PACKAGE_PATH "INSERT INTO package_path (filename, type, path) VALUES (?, ?, ?)"
+#define DB_SQL_DEL_PACKAGE "DELETE FROM package WHERE filename=?"
+#define DB_SQL_DEL_PACKAGE_DEPENDENCIES "DELETE FROM package_dependency WHERE filename=?"
+#define DB_SQL_DEL_PACKAGE_PATHS "DELETE FROM package_path WHERE filename=?"
+#define DB_SQL_GET_PACKAGE "SELECT basename, version, name, description, url, downloadurl, downloadsourceurl, category, type, versiondate, licensefile, licensetype, status, filesize, filetime FROM package WHERE filename=?"
+#define DB_SQL_GET_PACKAGE_DEPENDENCIES "SELECT type, name FROM package_dependency WHERE filename=?"
+#define DB_SQL_GET_PACKAGE_PATHS "SELECT type, path FROM package_path WHERE filename=?"
+
+//same values as used in the package database
+#define PACKAGE_DEPENDENCY_TYPE_OPTIONAL         0
+#define PACKAGE_DEPENDENCY_TYPE_MANDATORY        1
+#define PACKAGE_DEPENDENCY_TYPE_BUILD_OPTIONAL   2
+#define PACKAGE_DEPENDENCY_TYPE_BUILD            3
+
+#define PACKAGE_PATH_TYPE_FILE              0
+#define PACKAGE_PATH_TYPE_FOLDER            1
+
+struct pkgrepo_handle_struct {
+  sqlite3* db;
+  sqlite3_stmt* db_pkg_add;
+  sqlite3_stmt* db_pkgdep_add;
+  sqlite3_stmt* db_pkgpath_add;
+  sqlite3_stmt* db_pkg_del;
+  sqlite3_stmt* db_pkgdep_del;
+  sqlite3_stmt* db_pkgpath_del;
+  sqlite3_stmt* db_pkg_get;
+  sqlite3_stmt* db_pkgdep_get;
+  sqlite3_stmt* db_pkgpath_get;
+};
+
+////////////////////////////////////////////////////////////////////////
+
+static int64_t pkgrepo_get_dbversion (sqlite3* db)
+{
+  int64_t result = 0;
+  sqlite3_stmt* sqlresult;
+  if (sqlite3_prepare_v2(db, DB_SQL_GET_DBVERSION, -1, &sqlresult, NULL) == SQLITE_OK) {
+    if (sqlite3_step(sqlresult) == SQLITE_ROW)
+      result = sqlite3_column_int64(sqlresult, 0);
+    sqlite3_finalize(sqlresult);
+  }
+  return result;
+}
+
+static int pkgrepo_upgrade_database (sqlite3* db)
+{
+  int64_t dbversion;
+  sqlite3_stmt* sqlresult;
+  if (sqlite3_exec(db, DB_SQL_BEGIN_TRANSACTION, NULL, NULL, NULL) != SQLITE_OK)
+    return -1;
+  //check again now that the database is locked (another process may have created it in the meantime)
+  for (dbversion = pkgrepo_get_dbversion(db); dbversion < PKGREPO_VERSION; dbversion++) {
+    if (sqlite3_exec(db, pkgrepo_sql_create[dbversion], NULL, NULL, NULL) != SQLITE_OK)
+      break;
+    if (sqlite3_prepare_v2(db, DB_SQL_SET_DBVERSION, -1, &sqlresult, NULL) != SQLITE_OK)
+      break;
+    sqlite3_bind_int64(sqlresult, 1, dbversion + 1);
+    sqlite3_step(sqlresult);
+    sqlite3_finalize(sqlresult);
+  }
+  if (dbversion < PKGREPO_VERSION) {
+    sqlite3_exec(db, DB_SQL_ABORT_TRANSACTION, NULL, NULL, NULL);
+    return 1;
+  }
+  return (sqlite3_exec(db, DB_SQL_END_TRANSACTION, NULL, NULL, NULL) == SQLITE_OK ? 0 : 2);
+}
+
+#define PREP_SQL(var,sql) \
+  if (sqlite3_prepare_v3(handle->db, sql, -1, SQLITE_PREPARE_PERSISTENT, &handle->var, NULL) != SQLITE_OK) { \
+    pkgrepo_close(handle); \
+    return NULL; \
+  }
+
+pkgrepo_handle pkgrepo_open (const char* pkgdir)
+{
+  struct pkgrepo_handle_struct* handle;
+  struct memory_buffer* dbpath;
+  if (!pkgdir || !*pkgdir)
+    return NULL;
+  if ((handle = (struct pkgrepo_handle_struct*)calloc(1, sizeof(struct pkgrepo_handle_struct))) == NULL)
+    return NULL;
+  //open database
+  dbpath = memory_buffer_create();
+  memory_buffer_set_printf(dbpath, "%s%c%s", pkgdir, PATH_SEPARATOR, PACKAGE_REPOSITORY_INDEX_FILE);
+  if (sqlite3_open(memory_buffer_get(dbpath), &handle->db) != SQLITE_OK) {
+    memory_buffer_free(dbpath);
+    pkgrepo_close(handle);
+    return NULL;
+  }
+  memory_buffer_free(dbpath);
+  sqlite3_busy_timeout(handle->db, PKGREPO_BUSY_TIMEOUT_MS);
+  //create database if it doesn't exist or upgrade to current level if needed
+  if (pkgrepo_get_dbversion(handle->db) < PKGREPO_VERSION && pkgrepo_upgrade_database(handle->db) != 0) {
+    pkgrepo_close(handle);
+    return NULL;
+  }
+  //prepare SQL statements
+  PREP_SQL(db_pkg_add, DB_SQL_ADD_PACKAGE)
+  PREP_SQL(db_pkgdep_add, DB_SQL_ADD_PACKAGE_DEPENDENCY)
+  PREP_SQL(db_pkgpath_add, DB_SQL_ADD_PACKAGE_PATH)
+  PREP_SQL(db_pkg_del, DB_SQL_DEL_PACKAGE)
+  PREP_SQL(db_pkgdep_del, DB_SQL_DEL_PACKAGE_DEPENDENCIES)
+  PREP_SQL(db_pkgpath_del, DB_SQL_DEL_PACKAGE_PATHS)
+  PREP_SQL(db_pkg_get, DB_SQL_GET_PACKAGE)
+  PREP_SQL(db_pkgdep_get, DB_SQL_GET_PACKAGE_DEPENDENCIES)
+  PREP_SQL(db_pkgpath_get, DB_SQL_GET_PACKAGE_PATHS)
+  return handle;
+}
+
+#undef PREP_SQL
+
+void pkgrepo_close (pkgrepo_handle handle)
+{
+  if (handle) {
+    if (handle->db) {
+      sqlite3_finalize(handle->db_pkg_add);
+      sqlite3_finalize(handle->db_pkgdep_add);
+      sqlite3_finalize(handle->db_pkgpath_add);
+      sqlite3_finalize(handle->db_pkg_del);
+      sqlite3_finalize(handle->db_pkgdep_del);
+      sqlite3_finalize(handle->db_pkgpath_del);
+      sqlite3_finalize(handle->db_pkg_get);
+      sqlite3_finalize(handle->db_pkgdep_get);
+      sqlite3_finalize(handle->db_pkgpath_get);
+      sqlite3_close(handle->db);
+    }
+    free(handle);
+  }
+}
+
+//execute prepared statement with only the file name as parameter
+static int pkgrepo_exec_filename (sqlite3_stmt* stmt, const char* filename)
+{
+  int status;
+  sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_STATIC);
+  status = sqlite3_step(stmt);
+  sqlite3_clear_bindings(stmt);
+  sqlite3_reset(stmt);
+  return (status == SQLITE_DONE ? 0 : status);
+}
+
+//add all entries in list with the specified type using prepared statement (filename, type, value)
+static int pkgrepo_add_list (sqlite3_stmt* stmt, const char* filename, int64_t type, sorted_unique_list* list)
+{
+  size_t i;
+  const char* value;
+  int status = 0;
+  sqlite3_bind_text(stmt, 1, filename, -1, SQLITE_STATIC);
+  sqlite3_bind_int64(stmt, 2, type);
+  for (i = 0; !status && (value = sorted_unique_list_get(list, i)) != NULL; i++) {
+    sqlite3_bind_text(stmt, 3, value, -1, SQLITE_STATIC);
+    if (sqlite3_step(stmt) != SQLITE_DONE)
+      status = 1;
+    sqlite3_reset(stmt);
+  }
+  sqlite3_clear_bindings(stmt);
+  return status;
+}
+
+static int pkgrepo_remove_package_data (pkgrepo_handle handle, const char* filename)
+{
+  int status;
+  if ((status = pkgrepo_exec_filename(handle->db_pkgpath_del, filename)) != 0)
+    return status;
+  if ((status = pkgrepo_exec_filename(handle->db_pkgdep_del, filename)) != 0)
+    return status;
+  return pkgrepo_exec_filename(handle->db_pkg_del, filename);
+}
+
+int pkgrepo_add_package (pkgrepo_handle handle, const char* filename, const char* arch, const struct package_metadata_struct* pkginfo, uint64_t filesize, time_t filetime, const char* sha256)
+{
+  int i;
+  int status;
+  if (!handle || !filename || !pkginfo || !pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME])
+    return -1;
+  if (sqlite3_exec(handle->db, DB_SQL_BEGIN_TRANSACTION, NULL, NULL, NULL) != SQLITE_OK)
+    return -1;
+  //replace existing entry for the same package file
+  if ((status = pkgrepo_remove_package_data(handle, filename)) == 0) {
+    for (i = 0; i < PACKAGE_METADATA_TOTAL_FIELDS; i++)
+      sqlite3_bind_text(handle->db_pkg_add, i + 1, pkginfo->datafield[i], -1, SQLITE_STATIC);
+    sqlite3_bind_text(handle->db_pkg_add, PACKAGE_METADATA_TOTAL_FIELDS + 1, filename, -1, SQLITE_STATIC);
+    sqlite3_bind_text(handle->db_pkg_add, PACKAGE_METADATA_TOTAL_FIELDS + 2, arch, -1, SQLITE_STATIC);
+    sqlite3_bind_int64(handle->db_pkg_add, PACKAGE_METADATA_TOTAL_FIELDS + 3, (int64_t)filesize);
+    sqlite3_bind_int64(handle->db_pkg_add, PACKAGE_METADATA_TOTAL_FIELDS + 4, (int64_t)filetime);
+    sqlite3_bind_text(handle->db_pkg_add, PACKAGE_METADATA_TOTAL_FIELDS + 5, sha256, -1, SQLITE_STATIC);
+    if (sqlite3_step(handle->db_pkg_add) != SQLITE_DONE)
+      status = 1;
+    sqlite3_clear_bindings(handle->db_pkg_add);
+    sqlite3_reset(handle->db_pkg_add);
+  }
+  if (!status)
+    status = pkgrepo_add_list(handle->db_pkgdep_add, filename, PACKAGE_DEPENDENCY_TYPE_MANDATORY, pkginfo->dependencies);
+  if (!status)
+    status = pkgrepo_add_list(handle->db_pkgdep_add, filename, PACKAGE_DEPENDENCY_TYPE_OPTIONAL, pkginfo->optionaldependencies);
+  if (!status)
+    status = pkgrepo_add_list(handle->db_pkgdep_add, filename, PACKAGE_DEPENDENCY_TYPE_BUILD, pkginfo->builddependencies);
+  if (!status)
+    status = pkgrepo_add_list(handle->db_pkgdep_add, filename, PACKAGE_DEPENDENCY_TYPE_BUILD_OPTIONAL, pkginfo->optionalbuilddependencies);
+  if (!status)
+    status = pkgrepo_add_list(handle->db_pkgpath_add, filename, PACKAGE_PATH_TYPE_FILE, pkginfo->filelist);
+  if (!status)
+    status = pkgrepo_add_list(handle->db_pkgpath_add, filename, PACKAGE_PATH_TYPE_FOLDER, pkginfo->folderlist);
+  //commit or roll back
+  if (status) {
+    sqlite3_exec(handle->db, DB_SQL_ABORT_TRANSACTION, NULL, NULL, NULL);
+    return status;
+  }
+  return (sqlite3_exec(handle->db, DB_SQL_END_TRANSACTION, NULL, NULL, NULL) == SQLITE_OK ? 0 : 2);
+}
+
+struct package_metadata_struct* pkgrepo_read_package (pkgrepo_handle handle, const char* filename, uint64_t filesize, time_t filetime, int withpaths)
+{
+  int i;
+  const char* s;
+  struct package_metadata_struct* pkginfo = NULL;
+  if (!handle || !filename)
+    return NULL;
+  //get package information (only if the package file wasn't changed since it was indexed)
+  sqlite3_bind_text(handle->db_pkg_get, 1, filename, -1, SQLITE_STATIC);
+  if (sqlite3_step(handle->db_pkg_get) == SQLITE_ROW) {
+    if ((uint64_t)sqlite3_column_int64(handle->db_pkg_get, PACKAGE_METADATA_TOTAL_FIELDS) == filesize && (time_t)sqlite3_column_int64(handle->db_pkg_get, PACKAGE_METADATA_TOTAL_FIELDS + 1) == filetime) {
+      if ((pkginfo = package_metadata_create()) != NULL) {
+        for (i = 0; i < PACKAGE_METADATA_TOTAL_FIELDS; i++) {
+          s = (const char*)sqlite3_column_text(handle->db_pkg_get, i);
+          pkginfo->datafield[i] = (s ? strdup(s) : NULL);
+        }
+      }
+    }
+  }
+  sqlite3_clear_bindings(handle->db_pkg_get);
+  sqlite3_reset(handle->db_pkg_get);
+  if (!pkginfo)
+    return NULL;
+  //get dependencies
+  sqlite3_bind_text(handle->db_pkgdep_get, 1, filename, -1, SQLITE_STATIC);
+  while (sqlite3_step(handle->db_pkgdep_get) == SQLITE_ROW) {
+    s = (const char*)sqlite3_column_text(handle->db_pkgdep_get, 1);
+    switch (sqlite3_column_int64(handle->db_pkgdep_get, 0)) {
+      case PACKAGE_DEPENDENCY_TYPE_MANDATORY:
+        sorted_unique_list_add(pkginfo->dependencies, s);
+        break;
+      case PACKAGE_DEPENDENCY_TYPE_OPTIONAL:
+        sorted_unique_list_add(pkginfo->optionaldependencies, s);
+        break;
+      case PACKAGE_DEPENDENCY_TYPE_BUILD:
+        sorted_unique_list_add(pkginfo->builddependencies, s);
+        break;
+      case PACKAGE_DEPENDENCY_TYPE_BUILD_OPTIONAL:
+        sorted_unique_list_add(pkginfo->optionalbuilddependencies, s);
+        break;
+    }
+  }
+  sqlite3_clear_bindings(handle->db_pkgdep_get);
+  sqlite3_reset(handle->db_pkgdep_get);
+  //get files and folders
+  if (withpaths) {
+    sqlite3_bind_text(handle->db_pkgpath_get, 1, filename, -1, SQLITE_STATIC);
+    while (sqlite3_step(handle->db_pkgpath_get) == SQLITE_ROW) {
+      s = (const char*)sqlite3_column_text(handle->db_pkgpath_get, 1);
+      if (sqlite3_column_int64(handle->db_pkgpath_get, 0) == PACKAGE_PATH_TYPE_FOLDER)
+        sorted_unique_list_add(pkginfo->folderlist, s);
+      else
+        sorted_unique_list_add(pkginfo->filelist, s);
+    }
+    sqlite3_clear_bindings(handle->db_pkgpath_get);
+    sqlite3_reset(handle->db_pkgpath_get);
+  }
+  return pkginfo;
+}
@@ -0,0 +1,61 @@
+/*
+  header file for functions related to the package repository index (metadata of package files in a package directory)
+*/
+
+#ifndef INCLUDED_PKGREPO_H
+#define INCLUDED_PKGREPO_H
+
+#include "pkg.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//!handle type used for accessing the package repository index
+typedef struct pkgrepo_handle_struct* pkgrepo_handle;
+
+//!open package repository index in package directory (created if it doesn't exist yet)
+/*!
+  \param  pkgdir                package directory
+  \return a handle on success or NULL on error
+*/
+pkgrepo_handle pkgrepo_open (const char* pkgdir);
+
+//!close package repository index
+/*!
+  \param  handle                package repository index handle
+*/
+void pkgrepo_close (pkgrepo_handle handle);
+
+//!add or replace package file in package repository index
+/*!
+  \param  handle                package repository index handle
+  \param  filename              package file name (without path)
+  \param  arch                  target architecture
+  \param  pkginfo               package information (including files and folders)
+  \param  filesize              size of package file
+  \param  filetime              modification time of package file
+  \param  sha256                SHA-256 hash of package file as hexadecimal string (may be NULL)
+  \return 0 on success
+*/
+int pkgrepo_add_package (pkgrepo_handle handle, const char* filename, const char* arch, const struct package_metadata_struct* pkginfo, uint64_t filesize, time_t filetime, const char* sha256);
+
+//!read package information from package repository index
+/*!
+  \param  handle                package repository index handle
+  \param  filename              package file name (without path)
+  \param  filesize              current size of package file
+  \param  filetime              current modification time of package file
+  \param  withpaths             non-zero to also read the files and folders
+  \return package information or NULL if not found or if size or modification time don't match (package file was replaced after it was indexed), the caller must free the result with package_metadata_free()
+*/
+struct package_metadata_struct* pkgrepo_read_package (pkgrepo_handle handle, const char* filename, uint64_t filesize, time_t filetime, int withpaths);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_PKGREPO_H
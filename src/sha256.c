@@ -0,0 +1,170 @@
+#include "sha256.h"
+#include <stdio.h>
+#include <string.h>
+
+#define SHA256_FILE_READ_BUFFER_SIZE (64 * 1024)
+
+#define ROTR32(x,n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+//process one 64 byte block
+static void sha256_transform (struct sha256_context* ctx, const unsigned char* block)
+{
+  int i;
+  uint32_t w[64];
+  uint32_t a, b, c, d, e, f, g, h;
+  uint32_t t1, t2;
+  for (i = 0; i < 16; i++)
+    w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16) | ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+  for (i = 16; i < 64; i++)
+    w[i] = (ROTR32(w[i - 2], 17) ^ ROTR32(w[i - 2], 19) ^ (w[i - 2] >> 10)) + w[i - 7] + (ROTR32(w[i - 15], 7) ^ ROTR32(w[i - 15], 18) ^ (w[i - 15] >> 3)) + w[i - 16];
+  a = ctx->state[0];
+  b = ctx->state[1];
+  c = ctx->state[2];
+  d = ctx->state[3];
+  e = ctx->state[4];
+  f = ctx->state[5];
+  g = ctx->state[6];
+  h = ctx->state[7];
+  for (i = 0; i < 64; i++) {
+    t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+    t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+    h = g;
+    g = f;
+    f = e;
+    e = d + t1;
+    d = c;
+    c = b;
+    b = a;
+    a = t1 + t2;
+  }
+  ctx->state[0] += a;
+  ctx->state[1] += b;
+  ctx->state[2] += c;
+  ctx->state[3] += d;
+  ctx->state[4] += e;
+  ctx->state[5] += f;
+  ctx->state[6] += g;
+  ctx->state[7] += h;
+}
+
+void sha256_init (struct sha256_context* ctx)
+{
+  ctx->state[0] = 0x6a09e667;
+  ctx->state[1] = 0xbb67ae85;
+  ctx->state[2] = 0x3c6ef372;
+  ctx->state[3] = 0xa54ff53a;
+  ctx->state[4] = 0x510e527f;
+  ctx->state[5] = 0x9b05688c;
+  ctx->state[6] = 0x1f83d9ab;
+  ctx->state[7] = 0x5be0cd19;
+  ctx->length = 0;
+  ctx->bufferlen = 0;
+}
+
+void sha256_update (struct sha256_context* ctx, const void* data, size_t datalen)
+{
+  size_t n;
+  const unsigned char* p = (const unsigned char*)data;
+  ctx->length += datalen;
+  //complete partially filled block
+  if (ctx->bufferlen > 0) {
+    n = 64 - ctx->bufferlen;
+    if (n > datalen)
+      n = datalen;
+    memcpy(ctx->buffer + ctx->bufferlen, p, n);
+    ctx->bufferlen += n;
+    p += n;
+    datalen -= n;
+    if (ctx->bufferlen < 64)
+      return;
+    sha256_transform(ctx, ctx->buffer);
+    ctx->bufferlen = 0;
+  }
+  //process full blocks directly from data
+  while (datalen >= 64) {
+    sha256_transform(ctx, p);
+    p += 64;
+    datalen -= 64;
+  }
+  //keep remaining data
+  if (datalen > 0) {
+    memcpy(ctx->buffer, p, datalen);
+    ctx->bufferlen = datalen;
+  }
+}
+
+void sha256_final (struct sha256_context* ctx, unsigned char* digest)
+{
+  int i;
+  uint64_t bitlength = ctx->length * 8;
+  //add padding
+  ctx->buffer[ctx->bufferlen++] = 0x80;
+  if (ctx->bufferlen > 56) {
+    memset(ctx->buffer + ctx->bufferlen, 0, 64 - ctx->bufferlen);
+    sha256_transform(ctx, ctx->buffer);
+    ctx->bufferlen = 0;
+  }
+  memset(ctx->buffer + ctx->bufferlen, 0, 56 - ctx->bufferlen);
+  //add length in bits
+  for (i = 0; i < 8; i++)
+    ctx->buffer[56 + i] = (unsigned char)(bitlength >> (56 - i * 8));
+  sha256_transform(ctx, ctx->buffer);
+  //store result
+  for (i = 0; i < 8; i++) {
+    digest[i * 4] = (unsigned char)(ctx->state[i] >> 24);
+    digest[i * 4 + 1] = (unsigned char)(ctx->state[i] >> 16);
+    digest[i * 4 + 2] = (unsigned char)(ctx->state[i] >> 8);
+    digest[i * 4 + 3] = (unsigned char)ctx->state[i];
+  }
+}
+
+char* sha256_digest_to_hex (const unsigned char* digest, char* hex)
+{
+  int i;
+  static const char hexdigits[] = "0123456789abcdef";
+  for (i = 0; i < SHA256_DIGEST_SIZE; i++) {
+    hex[i * 2] = hexdigits[digest[i] >> 4];
+    hex[i * 2 + 1] = hexdigits[digest[i] & 0x0F];
+  }
+  hex[SHA256_DIGEST_SIZE * 2] = 0;
+  return hex;
+}
+
+int sha256_file (const char* path, char* hex)
+{
+  FILE* src;
+  char* buf;
+  size_t buflen;
+  struct sha256_context ctx;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  if ((src = fopen(path, "rb")) == NULL)
+    return 1;
+  if ((buf = (char*)malloc(SHA256_FILE_READ_BUFFER_SIZE)) == NULL) {
+    fclose(src);
+    return 2;
+  }
+  sha256_init(&ctx);
+  while ((buflen = fread(buf, 1, SHA256_FILE_READ_BUFFER_SIZE, src)) > 0)
+    sha256_update(&ctx, buf, buflen);
+  if (ferror(src)) {
+    free(buf);
+    fclose(src);
+    return 3;
+  }
+  sha256_final(&ctx, digest);
+  sha256_digest_to_hex(digest, hex);
+  free(buf);
+  fclose(src);
+  return 0;
+}
@@ -0,0 +1,70 @@
+/*
+  header file for SHA-256 hash functions
+*/
+
+#ifndef INCLUDED_SHA256_H
+#define INCLUDED_SHA256_H
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+//!size of SHA-256 digest in bytes
+#define SHA256_DIGEST_SIZE 32
+
+//!size of buffer needed to hold SHA-256 digest as hexadecimal string (including terminating zero)
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+//!data structure for calculating SHA-256 hash
+struct sha256_context {
+  uint32_t state[8];
+  uint64_t length;
+  unsigned char buffer[64];
+  size_t bufferlen;
+};
+
+//!initialize SHA-256 calculation
+/*!
+  \param  ctx                   SHA-256 context
+*/
+void sha256_init (struct sha256_context* ctx);
+
+//!add data to SHA-256 calculation
+/*!
+  \param  ctx                   SHA-256 context
+  \param  data                  data
+  \param  datalen               length of data in bytes
+*/
+void sha256_update (struct sha256_context* ctx, const void* data, size_t datalen);
+
+//!finish SHA-256 calculation
+/*!
+  \param  ctx                   SHA-256 context
+  \param  digest                buffer of SHA256_DIGEST_SIZE bytes that will receive the digest
+*/
+void sha256_final (struct sha256_context* ctx, unsigned char* digest);
+
+//!convert SHA-256 digest to lowercase hexadecimal string
+/*!
+  \param  digest                digest of SHA256_DIGEST_SIZE bytes
+  \param  hex                   buffer of SHA256_HEX_SIZE bytes that will receive the hexadecimal string
+  \return hex
+*/
+char* sha256_digest_to_hex (const unsigned char* digest, char* hex);
+
+//!calculate SHA-256 hash of a file
+/*!
+  \param  path                  path of file
+  \param  hex                   buffer of SHA256_HEX_SIZE bytes that will receive the hexadecimal string
+  \return 0 on success or non-zero on error
+*/
+int sha256_file (const char* path, char* hex);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif //INCLUDED_SHA256_H
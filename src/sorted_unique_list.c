@@ -101,7 +101,7 @@ size_t sorted_unique_list_add_comma_separated_list (sorted_unique_list* sortuniq
 
 void sorted_unique_list_remove (sorted_unique_list* sortuniqlist, const char* data)
 {
-  if (!sortuniqlist || !data || !*data)
+  if (!sortuniqlist || !data)
     return;
   avl_delete(sortuniqlist->tree, (void*)data);
 }
@@ -280,8 +280,8 @@ int sorted_unique_list_compare_lists (const sorted_unique_list* sortuniqlist1, c
   }
   //iterate through remaining individual lists
   if (callback_only1_fn) {
-    data1 = sorted_unique_list_get(sortuniqlist1, pos1);
     while (pos1 < sortuniqlist1size) {
+      data1 = sorted_unique_list_get(sortuniqlist1, pos1);
       if ((result = (*callback_only1_fn)(data1, callbackdata)) != 0)
         return result;
       pos1++;
@@ -14,7 +14,7 @@
 /*! \brief minor version number */
 #define WINLIBS_VERSION_MINOR 0
 /*! \brief micro version number */
-#define WINLIBS_VERSION_MICRO 24
+#define WINLIBS_VERSION_MICRO 25
 /*! @} */
 
 /*! \brief packed version number */
@@ -103,15 +103,28 @@
 #define PACKAGE_DATABASE_PATH "/var/lib/winlibs"
 #endif
 
+/*! \brief path where packages are extracted before being moved in place during installation */
+#ifdef _WIN32
+#define PACKAGE_STAGING_PATH "\\var\\lib\\winlibs\\staging"
+#else
+#define PACKAGE_STAGING_PATH "/var/lib/winlibs/staging"
+#endif
+
 /*! \brief package information database filename */
 #define PACKAGE_DATABASE_FILE "wl-pkg.db"
 
+/*! \brief package repository index filename (stored in the package directory) */
+#define PACKAGE_REPOSITORY_INDEX_FILE "wl-repo.db"
+
 /*! \brief extension for package recipe files */
 #define PACKAGE_RECIPE_EXTENSION ".winlib"
 
 /*! \brief base name for lock file used for downloads */
 #define SOURCE_DOWNLOAD_LOCK_FILE_BASE ".winlibsdownload"
 
+/*! \brief base name for lock file used while installing packages (stored in the package database path) */
+#define PACKAGE_INSTALL_LOCK_FILE_BASE ".winlibsinstall"
+
 /*! \brief sleep for specified number of seconds */
 #ifdef _WIN32
 #define SLEEP_SECONDS(s) Sleep(s * 1000);
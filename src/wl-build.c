@@ -51,16 +51,15 @@ DEFINE_INTERRUPT_HANDLER_END(handle_break_signal)
 
 int pkgdb_is_package_installed_callback (const char* basename, void* callbackdata)
 {
-  struct package_metadata_struct* pkginfo;
-  if ((pkginfo = pkgdb_read_package((pkgdb_handle)callbackdata, basename)) == NULL)
+  if (!pkgdb_snapshot_package_is_installed((pkgdb_snapshot)callbackdata, basename))
     return -1;
-  package_metadata_free(pkginfo);
   return 0;
 }
 
 int main (int argc, char** argv, char *envp[])
 {
   pkgdb_handle db;
+  pkgdb_snapshot installed;
   int showversion = 0;
   int showhelp = 0;
   const char* dstdir = NULL;
@@ -143,6 +142,12 @@ int main (int argc, char** argv, char *envp[])
     fprintf(stderr, "No valid package database found for: %s\n", dstdir);
     return 6;
   }
+  //load information about installed packages in memory
+  if ((installed = pkgdb_snapshot_create(db)) == NULL) {
+    fprintf(stderr, "Error reading package database for: %s\n", dstdir);
+    pkgdb_close(db);
+    return 6;
+  }
 
   //install signal handler
   INSTALL_INTERRUPT_HANDLER(handle_break_signal)
@@ -209,11 +214,11 @@ int main (int argc, char** argv, char *envp[])
     unsigned long exitcode;
     struct package_info_list_struct* current;
     struct package_metadata_struct* pkginfo;
-    struct package_metadata_struct* dbpkginfo;
+    const struct package_metadata_struct* dbpkginfo;
     while (!interrupted && (current = packagebuildlist) != NULL) {
       skip = 0;
       //check installed version
-      dbpkginfo = pkgdb_read_package(db, current->info->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
+      dbpkginfo = pkgdb_snapshot_get_package(installed, current->info->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
       printf("--> %s %s (", current->info->datafield[PACKAGE_METADATA_INDEX_BASENAME], current->info->datafield[PACKAGE_METADATA_INDEX_VERSION]);
       if (!dbpkginfo)
         printf("currently not installed");
@@ -235,7 +240,7 @@ int main (int argc, char** argv, char *envp[])
           skip++;
         }
         //check if prerequisites are installed
-        if (dstdir && (iterate_packages_in_list(pkginfo->dependencies, pkgdb_is_package_installed_callback, db) != 0 || iterate_packages_in_list(pkginfo->builddependencies, pkgdb_is_package_installed_callback, db) != 0)) {
+        if (dstdir && (iterate_packages_in_list(pkginfo->dependencies, pkgdb_is_package_installed_callback, installed) != 0 || iterate_packages_in_list(pkginfo->builddependencies, pkgdb_is_package_installed_callback, installed) != 0)) {
           printf("missing dependencies, skipping\n");
           skip++;
         }
@@ -259,15 +264,13 @@ int main (int argc, char** argv, char *envp[])
       if (skip && dstdir && pkginfo && pkginfo->lastchanged) {
         if (PKG_XTRA(current->info)->filtertype == filter_type_changed) {
           time_t install_lastchanged;
-          if ((install_lastchanged = installed_package_lastchanged(dstdir, current->info->datafield[PACKAGE_METADATA_INDEX_BASENAME])) != 0 && install_lastchanged < pkginfo->lastchanged) {
+          if (dbpkginfo && (install_lastchanged = dbpkginfo->lastchanged) != 0 && install_lastchanged < pkginfo->lastchanged) {
             printf("build recipe for %s was changed, rebuilding (installed: %lu, package: %lu)\n", pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], (unsigned long)install_lastchanged, (unsigned long)pkginfo->lastchanged);
             skip = 0;
           }
         }
       }
       //clean up
-      if (dbpkginfo)
-        package_metadata_free(dbpkginfo);
       if (pkginfo)
         package_metadata_free(pkginfo);
       //build package (unless it should be skipped)
@@ -286,6 +289,8 @@ int main (int argc, char** argv, char *envp[])
         }
         //build package
         exitcode = build_package(packageinfopath, current->info->datafield[PACKAGE_METADATA_INDEX_BASENAME], shellcmd, logfile, builddir);
+        //update in-memory information as the build process may have (re)installed the package
+        pkgdb_snapshot_refresh_package(installed, db, current->info->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
         //clean up log file
         if (logfile) {
           if (removelog && exitcode == 0)
@@ -306,6 +311,7 @@ int main (int argc, char** argv, char *envp[])
   }
 
   //clean up
+  pkgdb_snapshot_free(installed);
   pkgdb_close(db);
   sorted_unique_list_free(sortedpackagelist);
   return 0;
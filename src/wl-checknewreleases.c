@@ -34,6 +34,9 @@
 #define DEFAULT_CACHE_LIFETIME  14400
 #define DEFAULT_DATABASE        "versioncheck.sq3"
 #define DEFAULT_THREADS         8
+#define DEFAULT_TRANSFERS       100
+#define DEFAULT_HOST_TRANSFERS  4
+#define DEFAULT_HOST_RATE       5
 
 #define VERSION_REGEX "^(%s[-._ ]?|%s)?(v|version[- ]?|v\\.|r|release[- ]?|r\\.|)([0-9]{1,}([-._][0-9]{1,}){0,16}(|[-._][0-9a-z]{1,16}|[-._ ]\\(?(src|source|amalgamation|release|stable|final|bugfix)\\)?))(|\\.md5|\\.md5sum|\\.sha1|\\.sha1sum|\\.sha256|\\.sha256sum|\\.news|\\.changes|\\.changelog)(%s|\\.tar\\.gz|\\.tgz|\\.tar\\.bz|\\.tar\\.bz2|\\.tbz2|\\.tar\\.xz|\\.txz|\\.tar\\.lz|\\.tlz|\\.zip|\\.7z|)$"
 #define VERSION_REGEX_VECTOR 3
@@ -227,130 +230,109 @@ struct check_package_versions_struct {
   //struct downloadcache* cache;
   struct downloadcachedb* cachedb;
   struct versioncheckmasterdb* versionmasterdb;
+  struct downloader_multi* dl;
   unsigned long limitsuburls;
   size_t totalpackages;
+  struct package_page_queue_struct* pagequeue;
 };
 
 struct check_package_versions_thread_info_struct {
   int threadindex;
-  struct downloader* dl;
   struct versioncheckdb* versiondb;
 };
 
-sorted_unique_list* get_package_versions_from_url (struct check_package_versions_struct* info, struct check_package_versions_thread_info_struct* threadinfo, const char* url, const char* basename, const char* filematchprefix, const char* filematchsuffix, long* presponsecode, char** pstatus)
-{
-  char* versionmatchregex;
-  int rc;
-  PCRE2_SIZE erroroffset;
-  char* prefix;
-  char* suffix;
-  char* mimetype;
-  char* htmldata;
+//state of version check of a package (pages are downloaded by the download thread and processed by any of the processing threads)
+struct package_check_struct {
+  char* packagename;
+  struct package_metadata_struct* pkginfo;
+  time_t starttime;
   struct search_html_for_versions_struct data;
-  struct download_info_struct urlinfo;
-  //compile regular expression to determine version
-  prefix = quote_for_regex(filematchprefix);
-  suffix = quote_for_regex(filematchsuffix);
-  if (asprintf(&versionmatchregex, VERSION_REGEX, basename, (prefix ? prefix : ""), (suffix ? suffix : "")) < 0) {
-    commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in asprintf()", threadinfo->threadindex);
-    exit(13);
-  }
-  free(prefix);
-  free(suffix);
-  if ((data.re = pcre2_compile((PCRE2_UCHAR*)versionmatchregex, PCRE2_ZERO_TERMINATED, PCRE2_UTF | PCRE2_CASELESS, &rc, &erroroffset, NULL))  == NULL) {
-    PCRE2_UCHAR buffer[256];
-    pcre2_get_error_message(rc, buffer, sizeof(buffer));
-    commonoutput_printf(info->logoutput, 0, "[%i] PCRE2 compilation failed at offset %i: %s, expression: %s\n", threadinfo->threadindex, (int)erroroffset, buffer, versionmatchregex);
-    commonoutput_flush(info->logoutput);
-    free(versionmatchregex);
-    return NULL;
-  }
-  free(versionmatchregex);
-  //initialize lists
-  if ((data.versions = sorted_unique_list_create(versioncmp, free)) == NULL) {
-    commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in sorted_unique_list_create()", threadinfo->threadindex);
-    exit(11);
-  }
-  if ((data.subfolders = sorted_unique_list_create(versioncmpreverse, free)) == NULL) {
-    commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in sorted_unique_list_create()", threadinfo->threadindex);
-    exit(12);
+  long responsecode;
+  char* status;
+  unsigned int numsuburls;
+  unsigned int pending;                 //number of pages not processed yet
+  pthread_mutex_t lock;                 //protects data and pending while sub-URLs are processed
+};
+
+//downloaded page waiting to be processed
+struct package_page_struct {
+  struct package_check_struct* package;
+  unsigned int index;                   //0 for the main URL or number of the sub-URL
+  char* url;
+  char* data;
+  char* status;
+  char* actualurl;
+  char* mimetype;
+  struct download_info_struct info;
+  struct package_page_queue_struct* queue;
+  struct package_page_struct* next;
+};
+
+//queue of downloaded pages and number of packages being checked
+struct package_page_queue_struct {
+  struct package_page_struct* first;
+  struct package_page_struct* last;
+  size_t packagesinprogress;
+  int finished;                         //set when no more packages will be added
+  pthread_mutex_t lock;
+  pthread_cond_t pageadded;             //signalled when a page is added, when a package is done or when finished is set
+  pthread_cond_t packagedone;           //signalled when a package is done
+};
+
+//callback function called by the download thread when a page was downloaded
+void package_page_downloaded (const char* url, char* data, struct download_info_struct* urlinfo, struct package_page_struct* page)
+{
+  struct package_page_queue_struct* queue = page->queue;
+  page->data = data;
+  pthread_mutex_lock(&queue->lock);
+  if (queue->last)
+    queue->last->next = page;
+  else
+    queue->first = page;
+  queue->last = page;
+  pthread_cond_signal(&queue->pageadded);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+//queue download of main URL (index 0) or sub-URL of a package
+void package_page_download (struct check_package_versions_struct* info, struct package_check_struct* package, unsigned int index, char* url)
+{
+  struct package_page_struct* page;
+  if ((page = (struct package_page_struct*)malloc(sizeof(struct package_page_struct))) == NULL) {
+    commonoutput_printf(info->logoutput, -1, "Memory allocation error in package_page_download()");
+    exit(14);
   }
-  //create match_data block for holding result
-  data.match_data = pcre2_match_data_create_from_pattern(data.re, NULL);
-  //get output vector
-  data.ovector = pcre2_get_ovector_pointer(data.match_data);
-  //load and parse data from URL
-  commonoutput_printf(info->logoutput, 1, "[%i] %s: loading URL: %s\n", threadinfo->threadindex, basename, url);
-  commonoutput_flush(info->logoutput);
-  data.level = 0;
-  data.url = NULL;
-  mimetype = NULL;
-  urlinfo.status = pstatus;
-  urlinfo.actualurl = &data.url;
-  urlinfo.mimetype = &mimetype;
-  htmldata = downloader_get_file(threadinfo->dl, url, &urlinfo);
-  if (presponsecode)
-    *presponsecode = urlinfo.responsecode;
-  if (!htmldata) {
-    commonoutput_printf(info->logoutput, 1, "[%i] %s: failed loading URL: %s%s%s\n", threadinfo->threadindex, basename, url, (urlinfo.status && *urlinfo.status ? " - " : ""), (urlinfo.status && *urlinfo.status ? *urlinfo.status : ""));
-    commonoutput_flush(info->logoutput);
+  page->package = package;
+  page->index = index;
+  page->url = url;
+  page->data = NULL;
+  page->status = NULL;
+  page->actualurl = NULL;
+  page->mimetype = NULL;
+  page->info.cached = 0;
+  page->info.responsecode = -1;
+  page->info.errorclass = DOWNLOAD_ERROR_NONE;
+  page->info.status = &page->status;
+  page->info.actualurl = &page->actualurl;
+  page->info.mimetype = &page->mimetype;
+  page->queue = info->pagequeue;
+  page->next = NULL;
+  if (downloader_multi_get_file(info->dl, url, &page->info, (downloader_multi_callback_fn)package_page_downloaded, page) != 0)
+    package_page_downloaded(url, NULL, &page->info, page);
+}
+
+//process downloaded contents of a page
+void package_page_search_versions (struct check_package_versions_struct* info, struct check_package_versions_thread_info_struct* threadinfo, struct package_page_struct* page)
+{
+  if (mimetype_is_html(page->mimetype)) {
+    //parse HTML
+    search_html_for_versions(page->data, &page->package->data);
+  } else if (page->mimetype && strcmp(page->mimetype, custom_mimetype_ftp_listing) == 0) {
+    search_text_list_versions(page->data, &page->package->data);
   } else {
-    unsigned int i;
-    unsigned int n;
-    char* suburl;
-    //process downloaded contents
-    if (mimetype_is_html(mimetype)) {
-      //parse HTML
-      search_html_for_versions(htmldata, &data);
-    } else if (mimetype && strcmp(mimetype, custom_mimetype_ftp_listing) == 0) {
-      search_text_list_versions(htmldata, &data);
-    } else {
-      commonoutput_printf(info->logoutput, 1, "[%i] %s: unsupported MIME type \"%s\" from URL: %s\n", threadinfo->threadindex, basename, (mimetype ? mimetype : "(none)"), url);
-      commonoutput_flush(info->logoutput);
-    }
-    free(htmldata);
-    //process subfolders
-    n = sorted_unique_list_size(data.subfolders);
-    commonoutput_printf(info->logoutput, 2, "[%i] %s: done loading URL%s (%u subfolders found): %s\n", threadinfo->threadindex, basename, (urlinfo.cached ? " from cache" : ""), n, url);
+    commonoutput_printf(info->logoutput, 1, "[%i] %s: unsupported MIME type \"%s\" from URL: %s\n", threadinfo->threadindex, page->package->packagename, (page->mimetype ? page->mimetype : "(none)"), page->url);
     commonoutput_flush(info->logoutput);
-    if (info->limitsuburls && n > info->limitsuburls)
-      n = info->limitsuburls;
-    urlinfo.status = NULL;
-    urlinfo.actualurl = NULL;
-    data.level = 1;
-    for (i = 0; !interrupted && i < n; i++) {
-      if ((suburl = resolve_url(data.url, sorted_unique_list_get(data.subfolders, i))) != NULL) {
-        //load and parse data from URL
-        commonoutput_printf(info->logoutput, 2, "[%i] %s: loading sub-URL [%u/%u]: %s\n", threadinfo->threadindex, basename, i + 1, n, suburl);
-        commonoutput_flush(info->logoutput);
-        free(mimetype);
-        mimetype = NULL;
-        if ((htmldata = downloader_get_file(threadinfo->dl, suburl, &urlinfo)) == NULL) {
-          commonoutput_printf(info->logoutput, 2, "[%i] %s: failed loading sub-URL [%u/%u]: %s\n", threadinfo->threadindex, basename, i + 1, n, suburl);
-        } else {
-          commonoutput_printf(info->logoutput, 3, "[%i] %s: done loading sub-URL%s [%u/%u]: %s\n", threadinfo->threadindex, basename, (urlinfo.cached ? " from cache" : ""), i + 1, n, suburl);
-          //process downloaded contents
-          if (mimetype_is_html(mimetype)) {
-            search_html_for_versions(htmldata, &data);
-          } else if (strcmp(mimetype, custom_mimetype_ftp_listing) == 0) {
-            search_text_list_versions(htmldata, &data);
-          } else {
-            commonoutput_printf(info->logoutput, 1, "[%i] %s: unsupported MIME type \"%s\" from URL: %s\n", threadinfo->threadindex, basename, mimetype, url);
-          }
-          free(htmldata);
-        }
-        commonoutput_flush(info->logoutput);
-        free(suburl);
-      }
-    }
   }
-  //clean up
-  free(mimetype);
-  free(data.url);
-  pcre2_match_data_free(data.match_data);
-  pcre2_code_free(data.re);
-  sorted_unique_list_free(data.subfolders);
-  return data.versions;
 }
 
 struct new_version_callback_struct {
@@ -373,15 +355,140 @@ int new_version_callback (const char* version, struct new_version_callback_struc
   return 0;
 }
 
-int check_package_versions (struct check_package_versions_struct* info, struct check_package_versions_thread_info_struct* threadinfo, const char* packagename)
+//store the versions found for a package and report new versions
+void package_check_finish (struct check_package_versions_struct* info, struct check_package_versions_thread_info_struct* threadinfo, struct package_check_struct* package)
+{
+  unsigned int i;
+  unsigned int n;
+  const char* packagename = package->packagename;
+  struct package_metadata_struct* pkginfo = package->pkginfo;
+  if ((n = sorted_unique_list_size(package->data.versions)) > 0) {
+    versioncheckdb_group_start(threadinfo->versiondb);
+    for (i = 0; i < n; i++) {
+      versioncheckdb_update_package_version(threadinfo->versiondb, packagename, sorted_unique_list_get(package->data.versions, i));
+    }
+    versioncheckdb_update_package(threadinfo->versiondb, packagename, package->responsecode, package->status, pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_DOWNLOADURL]);
+    versioncheckdb_group_end(threadinfo->versiondb);
+  } else {
+    versioncheckdb_update_package(threadinfo->versiondb, packagename, package->responsecode, package->status, pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_DOWNLOADURL]);
+  }
+  //report detected new versions
+  if (n > 0) {
+    struct new_version_callback_struct newpackagedata = {0, package->starttime, pkginfo, NULL};
+    if ((newpackagedata.outputbuffer = memory_buffer_create()) != NULL) {
+      versioncheckdb_list_new_package_versions(threadinfo->versiondb, packagename, package->starttime, (versioncheckdb_list_new_package_versions_callback_fn)new_version_callback, &newpackagedata);
+      if (newpackagedata.outputbuffer->datalen)
+        commonoutput_putbuf(info->reportoutput, -9999, newpackagedata.outputbuffer->data, newpackagedata.outputbuffer->datalen);
+      memory_buffer_free(newpackagedata.outputbuffer);
+      commonoutput_flush(info->reportoutput);
+    }
+  }
+  //clean up
+  free(package->status);
+  free(package->data.url);
+  pcre2_match_data_free(package->data.match_data);
+  pcre2_code_free(package->data.re);
+  sorted_unique_list_free(package->data.subfolders);
+  sorted_unique_list_free(package->data.versions);
+  pthread_mutex_destroy(&package->lock);
+  package_metadata_free(package->pkginfo);
+  free(package->packagename);
+  free(package);
+  //let the other threads know this package is done
+  pthread_mutex_lock(&info->pagequeue->lock);
+  info->pagequeue->packagesinprogress--;
+  pthread_cond_broadcast(&info->pagequeue->pageadded);
+  pthread_cond_signal(&info->pagequeue->packagedone);
+  pthread_mutex_unlock(&info->pagequeue->lock);
+}
+
+//process a downloaded page of a package and queue downloads of the sub-URLs found on the main page
+void package_page_process (struct check_package_versions_struct* info, struct check_package_versions_thread_info_struct* threadinfo, struct package_page_struct* page)
+{
+  int done;
+  struct package_check_struct* package = page->package;
+  const char* basename = package->packagename;
+  if (page->index == 0) {
+    //main URL (no other thread uses the package data yet)
+    package->responsecode = page->info.responsecode;
+    package->status = page->status;
+    page->status = NULL;
+    package->data.url = page->actualurl;
+    page->actualurl = NULL;
+    if (!page->data && page->info.cached && page->info.errorclass != DOWNLOAD_ERROR_NONE) {
+      commonoutput_printf(info->logoutput, 1, "[%i] %s: skipped URL (stale, recent %s error): %s%s%s\n", threadinfo->threadindex, basename, download_error_class_name(page->info.errorclass), page->url, (package->status ? " - " : ""), (package->status ? package->status : ""));
+      commonoutput_flush(info->logoutput);
+    } else if (!page->data) {
+      commonoutput_printf(info->logoutput, 1, "[%i] %s: failed loading URL: %s%s%s\n", threadinfo->threadindex, basename, page->url, (package->status ? " - " : ""), (package->status ? package->status : ""));
+      commonoutput_flush(info->logoutput);
+    } else {
+      unsigned int i;
+      unsigned int n;
+      char* suburl;
+      //process downloaded contents
+      package->data.level = 0;
+      package_page_search_versions(info, threadinfo, page);
+      //process subfolders
+      n = sorted_unique_list_size(package->data.subfolders);
+      commonoutput_printf(info->logoutput, 2, "[%i] %s: done loading URL%s (%u subfolders found): %s\n", threadinfo->threadindex, basename, (page->info.cached ? " from cache" : ""), n, page->url);
+      commonoutput_flush(info->logoutput);
+      if (info->limitsuburls && n > info->limitsuburls)
+        n = info->limitsuburls;
+      package->numsuburls = n;
+      package->data.level = 1;
+      for (i = 0; !interrupted && i < n; i++) {
+        if ((suburl = resolve_url(package->data.url, sorted_unique_list_get(package->data.subfolders, i))) != NULL) {
+          //load all sub-URLs simultaneously
+          commonoutput_printf(info->logoutput, 2, "[%i] %s: loading sub-URL [%u/%u]: %s\n", threadinfo->threadindex, basename, i + 1, n, suburl);
+          commonoutput_flush(info->logoutput);
+          pthread_mutex_lock(&package->lock);
+          package->pending++;
+          pthread_mutex_unlock(&package->lock);
+          package_page_download(info, package, i + 1, suburl);
+        }
+      }
+    }
+  } else {
+    //sub-URL
+    if (!page->data && page->info.cached && page->info.errorclass != DOWNLOAD_ERROR_NONE) {
+      commonoutput_printf(info->logoutput, 2, "[%i] %s: skipped sub-URL (stale, recent %s error) [%u/%u]: %s\n", threadinfo->threadindex, basename, download_error_class_name(page->info.errorclass), page->index, package->numsuburls, page->url);
+    } else if (!page->data) {
+      commonoutput_printf(info->logoutput, 2, "[%i] %s: failed loading sub-URL [%u/%u]: %s\n", threadinfo->threadindex, basename, page->index, package->numsuburls, page->url);
+    } else {
+      commonoutput_printf(info->logoutput, 3, "[%i] %s: done loading sub-URL%s [%u/%u]: %s\n", threadinfo->threadindex, basename, (page->info.cached ? " from cache" : ""), page->index, package->numsuburls, page->url);
+      //process downloaded contents
+      pthread_mutex_lock(&package->lock);
+      package_page_search_versions(info, threadinfo, page);
+      pthread_mutex_unlock(&package->lock);
+    }
+    commonoutput_flush(info->logoutput);
+  }
+  //clean up
+  free(page->url);
+  free(page->data);
+  free(page->status);
+  free(page->actualurl);
+  free(page->mimetype);
+  free(page);
+  //finish package when all its pages are processed
+  pthread_mutex_lock(&package->lock);
+  done = (--package->pending == 0);
+  pthread_mutex_unlock(&package->lock);
+  if (done)
+    package_check_finish(info, threadinfo, package);
+}
+
+//start version check of a package by queueing download of its main URL
+int package_check_start (struct check_package_versions_struct* info, struct check_package_versions_thread_info_struct* threadinfo, const char* packagename)
 {
   char* url;
   char* prefix;
   char* suffix;
-  long responsecode;
-  char* status;
-  sorted_unique_list* versions;
+  char* versionmatchregex;
+  int rc;
+  PCRE2_SIZE erroroffset;
   struct package_metadata_struct* pkginfo;
+  struct package_check_struct* package;
   time_t starttime = time(NULL);
   //read package information
   if ((pkginfo = read_packageinfo(info->packageinfopath, packagename)) == NULL) {
@@ -393,41 +500,72 @@ int check_package_versions (struct check_package_versions_struct* info, struct c
   get_package_downloadurl_info(pkginfo, &url, &prefix, &suffix);
   if (!url || !*url) {
     versioncheckdb_update_package(threadinfo->versiondb, packagename, -1, "No URL", pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_DOWNLOADURL]);
-  } else {
-    unsigned int i;
-    unsigned int n = 0;
-    responsecode = 0;
-    status = NULL;
-    if ((versions = get_package_versions_from_url(info, threadinfo, url, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], prefix, suffix, &responsecode, &status)) != NULL && (n = sorted_unique_list_size(versions)) > 0) {
-      versioncheckdb_group_start(threadinfo->versiondb);
-      for (i = 0; i < n; i++) {
-        versioncheckdb_update_package_version(threadinfo->versiondb, packagename, sorted_unique_list_get(versions, i));
-      }
-      versioncheckdb_update_package(threadinfo->versiondb, packagename, responsecode, status, pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_DOWNLOADURL]);
-      versioncheckdb_group_end(threadinfo->versiondb);
-    } else {
-      versioncheckdb_update_package(threadinfo->versiondb, packagename, responsecode, status, pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_DOWNLOADURL]);
-    }
-    if (versions)
-      sorted_unique_list_free(versions);
-    //report detected new versions
-    if (n > 0) {
-      struct new_version_callback_struct newpackagedata = {0, starttime, pkginfo, NULL};
-      if ((newpackagedata.outputbuffer = memory_buffer_create()) != NULL) {
-        versioncheckdb_list_new_package_versions(threadinfo->versiondb, packagename, starttime, (versioncheckdb_list_new_package_versions_callback_fn)new_version_callback, &newpackagedata);
-        if (newpackagedata.outputbuffer->datalen)
-          commonoutput_putbuf(info->reportoutput, -9999, newpackagedata.outputbuffer->data, newpackagedata.outputbuffer->datalen);
-        memory_buffer_free(newpackagedata.outputbuffer);
-        commonoutput_flush(info->reportoutput);
-      }
+    free(url);
+    free(prefix);
+    free(suffix);
+    package_metadata_free(pkginfo);
+    return 0;
+  }
+  //compile regular expression to determine version
+  {
+    char* quotedprefix = quote_for_regex(prefix);
+    char* quotedsuffix = quote_for_regex(suffix);
+    if (asprintf(&versionmatchregex, VERSION_REGEX, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], (quotedprefix ? quotedprefix : ""), (quotedsuffix ? quotedsuffix : "")) < 0) {
+      commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in asprintf()", threadinfo->threadindex);
+      exit(13);
     }
-    free(status);
+    free(quotedprefix);
+    free(quotedsuffix);
   }
-  //clean up
-  free(url);
   free(prefix);
   free(suffix);
-  package_metadata_free(pkginfo);
+  if ((package = (struct package_check_struct*)malloc(sizeof(struct package_check_struct))) == NULL) {
+    commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in package_check_start()", threadinfo->threadindex);
+    exit(14);
+  }
+  if ((package->data.re = pcre2_compile((PCRE2_UCHAR*)versionmatchregex, PCRE2_ZERO_TERMINATED, PCRE2_UTF | PCRE2_CASELESS, &rc, &erroroffset, NULL))  == NULL) {
+    PCRE2_UCHAR buffer[256];
+    pcre2_get_error_message(rc, buffer, sizeof(buffer));
+    commonoutput_printf(info->logoutput, 0, "[%i] PCRE2 compilation failed at offset %i: %s, expression: %s\n", threadinfo->threadindex, (int)erroroffset, buffer, versionmatchregex);
+    commonoutput_flush(info->logoutput);
+    versioncheckdb_update_package(threadinfo->versiondb, packagename, 0, NULL, pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_DOWNLOADURL]);
+    free(versionmatchregex);
+    free(package);
+    free(url);
+    package_metadata_free(pkginfo);
+    return 0;
+  }
+  free(versionmatchregex);
+  //initialize lists
+  if ((package->data.versions = sorted_unique_list_create(versioncmp, free)) == NULL) {
+    commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in sorted_unique_list_create()", threadinfo->threadindex);
+    exit(11);
+  }
+  if ((package->data.subfolders = sorted_unique_list_create(versioncmpreverse, free)) == NULL) {
+    commonoutput_printf(info->logoutput, -1, "[%i] Memory allocation error in sorted_unique_list_create()", threadinfo->threadindex);
+    exit(12);
+  }
+  //create match_data block for holding result
+  package->data.match_data = pcre2_match_data_create_from_pattern(package->data.re, NULL);
+  //get output vector
+  package->data.ovector = pcre2_get_ovector_pointer(package->data.match_data);
+  package->data.level = 0;
+  package->data.url = NULL;
+  package->packagename = strdup(packagename);
+  package->pkginfo = pkginfo;
+  package->starttime = starttime;
+  package->responsecode = 0;
+  package->status = NULL;
+  package->numsuburls = 0;
+  package->pending = 1;
+  pthread_mutex_init(&package->lock, NULL);
+  //load and parse data from URL
+  pthread_mutex_lock(&info->pagequeue->lock);
+  info->pagequeue->packagesinprogress++;
+  pthread_mutex_unlock(&info->pagequeue->lock);
+  commonoutput_printf(info->logoutput, 1, "[%i] %s: loading URL: %s\n", threadinfo->threadindex, pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], url);
+  commonoutput_flush(info->logoutput);
+  package_page_download(info, package, 0, url);
   return 0;
 }
 
@@ -437,15 +575,15 @@ struct package_thread_struct {
   pthread_t thread;
   int threadindex;
   struct check_package_versions_struct* info;
-  struct sorted_item_queue_struct* packagelist;
   size_t count;
   struct check_package_versions_thread_info_struct threadinfo; //initialized inside the thread
 };
 
+//thread processing downloaded pages until all packages are done
 void* package_thread (struct package_thread_struct* threaddata)
 {
-  char* packagename;
-  size_t remaining;
+  struct package_page_struct* page;
+  struct package_page_queue_struct* queue = threaddata->info->pagequeue;
   //initialize
   threaddata->threadinfo.threadindex = threaddata->threadindex;
   //open version database file
@@ -454,27 +592,24 @@ void* package_thread (struct package_thread_struct* threaddata)
     commonoutput_flush(threaddata->info->logoutput);
     return NULL;
   }
-  //create downloader
-  if ((threaddata->threadinfo.dl = downloader_create(PROGRAM_USER_AGENT, threaddata->info->cachedb, threaddata->info->logoutput)) == NULL) {
-    commonoutput_printf(threaddata->info->logoutput, -1, "[%i] Error in downloader_create()", threaddata->threadinfo.threadindex);
-    commonoutput_flush(threaddata->info->logoutput);
-    versioncheckdb_close(threaddata->threadinfo.versiondb);
-    return NULL;
-  }
-  //process packages as long as there are any in the queue
-  while (!interrupted && (packagename = sorted_item_queue_take_next(threaddata->packagelist, &remaining)) != NULL) {
+  //process pages as long as there are packages being checked
+  while (1) {
+    pthread_mutex_lock(&queue->lock);
+    while (!queue->first && !(queue->finished && queue->packagesinprogress == 0))
+      pthread_cond_wait(&queue->pageadded, &queue->lock);
+    if ((page = queue->first) != NULL) {
+      if ((queue->first = page->next) == NULL)
+        queue->last = NULL;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    if (!page)
+      break;
     threaddata->count++;
-    commonoutput_printf(threaddata->info->logoutput, 1, "[%i] Package [%lu/%lu]: %s\n", threaddata->threadinfo.threadindex, (unsigned long)(threaddata->info->totalpackages - remaining), (unsigned long)threaddata->info->totalpackages, packagename);
-    commonoutput_flush(threaddata->info->logoutput);
-    check_package_versions(threaddata->info, &threaddata->threadinfo, packagename);
-    free(packagename);
-    sched_yield();
+    package_page_process(threaddata->info, &threaddata->threadinfo, page);
   }
   //clean up
-  downloader_free(threaddata->threadinfo.dl);
-  threaddata->threadinfo.dl = NULL;
   versioncheckdb_close(threaddata->threadinfo.versiondb);
-  commonoutput_printf(threaddata->info->logoutput, 2, "[%i] Thread finished after processing %lu packages\n", threaddata->threadinfo.threadindex, (unsigned long)threaddata->count);
+  commonoutput_printf(threaddata->info->logoutput, 2, "[%i] Thread finished after processing %lu pages\n", threaddata->threadinfo.threadindex, (unsigned long)threaddata->count);
   commonoutput_flush(threaddata->info->logoutput);
   return NULL;
 }
@@ -495,6 +630,9 @@ int main (int argc, char** argv, char *envp[])
   int showhelp = 0;
   int verbose = 0;
   int numthreads = DEFAULT_THREADS;
+  unsigned long maxtransfers = DEFAULT_TRANSFERS;
+  unsigned long maxhosttransfers = DEFAULT_HOST_TRANSFERS;
+  unsigned long maxhostrate = DEFAULT_HOST_RATE;
   unsigned long cache_expiration = DEFAULT_CACHE_LIFETIME;
   const char* cachedbfile = NULL;
   const char* versiondbpath = DEFAULT_DATABASE;
@@ -515,7 +653,10 @@ int main (int argc, char** argv, char *envp[])
     {'d', "db-file",         "FILE",    miniargv_cb_set_const_str, &versiondbpath,        "version database file (default: " DEFAULT_DATABASE ")", NULL},
     {'c', "cache",           "FILE",    miniargv_cb_set_const_str, &cachedbfile,          "set cache database (\"-\" for none, default: temporary database)", NULL},
     {'x', "cache-expires",   "S",       miniargv_cb_set_long/*u*/, &cache_expiration,     "set cache expiration in seconds or zero for none (default: " STRINGIZE(DEFAULT_CACHE_LIFETIME) "s)", NULL},
-    {'j', "threads",         "N",       miniargv_cb_set_int,       &numthreads,           "set the number of simultaneus threads to use (default: " STRINGIZE(DEFAULT_THREADS) ")", NULL},
+    {'j', "threads",         "N",       miniargv_cb_set_int,       &numthreads,           "set the number of threads processing downloaded pages (default: " STRINGIZE(DEFAULT_THREADS) ")", NULL},
+    {'m', "max-transfers",   "N",       miniargv_cb_set_long/*u*/, &maxtransfers,         "set the maximum number of simultaneous downloads (default: " STRINGIZE(DEFAULT_TRANSFERS) ")", NULL},
+    {'M', "host-transfers",  "N",       miniargv_cb_set_long/*u*/, &maxhosttransfers,     "set the maximum number of simultaneous downloads from the same host, zero for no limit (default: " STRINGIZE(DEFAULT_HOST_TRANSFERS) ")", NULL},
+    {'r', "host-rate",       "N",       miniargv_cb_set_long/*u*/, &maxhostrate,          "set the maximum number of downloads started per second from the same host, zero for no limit (default: " STRINGIZE(DEFAULT_HOST_RATE) ")", NULL},
     {'n', "sub-limit",       "N",       miniargv_cb_set_long/*u*/, &info.limitsuburls,    "only get this many of the latest version subdirectories, zero for no limit (default)", NULL},
     {'o', "report",          "FILE",    miniargv_cb_set_const_str, &reportfile,           "report file to append to (default: standard output)", NULL},
     {'l', "log",             "FILE",    miniargv_cb_set_const_str, &logfile,              "log file to append to (default: standard output)", NULL},
@@ -607,8 +748,28 @@ int main (int argc, char** argv, char *envp[])
       commonoutput_printf(info.logoutput, 2, "Cache entries deleted: %i\n", n);
     commonoutput_flush(info.logoutput);
   }
-  //process each package in the list using multiple threads
+  //start download thread
+  if (maxtransfers < 1)
+    maxtransfers = 1;
+  if ((info.dl = downloader_multi_create(PROGRAM_USER_AGENT, info.cachedb, maxtransfers, maxhosttransfers, maxhostrate, info.logoutput)) == NULL) {
+    fprintf(stderr, "Error in downloader_multi_create()\n");
+    return 4;
+  }
+  //initialize queue of downloaded pages
+  struct package_page_queue_struct pagequeue;
+  pagequeue.first = NULL;
+  pagequeue.last = NULL;
+  pagequeue.packagesinprogress = 0;
+  pagequeue.finished = 0;
+  pthread_mutex_init(&pagequeue.lock, NULL);
+  pthread_cond_init(&pagequeue.pageadded, NULL);
+  pthread_cond_init(&pagequeue.packagedone, NULL);
+  info.pagequeue = &pagequeue;
+  //process downloaded pages using multiple threads
   struct package_thread_struct* threaddata;
+  struct check_package_versions_thread_info_struct threadinfo;
+  char* packagename;
+  size_t remaining;
   size_t count;
   if ((threaddata = (struct package_thread_struct*)malloc(numthreads * sizeof(struct package_thread_struct))) == NULL) {
     fprintf(stderr, "Memory allocation error\n");
@@ -616,29 +777,58 @@ int main (int argc, char** argv, char *envp[])
   }
   starttime = time(NULL);
   info.totalpackages = sorted_item_queue_size(packagelist);
-  if (numthreads > info.totalpackages)
+  if (numthreads > 0 && (size_t)numthreads > info.totalpackages)
     numthreads = info.totalpackages;
-  commonoutput_printf(info.logoutput, 2, "Checking %lu packages using %i simultaneous threads\n", (unsigned long)info.totalpackages, numthreads);
+  if (numthreads < 1)
+    numthreads = 1;
+  commonoutput_printf(info.logoutput, 2, "Checking %lu packages using up to %lu simultaneous downloads (%lu per host) and %i processing threads\n", (unsigned long)info.totalpackages, maxtransfers, maxhosttransfers, numthreads);
   commonoutput_flush(info.logoutput);
   for (i = 0; i < numthreads; i++) {
-    threaddata[i].threadindex = i;
+    threaddata[i].threadindex = i + 1;
     threaddata[i].info = &info;
-    threaddata[i].packagelist = packagelist;
     threaddata[i].count = 0;
     if (pthread_create(&threaddata[i].thread, NULL, (void *(*)(void*))package_thread, &threaddata[i]) != 0) {
       fprintf(stderr, "Unable to create thread\n");
       return 5;
     }
   }
-  //wait for all threads to finish
+  //start checking packages (limit the number of packages in progress to the maximum number of simultaneous downloads)
+  threadinfo.threadindex = 0;
+  if ((threadinfo.versiondb = versioncheckdb_open(info.versionmasterdb)) == NULL) {
+    fprintf(stderr, "Error opening version database\n");
+    return 3;
+  }
   count = 0;
+  while (!interrupted && (packagename = sorted_item_queue_take_next(packagelist, &remaining)) != NULL) {
+    pthread_mutex_lock(&pagequeue.lock);
+    while (pagequeue.packagesinprogress >= maxtransfers)
+      pthread_cond_wait(&pagequeue.packagedone, &pagequeue.lock);
+    pthread_mutex_unlock(&pagequeue.lock);
+    count++;
+    commonoutput_printf(info.logoutput, 1, "[%i] Package [%lu/%lu]: %s\n", threadinfo.threadindex, (unsigned long)(info.totalpackages - remaining), (unsigned long)info.totalpackages, packagename);
+    commonoutput_flush(info.logoutput);
+    package_check_start(&info, &threadinfo, packagename);
+    free(packagename);
+  }
+  versioncheckdb_close(threadinfo.versiondb);
+  //wait for all threads to finish
+  pthread_mutex_lock(&pagequeue.lock);
+  pagequeue.finished = 1;
+  pthread_cond_broadcast(&pagequeue.pageadded);
+  pthread_mutex_unlock(&pagequeue.lock);
   for (i = 0; i < numthreads; i++) {
     pthread_join(threaddata[i].thread, NULL);
-    count += threaddata[i].count;
   }
+  downloader_multi_free(info.dl);
+  pthread_cond_destroy(&pagequeue.packagedone);
+  pthread_cond_destroy(&pagequeue.pageadded);
+  pthread_mutex_destroy(&pagequeue.lock);
   commonoutput_printf(info.logoutput, 1, "Finished, total packages processed: %lu\n", count);
   commonoutput_printf(info.logoutput, 3, "Total run time: %lu seconds\n", (unsigned long)(time(NULL) - starttime));
   free(threaddata);
+  //create compression dictionary for cache database if it doesn't have one yet
+  if (cachedbfile && info.cachedb && downloadcachedb_train_dictionary(info.cachedb) == 0)
+    commonoutput_printf(info.logoutput, 2, "Created compression dictionary for cache database: %s\n", cachedbfile);
   //purge cache if needed
   if (cachedbfile && info.cachedb)
     downloadcachedb_purge(info.cachedb);
@@ -658,9 +848,7 @@ int main (int argc, char** argv, char *envp[])
 TO DO:
   - don't follow links to URLs like:
       https://www.linkedin.com/company/
-  - cache download errors
   - test happens what if the network connection is interrupted or unavailable?
-  - use blobs for cached page content
 */
 
 /*
@@ -5,25 +5,44 @@
 #include <unistd.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <stdarg.h>
 #include <archive.h>
 #include <archive_entry.h>
 #include <expat.h>
 #include <miniargv.h>
+#include <dirtrav.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <versioncmp.h>
 #include "filesystem.h"
 #include "memory_buffer.h"
 #include "sorted_unique_list.h"
 //#include "text_buffer.h"
 //#include "text_list.h"
 #include "pkgdb.h"
+#include "pkgrepo.h"
+#include "sha256.h"
+#include "filestore.h"
+#include "pkgarchive.h"
+#include "build-order.h"
+#include "pkgfile.h"
+#include "exclusive_lock_file.h"
 
 #define PROGRAM_NAME    "wl-install"
 #define PROGRAM_DESC    "Command line utility to install a package"
 
 #if defined(_WIN32) && !defined(__MINGW64_VERSION_MAJOR)
 #define strcasecmp _stricmp
+#define strncasecmp _strnicmp
 #endif
-#define ARCHIVE_READ_BLOCK_SIZE 4096
+#define ARCHIVE_READ_BLOCK_SIZE (64 * 1024)
+#define EXTRACT_WRITE_BUFFER_SIZE (256 * 1024)
+#define DEFAULT_THREADS 4
+
+#define STRINGIZE_(value) #value
+#define STRINGIZE(value) STRINGIZE_(value)
 
 ////////////////////////////////////////////////////////////////////////
 
@@ -153,6 +172,8 @@ void xml_element_start_exclude (void *callbackdata, const XML_Char *name, const
 void xml_element_end_exclude (void *callbackdata, const XML_Char *name);
 void xml_element_start_dependencies (void *callbackdata, const XML_Char *name, const XML_Char **atts);
 void xml_element_end_dependencies (void *callbackdata, const XML_Char *name);
+void xml_element_start_files (void *callbackdata, const XML_Char *name, const XML_Char **atts);
+void xml_element_end_files (void *callbackdata, const XML_Char *name);
 
 void xml_element_start_root (void *callbackdata, const XML_Char *name, const XML_Char **atts)
 {
@@ -183,6 +204,9 @@ void xml_element_start_package (void *callbackdata, const XML_Char *name, const
   } else
   if (XML_Char_icmp_ins(name, X("dependencies")) == 0) {
     XML_SetElementHandler(data->xmlparser, xml_element_start_dependencies, xml_element_end_dependencies);
+  } else
+  if (XML_Char_icmp_ins(name, X("files")) == 0) {
+    XML_SetElementHandler(data->xmlparser, xml_element_start_files, xml_element_end_files);
   }
 }
 
@@ -245,34 +269,38 @@ void xml_element_end_dependencies (void *callbackdata, const XML_Char *name)
   }
 }
 
-////////////////////////////////////////////////////////////////////////
-
-int list_remove_entry (const char* data, void* callbackdata)
+void xml_element_start_files (void *callbackdata, const XML_Char *name, const XML_Char **atts)
 {
-  sorted_unique_list_remove((sorted_unique_list*)callbackdata, data);
-  return 0;
+  struct xml_data_struct* data = (struct xml_data_struct*)callbackdata;
+  if (XML_Char_icmp_ins(name, X("file")) == 0) {
+    const char* name;
+    const char* sha256;
+    const char* size;
+    if ((name = get_expat_attr_by_name(atts, "name")) != NULL && (sha256 = get_expat_attr_by_name(atts, "sha256")) != NULL && (size = get_expat_attr_by_name(atts, "size")) != NULL) {
+      package_metadata_set_file_info(data->metadata, name, sha256, strtoull(size, NULL, 10));
+    }
+  }
 }
 
-int filelist_delete_file (const char* data, void* callbackdata)
+void xml_element_end_files (void *callbackdata, const XML_Char *name)
 {
-  size_t dirlen;
-  char* path;
-  dirlen = strlen((char*)callbackdata);
-  if ((path = (char*)malloc(dirlen + strlen(data) + 2)) != NULL) {
-    memcpy(path, callbackdata, dirlen);
-    path[dirlen] = PATH_SEPARATOR;
-    strcpy(path + dirlen + 1, data);
-    if (unlink(path) != 0)
-      fprintf(stderr, "Error deleting file: %s\n", path);
-    free(path);
+  if (XML_Char_icmp_ins(name, X("files")) == 0) {
+    struct xml_data_struct* data = (struct xml_data_struct*)callbackdata;
+    XML_SetElementHandler(data->xmlparser, xml_element_start_package, xml_element_end_package);
   }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+int list_remove_entry (const char* data, void* callbackdata)
+{
+  sorted_unique_list_remove((sorted_unique_list*)callbackdata, data);
   return 0;
 }
 
-int filelist_delete_file_verbose (const char* data, void* callbackdata)
+int list_add_entry (const char* data, void* callbackdata)
 {
-  printf("Deleting: %s\n", data);
-  return filelist_delete_file(data, callbackdata);
+  sorted_unique_list_add((sorted_unique_list*)callbackdata, data);
   return 0;
 }
 
@@ -334,105 +362,709 @@ char* strdup_slashed (const char* path)
 
 ////////////////////////////////////////////////////////////////////////
 
-int read_metadata (const char* packagefilename, struct package_metadata_struct* metadata)
+//extract the data of the current archive entry to a file (uses the decompressor's own blocks to avoid copying) and optionally calculate the SHA-256 hash of the data written
+int extract_entry_to_file (struct archive* pkg, const char* path, int64_t size, char* sha256hex)
 {
-  //get metadata from package file
+  FILE* dst;
+  const void* buf;
+  size_t len;
+  la_int64_t offset;
+  la_int64_t pos = 0;
+  int status;
+  int result = 0;
+  struct sha256_context sha256ctx;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  static const char zeros[4096] = {0};
+  if ((dst = fopen(path, "wb")) == NULL) {
+    fprintf(stderr, "Error creating file: %s\n", path);
+    return 1;
+  }
+  //use a large output buffer
+  setvbuf(dst, NULL, _IOFBF, EXTRACT_WRITE_BUFFER_SIZE);
+#ifdef __linux__
+  //preallocate space and indicate data will be written sequentially
+  if (size > 0)
+    posix_fallocate(fileno(dst), 0, size);
+  posix_fadvise(fileno(dst), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  if (sha256hex)
+    sha256_init(&sha256ctx);
+  while ((status = archive_read_data_block(pkg, &buf, &len, &offset)) == ARCHIVE_OK || status == ARCHIVE_WARN) {
+    //fill gaps with zeros (sparse entries)
+    while (pos < offset) {
+      size_t n = ((size_t)(offset - pos) < sizeof(zeros) ? (size_t)(offset - pos) : sizeof(zeros));
+      if (fwrite(zeros, 1, n, dst) < n) {
+        result = 1;
+        break;
+      }
+      if (sha256hex)
+        sha256_update(&sha256ctx, zeros, n);
+      pos += n;
+    }
+    if (result || fwrite(buf, 1, len, dst) < len) {
+      fprintf(stderr, "Error writing to file: %s\n", path);
+      result = 1;
+      break;
+    }
+    if (sha256hex)
+      sha256_update(&sha256ctx, buf, len);
+    pos += len;
+  }
+  if (!result && status != ARCHIVE_EOF) {
+    fprintf(stderr, "Error reading from package: %s\n", path);
+    result = 2;
+  }
+  if (fclose(dst) != 0 && !result) {
+    fprintf(stderr, "Error writing to file: %s\n", path);
+    result = 1;
+  }
+  if (sha256hex) {
+    sha256_final(&sha256ctx, digest);
+    sha256_digest_to_hex(digest, sha256hex);
+  }
+  return result;
+}
+
+//parse metadata from current archive entry
+void read_metadata_entry (struct archive* pkg, struct package_metadata_struct* metadata)
+{
+  const void* buf;
+  size_t len;
+  la_int64_t offset;
+  struct xml_data_struct xmldata;
+  initialize_xml_data(&xmldata, metadata);
+  XML_SetElementHandler(xmldata.xmlparser, xml_element_start_root, xml_element_end_root);
+  while (archive_read_data_block(pkg, &buf, &len, &offset) == ARCHIVE_OK) {
+    XML_Parse(xmldata.xmlparser, (const char*)buf, len, 0);
+  }
+  XML_Parse(xmldata.xmlparser, NULL, 0, 1);
+  cleanup_xml_data(&xmldata);
+}
+
+//read only the metadata from a package file (stops reading after the metadata entry)
+int read_package_metadata (const char* packagefilename, struct package_metadata_struct* metadata)
+{
+  int result = 5;
   struct archive* pkg = archive_read_new();
-  //archive_read_support_filter_all(pkg);
-  //archive_read_support_format_all(pkg);
-  archive_read_support_format_7zip(pkg);
+  package_archive_read_setup(pkg);
+  if (archive_read_open_filename(pkg, packagefilename, ARCHIVE_READ_BLOCK_SIZE) != ARCHIVE_OK) {
+    result = 4;
+  } else {
+    struct archive_entry* pkgentry;
+    while (result && archive_read_next_header(pkg, &pkgentry) == ARCHIVE_OK) {
+      if (strcasecmp(archive_entry_pathname(pkgentry), PACKAGE_INFO_METADATA_FILE) == 0) {
+        read_metadata_entry(pkg, metadata);
+        result = 0;
+      }
+    }
+    archive_read_close(pkg);
+  }
+#if ARCHIVE_VERSION_NUMBER < 3000000
+  archive_read_finish(pkg);
+#else
+  archive_read_free(pkg);
+#endif
+  return result;
+}
+
+//check if installed file is identical to the one in the package (same hash in package metadata and in package database, same size on disk and either the modification time recorded at install time or the same hash on disk), on success mtime is set to the modification time on disk
+int is_installed_file_unchanged (const char* basepath, const struct package_metadata_struct* installedmetadata, const struct package_metadata_struct* metadata, const char* path, int64_t* mtime)
+{
+  int result = 0;
+  struct stat statbuf;
+  const struct package_file_info_struct* fileinfo;
+  const struct package_file_info_struct* installedfileinfo;
+  struct memory_buffer* fullpath;
+  char sha256hex[SHA256_HEX_SIZE];
+  if ((fileinfo = package_metadata_get_file_info(metadata, path)) == NULL || (installedfileinfo = package_metadata_get_file_info(installedmetadata, path)) == NULL)
+    return 0;
+  if (fileinfo->size != installedfileinfo->size || strcmp(fileinfo->sha256, installedfileinfo->sha256) != 0)
+    return 0;
+  fullpath = memory_buffer_create();
+  memory_buffer_set_printf(fullpath, "%s%c%s", basepath, PATH_SEPARATOR, path);
+  if (stat(memory_buffer_get(fullpath), &statbuf) == 0 && S_ISREG(statbuf.st_mode) && (uint64_t)statbuf.st_size == fileinfo->size) {
+    //the file may have been modified without changing its size, so hash it unless it still has the modification time recorded at install time
+    if ((installedfileinfo->mtime != 0 && (int64_t)statbuf.st_mtime == installedfileinfo->mtime) || (sha256_file(memory_buffer_get(fullpath), sha256hex) == 0 && strcasecmp(sha256hex, fileinfo->sha256) == 0)) {
+      *mtime = statbuf.st_mtime;
+      result = 1;
+    }
+  }
+  memory_buffer_free(fullpath);
+  return result;
+}
+
+//read package file in a single pass: parse metadata and extract files to the staging folder (if db is set files that are unchanged compared to the installed version are not extracted, if storepath is set files are taken from or added to the file store)
+int read_package (const char* packagefilename, struct package_metadata_struct* metadata, const char* stagingpath, pkgdb_handle db, pthread_mutex_t* dblock, const char* basepath, const char* storepath, int verbose, int showprogress)
+{
+  int result = 0;
+  struct package_metadata_struct* installedmetadata = NULL;
+  uint64_t packagesize = 0;
+  struct stat statbuf;
+  if (stat(packagefilename, &statbuf) == 0)
+    packagesize = statbuf.st_size;
+  //open package file
+  struct archive* pkg = archive_read_new();
+  package_archive_read_setup(pkg);
   if (archive_read_open_filename(pkg, packagefilename, ARCHIVE_READ_BLOCK_SIZE) != ARCHIVE_OK) {
     fprintf(stderr, "Error opening package file: %s\n", packagefilename);
-    return 4;
+    result = 4;
   } else {
     struct archive_entry* pkgentry;
     char* pathname;
-    while (archive_read_next_header(pkg, &pkgentry) == ARCHIVE_OK) {
+    char* p;
+    int metadatafound = 0;
+    char sha256hex[SHA256_HEX_SIZE];
+    int64_t mtime;
+    const struct package_file_info_struct* fileinfo;
+    struct memory_buffer* dstpath = memory_buffer_create();
+    while (!result && archive_read_next_header(pkg, &pkgentry) == ARCHIVE_OK) {
       if ((pathname = strdup_slashed(archive_entry_pathname(pkgentry))) != NULL) {
         if (strcasecmp(archive_entry_pathname(pkgentry), PACKAGE_INFO_METADATA_FILE) == 0) {
           //get metadata
-          char buf[256];
-          ssize_t len;
-          struct xml_data_struct xmldata;
-          initialize_xml_data(&xmldata, metadata);
-          XML_SetElementHandler(xmldata.xmlparser, xml_element_start_root, xml_element_end_root);
-/*
-const void *buff;
-size_t size;
-la_int64_t offset;
-len = archive_read_data_block(pkg, &buff, &size, &offset);
-*/
-          while ((len = archive_read_data(pkg, buf, sizeof(buf))) > 0) {
-            XML_Parse(xmldata.xmlparser, buf, len, 0);
-          }
-          XML_Parse(xmldata.xmlparser, NULL, 0, 1);
-          cleanup_xml_data(&xmldata);
+          read_metadata_entry(pkg, metadata);
+          metadatafound = 1;
           free(pathname);
-        } else if (archive_entry_filetype(pkgentry) & AE_IFREG) {
-          //add file path to list
-          sorted_unique_list_add_allocated(metadata->filelist, pathname);
+          //get information about installed version (used to skip unchanged files)
+          if (db && metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME] && !installedmetadata) {
+            if (dblock)
+              pthread_mutex_lock(dblock);
+            installedmetadata = pkgdb_read_package(db, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
+            if (dblock)
+              pthread_mutex_unlock(dblock);
+          }
+        } else if (archive_entry_filetype(pkgentry) == AE_IFREG) {
           //update total size to extract
           metadata->totalsize += archive_entry_size(pkgentry);
-          /*archive_read_data_skip(pkg);*/
-        } else if (archive_entry_filetype(pkgentry) & AE_IFDIR) {
+          //skip files that are excluded (metadata is normally the first entry in the package)
+          if (metadatafound && is_file_excluded(metadata, pathname)) {
+            free(pathname);
+          } else if (installedmetadata && is_installed_file_unchanged(basepath, installedmetadata, metadata, pathname, &mtime)) {
+            //skip files that are identical to the installed version
+            if (verbose)
+              printf("Unchanged: %s\n", pathname);
+            archive_read_data_skip(pkg);
+            package_metadata_set_file_mtime(metadata, pathname, mtime);
+            sorted_unique_list_add_allocated(metadata->filelist, pathname);
+          } else {
+            //show progress
+            if (showprogress && !verbose && packagesize)
+              printf("\r%3i%%", (int)(archive_filter_bytes(pkg, -1) * 100 / packagesize));
+            //determine path in staging folder
+            if ((p = strrchr(pathname, PATH_SEPARATOR)) != NULL)
+              recursive_mkdir(memory_buffer_get(memory_buffer_set_printf(dstpath, "%s%c%.*s", stagingpath, PATH_SEPARATOR, (int)(p - pathname), pathname)));
+            memory_buffer_set_printf(dstpath, "%s%c%s", stagingpath, PATH_SEPARATOR, pathname);
+            if (storepath && (fileinfo = package_metadata_get_file_info(metadata, pathname)) != NULL && filestore_get_file(storepath, fileinfo->sha256, archive_entry_size(pkgentry), memory_buffer_get(dstpath)) == 0) {
+              //take file from the file store instead of extracting it
+              if (verbose)
+                printf("From store: %s\n", pathname);
+              archive_read_data_skip(pkg);
+            } else {
+              if (verbose)
+                printf("Extracting: %s\n", pathname);
+              //extract and keep hash and size of the data written (so the package database always has a complete manifest)
+              if (extract_entry_to_file(pkg, memory_buffer_get(dstpath), archive_entry_size(pkgentry), sha256hex) != 0) {
+                result = 6;
+              } else {
+                package_metadata_set_file_info(metadata, pathname, sha256hex, archive_entry_size(pkgentry));
+                //add extracted file to the file store
+                if (storepath && filestore_add_file(storepath, sha256hex, memory_buffer_get(dstpath)) != 0)
+                  fprintf(stderr, "Error adding file to file store: %s\n", pathname);
+              }
+            }
+            //keep modification time to detect changes to the installed file later (moving the file in place does not change it)
+            if (!result && stat(memory_buffer_get(dstpath), &statbuf) == 0)
+              package_metadata_set_file_mtime(metadata, pathname, statbuf.st_mtime);
+            //add file path to list
+            sorted_unique_list_add_allocated(metadata->filelist, pathname);
+          }
+        } else if (archive_entry_filetype(pkgentry) == AE_IFDIR) {
           //add folder path to list
           sorted_unique_list_add_allocated(metadata->folderlist, pathname);
-/*
-          //remove trailing path separator(s)
-          char* path = (*folderlistlast)->text;
-          size_t pathlen = strlen(path);
-          while (pathlen > 0 && (path[pathlen - 1] == '/'
-#ifdef _WIN32
-            || path[pathlen - 1] == '\\'
-#endif
-          ))
-            path[--pathlen] = 0;
-*/
-          /*archive_read_data_skip(pkg);*/
         } else {
           //unhandled file type
-          /*archive_read_data_skip(pkg);*/
           free(pathname);
         }
       }
     }
     archive_read_close(pkg);
-    //remove listed exlusions from the file list
-    //sorted_unique_list_compare_lists(metadata->fileexclusions, metadata->filelist, list_remove_entry, NULL, NULL, &(metadata->filelist));
+    //remove listed exlusions from the file list (needed in case metadata was not the first entry in the package)
     {
-      int i;
-      int n;
+      size_t i;
       const char* s;
-      n = sorted_unique_list_size(metadata->filelist);
-      for (i = 0; i < n; i++) {
-        if ((s = sorted_unique_list_get(metadata->filelist, i)) != NULL) {
-          if (is_file_excluded(metadata, s)) {
-            sorted_unique_list_remove(metadata->filelist, s);
-          }
+      i = 0;
+      while ((s = sorted_unique_list_get(metadata->filelist, i)) != NULL) {
+        if (is_file_excluded(metadata, s)) {
+          unlink(memory_buffer_get(memory_buffer_set_printf(dstpath, "%s%c%s", stagingpath, PATH_SEPARATOR, s)));
+          sorted_unique_list_remove(metadata->filelist, s);
+        } else {
+          i++;
         }
       }
     }
-    sorted_unique_list_compare_lists(metadata->folderexclusions, metadata->folderlist, list_remove_entry, NULL, NULL, &(metadata->folderlist));
     //remove listed exlusions from the folder list
     {
-      int i;
-      int n;
+      size_t i;
       const char* s;
-      n = sorted_unique_list_size(metadata->folderlist);
-      for (i = 0; i < n; i++) {
-        if ((s = sorted_unique_list_get(metadata->folderlist, i)) != NULL) {
-          if (is_file_excluded(metadata, s)) {
-            sorted_unique_list_remove(metadata->folderlist, s);
-          }
+      i = 0;
+      while ((s = sorted_unique_list_get(metadata->folderlist, i)) != NULL) {
+        if (is_directory_excluded(metadata, s)) {
+          sorted_unique_list_remove(metadata->folderlist, s);
+        } else {
+          i++;
         }
       }
     }
+    memory_buffer_free(dstpath);
   }
 #if ARCHIVE_VERSION_NUMBER < 3000000
-  archive_write_finish(pkg);
+  archive_read_finish(pkg);
 #else
-  archive_write_free(pkg);
+  archive_read_free(pkg);
 #endif
+  package_metadata_free(installedmetadata);
+  return result;
+}
+
+//move extracted file from staging folder to installation folder
+int move_staged_file (const char* srcpath, const char* dstpath)
+{
+  if (rename(srcpath, dstpath) != 0) {
+    //try to delete first and then move again
+    delete_file(dstpath);
+    if (rename(srcpath, dstpath) != 0) {
+      fprintf(stderr, "Error creating file: %s\n", dstpath);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+struct install_staged_files_struct {
+  const char* basepath;
+  const char* stagingpath;
+  struct memory_buffer* srcpath;
+  struct memory_buffer* dstpath;
+  int verbose;
+  int errors;
+};
+
+int install_staged_folder_callback (pkgdb_handle handle, const char* path, void* callbackdata)
+{
+  struct install_staged_files_struct* data = (struct install_staged_files_struct*)callbackdata;
+  recursive_mkdir(memory_buffer_get(memory_buffer_set_printf(data->dstpath, "%s%c%s", data->basepath, PATH_SEPARATOR, path)));
+  return 0;
+}
+
+int install_staged_file_callback (pkgdb_handle handle, const char* path, void* callbackdata)
+{
+  struct install_staged_files_struct* data = (struct install_staged_files_struct*)callbackdata;
+  memory_buffer_set_printf(data->srcpath, "%s%c%s", data->stagingpath, PATH_SEPARATOR, path);
+  //skip files that were already moved in place or that were not extracted because they didn't change
+  if (!file_exists(memory_buffer_get(data->srcpath)))
+    return 0;
+  memory_buffer_set_printf(data->dstpath, "%s%c%s", data->basepath, PATH_SEPARATOR, path);
+  if (move_staged_file(memory_buffer_get(data->srcpath), memory_buffer_get(data->dstpath)) != 0)
+    data->errors++;
+  return 0;
+}
+
+int delete_stale_file_callback (pkgdb_handle handle, const char* path, void* callbackdata)
+{
+  struct install_staged_files_struct* data = (struct install_staged_files_struct*)callbackdata;
+  memory_buffer_set_printf(data->dstpath, "%s%c%s", data->basepath, PATH_SEPARATOR, path);
+  //skip files that were already deleted
+  if (!file_exists(memory_buffer_get(data->dstpath)))
+    return 0;
+  if (data->verbose)
+    printf("Deleting: %s\n", path);
+  if (delete_file(memory_buffer_get(data->dstpath)) < 0) {
+    fprintf(stderr, "Error deleting file: %s\n", memory_buffer_get(data->dstpath));
+    data->errors++;
+  }
+  return 0;
+}
+
+//complete a committed installation by moving staged files in place and deleting stale files (can safely be repeated after an interruption)
+int install_staged_files (pkgdb_handle db, const char* basepath, const char* staging, const char* package, int verbose)
+{
+  struct install_staged_files_struct data;
+  char* stagingpath = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%s%c%s", basepath, PACKAGE_STAGING_PATH, PATH_SEPARATOR, staging));
+  data.basepath = basepath;
+  data.stagingpath = stagingpath;
+  data.srcpath = memory_buffer_create();
+  data.dstpath = memory_buffer_create();
+  data.verbose = verbose;
+  data.errors = 0;
+  //create folder structure
+  pkgdb_interate_package_folders(db, package, install_staged_folder_callback, &data);
+  //move extracted files from staging folder in place
+  if (pkgdb_interate_package_files(db, package, install_staged_file_callback, &data) != 0)
+    data.errors++;
+  //delete files that are no longer used
+  if (pkgdb_journal_iterate_stale_files(db, staging, delete_stale_file_callback, &data) != 0)
+    data.errors++;
+  //remove staging folder and journal entry if all went well
+  if (!data.errors) {
+    if (folder_exists(stagingpath) && dirtrav_recursive_delete(stagingpath) != 0)
+      fprintf(stderr, "Error deleting staging folder: %s\n", stagingpath);
+    if (pkgdb_journal_end(db, staging) != 0) {
+      fprintf(stderr, "Error removing journal entry for staging folder: %s\n", staging);
+      data.errors++;
+    }
+  }
+  memory_buffer_free(data.srcpath);
+  memory_buffer_free(data.dstpath);
+  free(stagingpath);
+  return data.errors;
+}
+
+//discard an installation that was not committed by deleting its staging folder (returns non-zero if the journal entry could not be removed)
+int discard_staged_files (pkgdb_handle db, const char* basepath, const char* staging)
+{
+  int result = 0;
+  char* stagingpath = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%s%c%s", basepath, PACKAGE_STAGING_PATH, PATH_SEPARATOR, staging));
+  if (folder_exists(stagingpath) && dirtrav_recursive_delete(stagingpath) != 0)
+    fprintf(stderr, "Error deleting staging folder: %s\n", stagingpath);
+  if (pkgdb_journal_end(db, staging) != 0) {
+    fprintf(stderr, "Error removing journal entry for staging folder: %s\n", staging);
+    result = 1;
+  }
+  free(stagingpath);
+  return result;
+}
+
+//roll forward or roll back installations that were interrupted
+int recover_interrupted_installations (pkgdb_handle db, const char* basepath, int verbose)
+{
+  char* staging;
+  char* package;
+  int state;
+  int result = 0;
+  while (!result && (staging = pkgdb_journal_get_pending(db, &package, &state)) != NULL) {
+    if (state == PKGDB_JOURNAL_STATE_COMMITTED && package) {
+      printf("Completing interrupted installation of %s\n", package);
+      if (install_staged_files(db, basepath, staging, package, verbose) != 0) {
+        fprintf(stderr, "Error completing interrupted installation of %s\n", package);
+        result = 1;
+      }
+    } else {
+      if (verbose)
+        printf("Discarding interrupted installation in staging folder: %s\n", staging);
+      if (discard_staged_files(db, basepath, staging) != 0)
+        result = 1;
+    }
+    free(package);
+    free(staging);
+  }
+  return result;
+}
+
+//check if package file exists as specified or in the package directory (returns allocated string or NULL if not found)
+static char* find_package_file_in_pkgdir (const char* name, const char* pkgdir)
+{
+  char* path;
+  size_t pkgdirlen;
+  if (file_exists(name))
+    return strdup(name);
+  if (!*pkgdir)
+    return NULL;
+  pkgdirlen = strlen(pkgdir);
+  if (pkgdir[pkgdirlen - 1] == '/'
+#ifdef _WIN32
+    || pkgdir[pkgdirlen - 1] == '\\' || pkgdir[pkgdirlen - 1] == ':'
+#endif
+    )
+    path = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%s", pkgdir, name));
+  else
+    path = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%c%s", pkgdir, PATH_SEPARATOR, name));
+  if (path && !file_exists(path)) {
+    free(path);
+    path = NULL;
+  }
+  return path;
+}
+
+//find package file, adding extension (any supported package file format), architecture and package directory if needed (returns allocated string or NULL if not found)
+char* find_package_file (const char* name, const char* pkgdir, const char* arch)
+{
+  size_t i;
+  size_t namelen;
+  size_t extlen;
+  size_t baselen;
+  size_t archlen;
+  char* candidate;
+  char* packagefilename = NULL;
+  const struct package_archive_format_struct* format;
+  if (file_exists(name))
+    return strdup(name);
+  //split name in base name, architecture and extension
+  namelen = strlen(name);
+  extlen = package_archive_extension_length(name);
+  baselen = namelen - extlen;
+  archlen = (arch ? strlen(arch) : 0);
+  if (archlen > 0 && baselen > archlen && name[baselen - archlen - 1] == '.' && strncasecmp(name + baselen - archlen, arch, archlen) == 0)
+    baselen -= archlen + 1;
+  //try the specified extension or each supported extension
+  for (i = 0; !packagefilename && (format = package_archive_get_format_by_index(i)) != NULL; i++) {
+    if (extlen > 0 && strcasecmp(name + namelen - extlen, format->extension) != 0)
+      continue;
+    if ((candidate = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%.*s%s%s%s", (int)baselen, name, (archlen > 0 ? "." : ""), (archlen > 0 ? arch : ""), format->extension))) != NULL) {
+      packagefilename = find_package_file_in_pkgdir(candidate, pkgdir);
+      free(candidate);
+    }
+  }
+  if (!packagefilename)
+    fprintf(stderr, "Package file not found: %s\n", name);
+  return packagefilename;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//get metadata of all packages for the specified architecture in the package directory (package file name is stored in extradata, only the latest version of each package is kept)
+sorted_unique_list* load_package_index (const char* pkgdir, const char* arch)
+{
+  DIR* dir;
+  struct dirent* dp;
+  size_t namelen;
+  char* path;
+  int status;
+  struct stat statbuf;
+  struct package_metadata_struct* pkginfo;
+  struct package_metadata_struct* existingpkginfo;
+  sorted_unique_list* index;
+  pkgrepo_handle repo = NULL;
+  size_t extlen;
+  size_t archlen = strlen(arch);
+  if ((dir = opendir(pkgdir)) == NULL)
+    return NULL;
+  index = sorted_unique_list_create(packageinfo_cmp_basename, (sorted_unique_free_fn)package_metadata_free);
+  //use repository index if available to avoid opening each package file
+  path = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%c%s", pkgdir, PATH_SEPARATOR, PACKAGE_REPOSITORY_INDEX_FILE));
+  if (file_exists(path))
+    repo = pkgrepo_open(pkgdir);
+  free(path);
+  while ((dp = readdir(dir)) != NULL) {
+    //only process package files (any supported format) for the specified architecture
+    namelen = strlen(dp->d_name);
+    extlen = package_archive_extension_length(dp->d_name);
+    if (extlen > 0 && namelen > extlen + archlen + 1 && dp->d_name[namelen - extlen - archlen - 1] == '.' && strncasecmp(dp->d_name + namelen - extlen - archlen, arch, archlen) == 0) {
+      path = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%c%s", pkgdir, PATH_SEPARATOR, dp->d_name));
+      //get metadata from repository index (only if package file wasn't changed after it was indexed) or from package file
+      status = 0;
+      pkginfo = NULL;
+      if (repo && stat(path, &statbuf) == 0)
+        pkginfo = pkgrepo_read_package(repo, dp->d_name, statbuf.st_size, statbuf.st_mtime, 0);
+      if (!pkginfo) {
+        pkginfo = package_metadata_create();
+        status = read_package_metadata(path, pkginfo);
+      }
+      if (status != 0 || !pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME] || !pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION]) {
+        fprintf(stderr, "Skipping package file without valid metadata: %s\n", path);
+        package_metadata_free(pkginfo);
+        free(path);
+        continue;
+      }
+      pkginfo->extradata = path;
+      pkginfo->extradata_free_fn = free;
+      //only keep the latest version
+      if ((existingpkginfo = (struct package_metadata_struct*)sorted_unique_list_search(index, (char*)pkginfo)) != NULL) {
+        if (versioncmp(existingpkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION]) >= 0) {
+          package_metadata_free(pkginfo);
+          continue;
+        }
+        sorted_unique_list_remove(index, (char*)existingpkginfo);
+      }
+      sorted_unique_list_add_allocated(index, (char*)pkginfo);
+    }
+  }
+  closedir(dir);
+  pkgrepo_close(repo);
+  return index;
+}
+
+struct add_dependencies_struct {
+  pkgdb_handle db;
+  sorted_unique_list* index;
+  sorted_unique_list* visited;
+  sorted_unique_list* packagefiles;
+  int missing;
+};
+
+//add package to list of package files to install (if not installed yet) and recurse into its dependencies
+int add_dependency_to_install (const char* basename, void* callbackdata)
+{
+  struct add_dependencies_struct* data = (struct add_dependencies_struct*)callbackdata;
+  struct package_metadata_struct searchpkginfo;
+  struct package_metadata_struct* pkginfo;
+  //skip if already processed or if already installed
+  if (sorted_unique_list_find(data->visited, basename))
+    return 0;
+  sorted_unique_list_add(data->visited, basename);
+  if (pkgdb_package_is_installed(data->db, basename))
+    return 0;
+  //find package in package directory
+  searchpkginfo.datafield[PACKAGE_METADATA_INDEX_BASENAME] = (char*)basename;
+  if ((pkginfo = (struct package_metadata_struct*)sorted_unique_list_search(data->index, (char*)&searchpkginfo)) == NULL) {
+    fprintf(stderr, "Dependency not found in package directory: %s\n", basename);
+    data->missing++;
+    return 0;
+  }
+  sorted_unique_list_add(data->packagefiles, (char*)pkginfo->extradata);
+  //recurse for each dependency
+  iterate_packages_in_list(pkginfo->dependencies, add_dependency_to_install, data);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+struct install_job_struct {
+  struct package_info_extradata_struct xtra;  //used by generate_build_list(), must be first member
+  char* packagefilename;
+  char* stagingpath;
+  char staging[32];
+  struct package_metadata_struct* metadata;
+  int status;
+  int done;
+};
+
+struct extract_queue_struct {
+  struct install_job_struct* jobs;
+  size_t jobcount;
+  size_t nextjob;
+  pthread_mutex_t lock;
+  pkgdb_handle db;
+  pthread_mutex_t dblock;
+  const char* basepath;
+  const char* storepath;
+  int verbose;
+  int showprogress;
+};
+
+//extract package file to staging folder and get metadata in a single pass
+void extract_job (struct install_job_struct* job, pkgdb_handle db, pthread_mutex_t* dblock, const char* basepath, const char* storepath, int verbose, int showprogress)
+{
+  job->metadata = package_metadata_create();
+  if ((job->status = read_package(job->packagefilename, job->metadata, job->stagingpath, db, dblock, basepath, storepath, verbose, showprogress)) != 0) {
+    if (job->status == 4)
+      fprintf(stderr, "\rError opening package file: %s\n", job->packagefilename);
+    else
+      fprintf(stderr, "\rError extracting package file: %s\n", job->packagefilename);
+  } else if (!job->metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME] || !job->metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME][0]) {
+    //check if metadata was present
+    fprintf(stderr, "\rError: metadata missing in package file (basename not set): %s\n", job->packagefilename);
+    job->status = 5;
+  }
+}
+
+void* extract_thread (struct extract_queue_struct* queue)
+{
+  size_t index;
+  while (1) {
+    //take next package from the queue
+    pthread_mutex_lock(&queue->lock);
+    index = queue->nextjob++;
+    pthread_mutex_unlock(&queue->lock);
+    if (index >= queue->jobcount)
+      break;
+    extract_job(&queue->jobs[index], queue->db, &queue->dblock, queue->basepath, queue->storepath, queue->verbose, queue->showprogress);
+  }
+  return NULL;
+}
+
+//register extracted package in package database and move files in place
+int install_job (pkgdb_handle db, const char* basepath, struct install_job_struct* job, int showdiff, int exportinfo, int verbose)
+{
+  int abort = 0;
+  struct package_metadata_struct* metadata = job->metadata;
+
+  //get information about already installed package from package database
+  char* installedversion = NULL;
+  sorted_unique_list* installedfilelist = NULL;
+  {
+    struct package_metadata_struct* installedmetadata;
+    if ((installedmetadata = pkgdb_read_package(db, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME])) != NULL) {
+      //take over version and list of installed files
+      installedversion = installedmetadata->datafield[PACKAGE_METADATA_INDEX_VERSION];
+      installedmetadata->datafield[PACKAGE_METADATA_INDEX_VERSION] = NULL;
+      installedfilelist = installedmetadata->filelist;
+      installedmetadata->filelist = NULL;
+      package_metadata_free(installedmetadata);
+    }
+    if (!installedfilelist)
+      installedfilelist = sorted_unique_list_create(strcmp, free);
+  }
+
+  //show information
+  if (installedversion)
+    printf("\rUpdating %s from version %s to %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], installedversion, metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+  else
+    printf("\rInstalling %s version %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+  if (verbose) {
+    printf("Destination: %s\n", basepath);
+  }
+
+  //compare contents of text lists
+  if (showdiff && installedversion)
+    sorted_unique_list_compare_lists(installedfilelist, metadata->filelist, NULL, filelist_show_old, filelist_show_new, NULL);
+
+  //determine files that are no longer used
+  sorted_unique_list* stalefilelist = sorted_unique_list_create(strcmp, free);
+  sorted_unique_list_compare_lists(installedfilelist, metadata->filelist, NULL, list_add_entry, NULL, stalefilelist);
+
+  //commit package information and journal state to package database in one transaction, from here on the installation will be completed even if interrupted
+  if (pkgdb_journal_commit_package(db, job->staging, metadata, stalefilelist) != 0) {
+    fprintf(stderr, "Error registering package in package database\n");
+    discard_staged_files(db, basepath, job->staging);
+    abort = 1;
+  }
+  sorted_unique_list_free(stalefilelist);
+
+  //move staged files in place and delete stale files
+  if (!abort) {
+    if (install_staged_files(db, basepath, job->staging, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], verbose) != 0)
+      abort = 2;
+  }
+
+  //remove stale package information files or export them from the package database if requested
+  if (!abort) {
+    if (exportinfo)
+      pkgdb_export_package_info_files(db, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
+    else
+      pkgdb_remove_package_info_files(db, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
+    //create folder with license file
+    /////TO DO
+  }
+
+  //show information
+  if (!abort) {
+    printf("\rFinished ");
+    if (!installedversion)
+      printf("installing %s %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+/*
+    if (strcmp(metadata->datafield[PACKAGE_METADATA_INDEX_VERSION], installedversion) == 0)
+      printf("reinstalling %s %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+*/
+    else
+      printf("updating %s %s (previous version: %s)\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION], installedversion);
+  } else if (abort == 2) {
+    fprintf(stderr, "Error installing %s %s, installation will be completed on next run\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+  } else {
+    fprintf(stderr, "Error installing %s %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
+  }
+
+  //clean up
+  free(installedversion);
+  sorted_unique_list_free(installedfilelist);
+  return abort;
+}
+
+int get_lock_progress (exclusive_lock_file handle, void* callbackdata)
+{
+  if ((*(int*)callbackdata)++ == 0) {
+    printf("Waiting for other process to finish installing...\n");
+  }
   return 0;
 }
 
@@ -440,16 +1072,30 @@ int main (int argc, char** argv, char *envp[])
 {
   //process command line parameters
   int i;
+  size_t j;
   char* p;
   int showversion = 0;
   int showhelp = 0;
   int showdiff = 0;
+  int exportinfo = 0;
   int verbose = 0;
   int abort = 0;
+  int numthreads = DEFAULT_THREADS;
+  int withdeps = 0;
+  int allfiles = 0;
+  pkgdb_handle db = NULL;
   char* arch = NULL;
   const char* basepath = NULL;
   const char* pkgdir = NULL;
-  char* packagefilename = NULL;
+  const char* storepath = NULL;
+  size_t jobcount = 0;
+  struct install_job_struct* jobs = NULL;
+  sorted_unique_list* packagefiles = NULL;
+  sorted_unique_list* sortedpackagelist = NULL;
+  struct package_info_list_struct* packageinstalllist;
+  exclusive_lock_file lock = NULL;
+  const char* errmsg;
+  struct add_dependencies_struct depsdata = {NULL, NULL, NULL, NULL, 0};
   //definition of command line arguments
   const miniargv_definition argdef[] = {
     {'h', "help",         NULL,      miniargv_cb_increment_int, &showhelp,        "show command line help", NULL},
@@ -458,13 +1104,19 @@ int main (int argc, char** argv, char *envp[])
     {'i', "install-path", "PATH",    miniargv_cb_set_const_str, &basepath,        "package installation path\noverrides environment variable MINGWPREFIX", NULL},
     {'a', "arch",         "ARCH",    miniargv_cb_strdup,        &arch,            "architecture (i686/x86_64, default based on $RUNPLATFORM)", NULL},
     {'d', "diff",         NULL,      miniargv_cb_increment_int, &showdiff,        "show difference with installed package (files added/removed)", NULL},
+    {'x', "export-info",  NULL,      miniargv_cb_increment_int, &exportinfo,      "also write package information files to " PACKAGE_INFO_PATH " (for use by legacy tools)", NULL},
+    {'w', "with-deps",    NULL,      miniargv_cb_increment_int, &withdeps,        "also install missing dependencies from the package directory", NULL},
+    {'f', "all-files",    NULL,      miniargv_cb_increment_int, &allfiles,        "also extract files that are identical to the installed version (e.g. to repair an installation)", NULL},
+    {'s', "store",        "PATH",    miniargv_cb_set_const_str, &storepath,       "path of file store used to share identical files between installations (files are cloned if supported by the file system, otherwise hard linked as read-only files)\noverrides environment variable PACKAGESTORE", NULL},
+    {'j', "threads",      "N",       miniargv_cb_set_int,       &numthreads,      "number of packages to extract simultaneously (default: " STRINGIZE(DEFAULT_THREADS) ")", NULL},
     {'v', "verbose",      NULL,      miniargv_cb_increment_int, &verbose,         "verbose mode", NULL},
-    {0,   NULL,           "PACKAGE", miniargv_cb_error,         NULL,             "package to install", NULL},
+    {0,   NULL,           "PACKAGE", miniargv_cb_error,         NULL,             "package(s) to install", NULL},
     MINIARGV_DEFINITION_END
   };
   //definition of environment variables
   const miniargv_definition envdef[] = {
     {0,   "PACKAGEDIR",   NULL,      miniargv_cb_set_const_str, &pkgdir,          "path where package files are stored", NULL},
+    {0,   "PACKAGESTORE", NULL,      miniargv_cb_set_const_str, &storepath,       "path of file store used to share identical files between installations", NULL},
     {0,   "MINGWPREFIX",  NULL,      miniargv_cb_set_const_str, &basepath,        "package installation path", NULL},
     {0,   "RUNPLATFORM",  NULL,      miniargv_cb_strdup,        &arch,            "target architecture (i686-w64-mingw32/x86_64-w64-mingw32)", NULL},
     MINIARGV_DEFINITION_END
@@ -517,16 +1169,10 @@ int main (int argc, char** argv, char *envp[])
     fprintf(stderr, "Path does not exist: %s\n", basepath);
     return 3;
   }
-  if ((i = miniargv_get_next_arg_param(0, argv, argdef, NULL)) <= 0) {
+  if (miniargv_get_next_arg_param(0, argv, argdef, NULL) <= 0) {
     fprintf(stderr, "Missing package name\n");
     return 4;
-  } else {
-    if (miniargv_get_next_arg_param(i, argv, argdef, NULL) > 0) {
-      fprintf(stderr, "Only one package name allowed (additional parameter: %s)\n", argv[i]);
-      return 5;
-    }
   }
-  packagefilename = strdup(argv[i]);
   if (!pkgdir || !*pkgdir) {
     fprintf(stderr, "Missing package directory\n");
     return 6;
@@ -551,55 +1197,8 @@ int main (int argc, char** argv, char *envp[])
   } else if ((p = strchr(arch, '-')) != NULL) {
     *p = 0;
   }
-  if (!packagefilename || !*packagefilename) {
-    fprintf(stderr, "Missing package name\n");
-    return 7;
-  }
-  if (!file_exists(packagefilename)) {
-    size_t packagefilenamelen = strlen(packagefilename);
-    //add extension if needed
-    if (!(packagefilenamelen >= 3 && strcasecmp(packagefilename + packagefilenamelen - 3, ".7z") == 0)) {
-      if ((packagefilename = (char*)realloc(packagefilename, packagefilenamelen + 3 + 1)) != NULL) {
-        strcpy(packagefilename + packagefilenamelen, ".7z");
-        packagefilenamelen += 3;
-      }
-    }
-    //add architecture if needed
-    if (arch && *arch) {
-      size_t archlen = strlen(arch);
-      if (!(packagefilenamelen >= 4 + archlen && packagefilename[packagefilenamelen - 4 - archlen] == '.' && strcasecmp(packagefilename + packagefilenamelen - 3 - archlen, arch) == 0)) {
-        if ((packagefilename = (char*)realloc(packagefilename, packagefilenamelen + archlen + 2)) != NULL) {
-          memmove(packagefilename + packagefilenamelen - 3 + 1 + archlen, packagefilename + packagefilenamelen - 3, 4);
-          packagefilename[packagefilenamelen - 3] = '.';
-          memcpy(packagefilename + packagefilenamelen - 2, arch, archlen);
-          packagefilenamelen += 1 + archlen;
-        }
-      }
-    }
-    if (!file_exists(packagefilename) && *pkgdir) {
-      size_t pkgdirlen = strlen(pkgdir);
-      size_t separatorlen = (pkgdir[pkgdirlen - 1] == '/'
-#ifdef _WIN32
-        || pkgdir[pkgdirlen - 1] == '\\' || pkgdir[pkgdirlen - 1] == ':'
-#endif
-        ? 0 : 1);
-      if ((packagefilename = (char*)realloc(packagefilename, pkgdirlen + separatorlen + packagefilenamelen + 1)) != NULL) {
-        memmove(packagefilename + pkgdirlen + separatorlen, packagefilename, packagefilenamelen + 1);
-        memcpy(packagefilename, pkgdir, pkgdirlen);
-        if (separatorlen)
-          packagefilename[pkgdirlen] =
-#ifdef _WIN32
-            '\\';
-#else
-            '/';
-#endif
-      }
-    }
-    if (!file_exists(packagefilename)) {
-      fprintf(stderr, "Package file not found: %s\n", packagefilename);
-      return 3;
-    }
-  }
+  if (storepath && !*storepath)
+    storepath = NULL;
   //show verbose information
 /*
   if (verbose) {
@@ -609,229 +1208,221 @@ int main (int argc, char** argv, char *envp[])
   }
 */
 
-  //get metadata from package file
-  struct package_metadata_struct* metadata = package_metadata_create();
-  if (read_metadata(packagefilename, metadata) != 0) {
-    fprintf(stderr, "Error opening package file: %s\n", packagefilename);
-    return 4;
+  //open package database
+  if ((db = pkgdb_open(basepath)) == NULL) {
+    fprintf(stderr, "Error opening package database in: %s\n", basepath);
+    abort = 3;
+    goto cleanup;
   }
-  //check if metadata was present
-  if (!metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME] || !metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME][0]) {
-    fprintf(stderr, "Error: metadata missing in package file (basename not set)\n");
-    return 5;
+
+  //get metadata of packages in package directory if dependencies should be installed
+  if (withdeps) {
+    if ((depsdata.index = load_package_index(pkgdir, arch)) == NULL) {
+      fprintf(stderr, "Error reading package directory: %s\n", pkgdir);
+      abort = 6;
+      goto cleanup;
+    }
+    depsdata.db = db;
+    depsdata.visited = sorted_unique_list_create(strcmp, free);
+    depsdata.packagefiles = sorted_unique_list_create(strcmp, free);
+    depsdata.missing = 0;
   }
-  //make sure totalsize is not zero (to avoid division by zero in the progress indicator)
-  if (metadata->totalsize == 0)
-    metadata->totalsize++;
 
-  //get information about already installed package
-  char* installedversion = NULL;
-  sorted_unique_list* installedfilelist = sorted_unique_list_create(strcmp, free);
-  {
-    sorted_unique_list* v = sorted_unique_list_create(strcmp, free);
-    struct memory_buffer* pkginfopath = memory_buffer_create();
-    struct memory_buffer* filepath = memory_buffer_create();
-    //determine package information path
-    memory_buffer_set_printf(pkginfopath, "%s%s%c%s%c", basepath, PACKAGE_INFO_PATH, PATH_SEPARATOR, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], PATH_SEPARATOR);
-    //load version installed package
-    sorted_unique_list_load_from_file(&v, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_VERSION_FILE)));
-    installedversion = sorted_unique_list_get_and_remove_first(v);
-    sorted_unique_list_free(v);
-    //load list of installed files
-    sorted_unique_list_load_from_file(&installedfilelist, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_CONTENT_FILE)));
-    //clean up
-    memory_buffer_free(pkginfopath);
-    memory_buffer_free(filepath);
+  //find package files
+  packagefiles = sorted_unique_list_create(strcmp, free);
+  i = 0;
+  while ((i = miniargv_get_next_arg_param(i, argv, argdef, NULL)) > 0) {
+    char* packagefilename = NULL;
+    if (!*argv[i]) {
+      fprintf(stderr, "Missing package name\n");
+      abort = 7;
+      goto cleanup;
+    }
+    //look up package name in package directory
+    if (withdeps) {
+      struct package_metadata_struct searchpkginfo;
+      struct package_metadata_struct* pkginfo;
+      searchpkginfo.datafield[PACKAGE_METADATA_INDEX_BASENAME] = argv[i];
+      if ((pkginfo = (struct package_metadata_struct*)sorted_unique_list_search(depsdata.index, (char*)&searchpkginfo)) != NULL)
+        packagefilename = strdup((char*)pkginfo->extradata);
+    }
+    if (!packagefilename && (packagefilename = find_package_file(argv[i], pkgdir, arch)) == NULL) {
+      abort = 3;
+      goto cleanup;
+    }
+    sorted_unique_list_add_allocated(packagefiles, packagefilename);
   }
 
-  //show information
-  if (installedversion)
-    printf("Updating %s from version %s to %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], installedversion, metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
-  else
-    printf("Installing %s version %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
-  if (verbose) {
-    printf("Destination: %s\n", basepath);
+  //add missing dependencies
+  if (withdeps) {
+    struct package_metadata_struct** pkginfo;
+    size_t count = sorted_unique_list_size(packagefiles);
+    if ((pkginfo = (struct package_metadata_struct**)calloc(count, sizeof(struct package_metadata_struct*))) == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      abort = 7;
+      goto cleanup;
+    }
+    //mark all explicitly specified packages as visited first so they are not added again as a dependency of another one
+    for (j = 0; j < count; j++) {
+      pkginfo[j] = package_metadata_create();
+      if (read_package_metadata(sorted_unique_list_get(packagefiles, j), pkginfo[j]) == 0 && pkginfo[j]->datafield[PACKAGE_METADATA_INDEX_BASENAME])
+        sorted_unique_list_add(depsdata.visited, pkginfo[j]->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
+    }
+    for (j = 0; j < count; j++) {
+      if (pkginfo[j]->datafield[PACKAGE_METADATA_INDEX_BASENAME])
+        iterate_packages_in_list(pkginfo[j]->dependencies, add_dependency_to_install, &depsdata);
+      package_metadata_free(pkginfo[j]);
+    }
+    free(pkginfo);
+    if (depsdata.missing) {
+      fprintf(stderr, "Unable to install due to %i missing dependencies\n", depsdata.missing);
+      abort = 8;
+      goto cleanup;
+    }
+    if (sorted_unique_list_size(depsdata.packagefiles) > 0)
+      printf("Adding %lu missing dependencies\n", (unsigned long)sorted_unique_list_size(depsdata.packagefiles));
+    for (j = 0; j < sorted_unique_list_size(depsdata.packagefiles); j++)
+      sorted_unique_list_add(packagefiles, sorted_unique_list_get(depsdata.packagefiles, j));
   }
 
-  //compare contents of text lists
-  if (showdiff && installedversion)
-    sorted_unique_list_compare_lists(installedfilelist, metadata->filelist, NULL, filelist_show_old, filelist_show_new, NULL);
+  //prevent other processes from installing in the same location at the same time
+  i = 0;
+  p = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%s", basepath, PACKAGE_DATABASE_PATH));
+  lock = exclusive_lock_file_create(p, PACKAGE_INSTALL_LOCK_FILE_BASE, &errmsg, get_lock_progress, &i);
+  free(p);
+  if (!lock) {
+    fprintf(stderr, "%s\n", errmsg);
+    abort = 3;
+    goto cleanup;
+  }
 
-  //delete files that are no longer used
-  sorted_unique_list_compare_lists(installedfilelist, metadata->filelist, NULL, (verbose ? filelist_delete_file_verbose : filelist_delete_file), NULL, (void*)basepath);
+  //complete or discard installations that were interrupted
+  if (recover_interrupted_installations(db, basepath, verbose) != 0) {
+    abort = 3;
+    goto cleanup;
+  }
 
-  //create folder structure
-  {
-    int i;
-    int n;
-    struct memory_buffer* folderpath = memory_buffer_create();
-    n = sorted_unique_list_size(metadata->folderlist);
-    for (i = 0; i < n; i++)
-      recursive_mkdir(memory_buffer_get(memory_buffer_set_printf(folderpath, "%s%c%s", basepath, PATH_SEPARATOR, sorted_unique_list_get(metadata->folderlist, i))));
-    //clean up
-    memory_buffer_free(folderpath);
+  //create install jobs
+  if ((jobs = (struct install_job_struct*)calloc(sorted_unique_list_size(packagefiles), sizeof(struct install_job_struct))) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    abort = 7;
+    goto cleanup;
   }
+  jobcount = sorted_unique_list_size(packagefiles);
+  for (j = 0; j < jobcount; j++)
+    jobs[j].packagefilename = strdup(sorted_unique_list_get(packagefiles, j));
+  sorted_unique_list_free(packagefiles);
+  packagefiles = NULL;
 
-  //extract files
-  struct archive* pkg = archive_read_new();
-  //archive_read_support_filter_all(pkg);
-  //archive_read_support_format_all(pkg);
-  archive_read_support_format_7zip(pkg);
-  if (archive_read_open_filename(pkg, packagefilename, ARCHIVE_READ_BLOCK_SIZE) != ARCHIVE_OK) {
-    fprintf(stderr, "Error opening package file: %s\n", packagefilename);
-    return 4;
+  //create staging folders
+  for (j = 0; j < jobcount; j++) {
+    snprintf(jobs[j].staging, sizeof(jobs[j].staging), "%lu-%lu", (unsigned long)getpid(), (unsigned long)j);
+    jobs[j].stagingpath = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s%s%c%s", basepath, PACKAGE_STAGING_PATH, PATH_SEPARATOR, jobs[j].staging));
+    if (folder_exists(jobs[j].stagingpath))
+      dirtrav_recursive_delete(jobs[j].stagingpath);
+    if (recursive_mkdir(jobs[j].stagingpath) != 0 || pkgdb_journal_begin(db, jobs[j].staging) != 0) {
+      fprintf(stderr, "Error creating staging folder: %s\n", jobs[j].stagingpath);
+      abort = 3;
+      goto cleanup;
+    }
+  }
+
+  //extract package files to staging folders (using multiple threads if more than one package is installed)
+  if (numthreads > 0 && (size_t)numthreads > jobcount)
+    numthreads = jobcount;
+  if (numthreads <= 1) {
+    for (j = 0; j < jobcount; j++)
+      extract_job(&jobs[j], (allfiles ? NULL : db), NULL, basepath, storepath, verbose, 1);
   } else {
-    struct archive_entry* pkgentry;
-    char* pathname;
-    char* fullpath;
-    FILE* dst;
-    size_t basepathlen = strlen(basepath);
-    uint64_t currentsize = 0;
-    while (!abort && archive_read_next_header(pkg, &pkgentry) == ARCHIVE_OK) {
-      if ((pathname = strdup_slashed(archive_entry_pathname(pkgentry))) != NULL) {
-        if (archive_entry_filetype(pkgentry) & AE_IFREG && sorted_unique_list_find(metadata->filelist, pathname)) {
-          //remove from file list (optional early cleanup for performance improvement)
-          //sorted_unique_list_remove(metadata->filelist, pathname);
-          //determine destination name
-          if ((fullpath = (char*)malloc(basepathlen + strlen(pathname) + 2)) != NULL) {
-            memcpy(fullpath, basepath, basepathlen);
-            fullpath[basepathlen] = PATH_SEPARATOR;
-            strcpy(fullpath + basepathlen + 1, pathname);
-            //show progress
-            if (verbose)
-              printf("Extracting: %s\n", pathname);
-            else
-              printf("\r%3i%%", (int)(currentsize * 100 / metadata->totalsize));
-            //write file contents
-            if ((dst = fopen(fullpath, "wb")) == NULL) {
-              //try to delete first and then open again for write
-              if (unlink(fullpath) != 0) {
-                //fprintf(stderr, "Error deleting file: %s\n", fullpath);
-              }
-              if ((dst = fopen(fullpath, "wb")) == NULL) {
-                fprintf(stderr, "Error creating file: %s\n", fullpath);
-                abort = 1;
-              }
-            }
-            if (!abort) {
-              char buf[256];
-              ssize_t len;
-              while ((len = archive_read_data(pkg, buf, sizeof(buf))) > 0) {
-                if (fwrite(buf, 1, len, dst) < len) {
-                  fprintf(stderr, "Error writing to file: %s\n", fullpath);
-                  abort = 1;
-                  break;
-                }
-                currentsize += len;
-              }
-              fclose(dst);
-            }
-            free(fullpath);
-          } else {
-            fprintf(stderr, "Memory allocation error\n");
-          }
-        } else {
-          /*archive_read_data_skip(pkg);*/
-        }
-        free(pathname);
+    struct extract_queue_struct queue;
+    pthread_t* threads;
+    if ((threads = (pthread_t*)malloc(numthreads * sizeof(pthread_t))) == NULL) {
+      fprintf(stderr, "Memory allocation error\n");
+      abort = 7;
+      goto cleanup;
+    }
+    queue.jobs = jobs;
+    queue.jobcount = jobcount;
+    queue.nextjob = 0;
+    queue.db = (allfiles ? NULL : db);
+    queue.basepath = basepath;
+    queue.storepath = storepath;
+    queue.verbose = verbose;
+    queue.showprogress = 0;
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_mutex_init(&queue.dblock, NULL);
+    if (verbose)
+      printf("Extracting %lu packages using %i simultaneous threads\n", (unsigned long)jobcount, numthreads);
+    for (i = 0; i < numthreads; i++) {
+      if (pthread_create(&threads[i], NULL, (void*(*)(void*))extract_thread, &queue) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        //process remaining packages in the current thread
+        numthreads = i;
+        extract_thread(&queue);
+        break;
       }
     }
+    for (i = 0; i < numthreads; i++)
+      pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&queue.lock);
+    pthread_mutex_destroy(&queue.dblock);
+    free(threads);
   }
-#if ARCHIVE_VERSION_NUMBER < 3000000
-  archive_write_finish(pkg);
-#else
-  archive_write_free(pkg);
-#endif
 
-  //create metadata files
-  {
-    struct memory_buffer* pkginfopath = memory_buffer_create();
-    struct memory_buffer* filepath = memory_buffer_create();
-    //determine package information path
-    memory_buffer_set_printf(pkginfopath, "%s%s%c%s%c", basepath, PACKAGE_INFO_PATH, PATH_SEPARATOR, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], PATH_SEPARATOR);
-    //create package information path if needed
-    recursive_mkdir(memory_buffer_get(pkginfopath));
-    //create version file
-    write_to_file(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_VERSION_FILE)), metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
-    //create file listing file
-    sorted_unique_list_save_to_file(metadata->filelist, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_CONTENT_FILE)));
-    //create folder listing file
-    sorted_unique_list_save_to_file(metadata->folderlist, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_FOLDERS_FILE)));
-    //create dependency files
-    sorted_unique_list_save_to_file(metadata->dependencies, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_DEPENDENCIES_FILE)));
-    sorted_unique_list_save_to_file(metadata->optionaldependencies, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_OPTIONALDEPENDENCIES_FILE)));
-    sorted_unique_list_save_to_file(metadata->builddependencies, memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_BUILDDEPENDENCIES_FILE)));
-    //create metadata file
-    /////TO DO
-    //create folder with license file
-    /////TO DO
-    //clean up
-    memory_buffer_free(pkginfopath);
-    memory_buffer_free(filepath);
+  //determine install order based on dependencies
+  sortedpackagelist = sorted_unique_list_create(packageinfo_cmp_basename, (sorted_unique_free_fn)package_metadata_free);
+  for (j = 0; j < jobcount; j++) {
+    if (jobs[j].status == 0 && sorted_unique_list_find(sortedpackagelist, (char*)jobs[j].metadata)) {
+      fprintf(stderr, "Package %s specified more than once, skipping: %s\n", jobs[j].metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], jobs[j].packagefilename);
+      jobs[j].status = 6;
+    }
+    if (jobs[j].status != 0) {
+      discard_staged_files(db, basepath, jobs[j].staging);
+      package_metadata_free(jobs[j].metadata);
+      jobs[j].metadata = NULL;
+      jobs[j].done = 1;
+      abort = 1;
+    } else {
+      jobs[j].metadata->extradata = &jobs[j];
+      sorted_unique_list_add_allocated(sortedpackagelist, (char*)jobs[j].metadata);
+    }
   }
+  packageinstalllist = generate_build_list(sortedpackagelist);
 
-/************/
-  pkgdb_handle db = pkgdb_open(basepath);
-  struct package_metadata_struct* my_metadata = pkgdb_read_package(db, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
-  package_metadata_free(my_metadata);
-  pkgdb_uninstall_package(db, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
-  pkgdb_install_package(db, metadata);
-  pkgdb_close(db);
-/************/
-
-  //show information on success or clean up on error
-  if (!abort) {
-    //show information
-    printf("\rFinished ");
-    if (!installedversion)
-      printf("installing %s %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
-/*
-    if (strcmp(metadata->datafield[PACKAGE_METADATA_INDEX_VERSION], installedversion) == 0)
-      printf("reinstalling %s %s\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
-*/
-    else
-      printf("updating %s %s (previous version: %s)\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION], installedversion);
-  } else {
-    //clean up
-    struct memory_buffer* pkginfopath;
-    struct memory_buffer* path;
-    fprintf(stderr, "Error installing %s %s, uninstalling\n", metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME], metadata->datafield[PACKAGE_METADATA_INDEX_VERSION]);
-    path = memory_buffer_create();
-    //remove metadata files
-    pkginfopath = memory_buffer_create();
-    memory_buffer_set_printf(pkginfopath, "%s%s%c%s", basepath, PACKAGE_INFO_PATH, PATH_SEPARATOR, metadata->datafield[PACKAGE_METADATA_INDEX_BASENAME]);
-    unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", memory_buffer_get(pkginfopath), PATH_SEPARATOR, PACKAGE_INFO_VERSION_FILE)));
-    unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", memory_buffer_get(pkginfopath), PATH_SEPARATOR, PACKAGE_INFO_CONTENT_FILE)));
-    unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", memory_buffer_get(pkginfopath), PATH_SEPARATOR, PACKAGE_INFO_FOLDERS_FILE)));
-    unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", memory_buffer_get(pkginfopath), PATH_SEPARATOR, PACKAGE_INFO_DEPENDENCIES_FILE)));
-    unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", memory_buffer_get(pkginfopath), PATH_SEPARATOR, PACKAGE_INFO_OPTIONALDEPENDENCIES_FILE)));
-    unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", memory_buffer_get(pkginfopath), PATH_SEPARATOR, PACKAGE_INFO_BUILDDEPENDENCIES_FILE)));
-    rmdir(memory_buffer_get(pkginfopath));
-    memory_buffer_free(pkginfopath);
-    //remove files
-    int i;
-    int n;
-    const char* s;
-    n = sorted_unique_list_size(metadata->filelist);
-    i = 0;
-    while (i < n) {
-      s = sorted_unique_list_get(metadata->filelist, i);
-      unlink(memory_buffer_get(memory_buffer_set_printf(path, "%s%c%s", basepath, PATH_SEPARATOR, s)));
+  //register packages and move files in place in the right order
+  while (packageinstalllist) {
+    struct package_info_list_struct* current = packageinstalllist;
+    struct install_job_struct* job = (struct install_job_struct*)current->info->extradata;
+    //packages that are part of a cyclic dependency can be listed more than once
+    if (!job->done) {
+      if (install_job(db, basepath, job, showdiff, exportinfo, verbose) != 0)
+        abort = 1;
+      job->done = 1;
     }
-    /////TO DO: remove (empty an no longer used) folders
-    memory_buffer_free(path);
+    packageinstalllist = current->next;
+    free(current);
   }
 
-  //clean up
-  free(installedversion);
-  sorted_unique_list_free(installedfilelist);
-  package_metadata_free(metadata);
+  //clean up (the lock is released last, after staging folders and journal entries of packages that were not installed are removed)
+cleanup:
+  for (j = 0; j < jobcount; j++) {
+    if (jobs[j].stagingpath && !jobs[j].done)
+      discard_staged_files(db, basepath, jobs[j].staging);
+    free(jobs[j].packagefilename);
+    free(jobs[j].stagingpath);
+  }
+  free(jobs);
+  sorted_unique_list_free(sortedpackagelist);
+  sorted_unique_list_free(packagefiles);
+  sorted_unique_list_free(depsdata.packagefiles);
+  sorted_unique_list_free(depsdata.visited);
+  sorted_unique_list_free(depsdata.index);
+  pkgdb_close(db);
+  exclusive_lock_file_destroy(lock);
   free(arch);
-  free(packagefilename);
   return abort;
 }
 
 /////TO DO: make folder .license and copy license file(s)
 /////TO DO: clean up (empty) folders
-/////TO DO: allow installation of multiple packages
 
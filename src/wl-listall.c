@@ -7,6 +7,7 @@
 #include "sorted_unique_list.h"
 #include "filesystem.h"
 #include "pkgfile.h"
+#include "pkgdb.h"
 
 #define PROGRAM_NAME    "wl-listall"
 #define PROGRAM_DESC    "Command line utility to list available package recipes"
@@ -26,15 +27,22 @@ int main (int argc, char *argv[], char *envp[])
   const char* basename;
   size_t totalbuilding = 0;
   size_t totalproblems = 0;
+  size_t totalinstalled = 0;
+  size_t totaloutdated = 0;
+  pkgdb_handle db = NULL;
+  pkgdb_snapshot installed = NULL;
+  const struct package_metadata_struct* dbpkginfo;
   int showversion = 0;
   int showhelp = 0;
   int verbose = 1;
   const char* packageinfopath = NULL;
+  const char* dstdir = NULL;
   //definition of command line arguments
   const miniargv_definition argdef[] = {
     {'h', "help",          NULL,   miniargv_cb_increment_int,   &showhelp,        "show command line help", NULL},
     {0,   "version",         NULL,   miniargv_cb_increment_int, &showversion,     "show version information", NULL},
     {'s', "source-path",   "PATH", miniargv_cb_set_const_str,   &packageinfopath, "build recipe path\noverrides environment variable BUILDSCRIPTS\ncan be multiple paths separated by \"" WINLIBS_CHR2STR(PATHLIST_SEPARATOR) "\"", NULL},
+    {'i', "install-path",  "PATH", miniargv_cb_set_const_str,   &dstdir,          "package installation path\nif specified installed versions will also be listed", NULL},
     //{'v', "verbose",       NULL,   miniargv_cb_increment_int,   &verbose,         "verbose mode", NULL},
     {'q', "quiet",         NULL,   miniargv_cb_set_int_to_zero, &verbose,         "quiet mode", NULL},
     MINIARGV_DEFINITION_END
@@ -76,6 +84,18 @@ int main (int argc, char *argv[], char *envp[])
     fprintf(stderr, "Invalid path(s) specified with -s parameter or BUILDSCRIPTS environment variable: %s\n", packageinfopath);
     return 3;
   }
+  if (dstdir && *dstdir) {
+    if (!folder_exists(dstdir)) {
+      fprintf(stderr, "Path does not exist: %s\n", dstdir);
+      return 3;
+    }
+    //load information about all installed packages in one go
+    if (!pkgdb_exists(dstdir) || (db = pkgdb_open(dstdir)) == NULL || (installed = pkgdb_snapshot_create(db)) == NULL) {
+      fprintf(stderr, "No valid package database found for: %s\n", dstdir);
+      pkgdb_close(db);
+      return 3;
+    }
+  }
   //read all package info
   if ((packagelist = sorted_unique_list_create(versioncmp, free)) == NULL) {
     fprintf(stderr, "Memory allocation error in sorted_unique_list_create()\n");
@@ -94,8 +114,18 @@ int main (int argc, char *argv[], char *envp[])
         fprintf(stderr, "Name mismatch for package %s (name in file: %s)\n", basename, (pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME] ? pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME] : "NULL"));
         totalproblems++;
       }
-      if (verbose)
-        printf("%s %s%s\n", pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], (pkginfo->buildok ? "" : " (not building)"));
+      dbpkginfo = pkgdb_snapshot_get_package(installed, basename);
+      if (dbpkginfo) {
+        totalinstalled++;
+        if (!dbpkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION] || !pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION] || strcmp(dbpkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION]) != 0)
+          totaloutdated++;
+      }
+      if (verbose) {
+        printf("%s %s%s", pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION], (pkginfo->buildok ? "" : " (not building)"));
+        if (dbpkginfo)
+          printf(" (installed: %s)", (dbpkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION] ? dbpkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION] : "unknown version"));
+        printf("\n");
+      }
       if (pkginfo->buildok)
         totalbuilding++;
       package_metadata_free(pkginfo);
@@ -105,7 +135,13 @@ int main (int argc, char *argv[], char *envp[])
   printf("Total packages: %lu\n", (unsigned long)n);
   printf("Total packages than can be built: %lu\n", (unsigned long)totalbuilding);
   printf("Total packages with package information problems: %lu\n", (unsigned long)totalproblems);
+  if (installed) {
+    printf("Total packages installed: %lu\n", (unsigned long)totalinstalled);
+    printf("Total installed packages with different version than recipe: %lu\n", (unsigned long)totaloutdated);
+  }
   //clean up
+  pkgdb_snapshot_free(installed);
+  pkgdb_close(db);
   sorted_unique_list_free(packagelist);
   return 0;
 }
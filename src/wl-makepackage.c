@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
 #include <miniargv.h>
 #include <dirtrav.h>
 #include <pcre2_finder.h>
@@ -21,10 +22,17 @@
 #ifndef NO_PEDEPS
 #include <pedeps.h>
 #endif
+#include "filesystem.h"
 #include "fstab.h"
 #include "memory_buffer.h"
-#ifndef NO_PEDEPS
 #include "sorted_unique_list.h"
+#include "pkg.h"
+#include "pkgdb.h"
+#include "pkgrepo.h"
+#include "pkgarchive.h"
+#include "sha256.h"
+#ifndef NO_PEDEPS
+#include "pecache.h"
 #endif
 
 #define PCRE2_SUCCESS 0  ////
@@ -41,20 +49,8 @@
 #define LIBARCHIVE_7ZIP_AVOID_BACKSLASHES 1     //see bug reported here: https://github.com/libarchive/libarchive/issues/1833
 #endif
 
-//#define ARCHIVEFORMAT_TAR
-//#define PACKAGE_EXTENSION ".tar"
-//#define ARCHIVEFORMAT_TAR_GZ
-//#define PACKAGE_EXTENSION ".tar.gz"
-//#define ARCHIVEFORMAT_TAR_BZ2
-//#define PACKAGE_EXTENSION ".tar.bz2"
-//#define ARCHIVEFORMAT_TAR_LZ4
-//#define PACKAGE_EXTENSION ".tar.lz4"
-//#define ARCHIVEFORMAT_TAR_XZ
-//#define PACKAGE_EXTENSION ".tar.xz"
-//#define ARCHIVEFORMAT_ZIP
-//#define PACKAGE_EXTENSION ".zip"
-#define ARCHIVEFORMAT_7Z
-#define PACKAGE_EXTENSION ".7z"
+#define FILE_READ_BUFFER_SIZE (64 * 1024)
+#define MODIFIED_FILE_MEMORY_LIMIT (16 * 1024 * 1024)   //files needing replacements up to this size are processed in memory
 
 #undef METADATA_CONTENTS
 #undef CHECK_DEPENDANCIES
@@ -65,6 +61,9 @@
 #include "text_list.h"
 #endif
 
+struct find_replace_callback_struct;
+struct previous_package_struct;
+
 struct packager_callback_struct {
   struct archive* arch;
   size_t level;
@@ -72,14 +71,417 @@ struct packager_callback_struct {
   const char* srcdir;
   const char* dstdir;
   struct fstab_data_struct* fstabdata;
+  struct package_metadata_struct* pkginfo;
+  struct find_replace_callback_struct* replacers;
+  int64_t sourcedateepoch;              //timestamp used for all entries (clamped to file modification time) or -1 to store no timestamps
+  struct previous_package_struct* previous;     //if not NULL entries are compared with the previous package file instead of being written to the archive
 #ifndef NO_PEDEPS
   sorted_unique_list* ownpemodules;
   sorted_unique_list* pedeps;
-  char* pelastmodule;
 #endif
 };
 
-int add_folder_to_archive (const char* relativepath, struct packager_callback_struct* callbackdata)
+////////////////////////////////////////////////////////////////////////
+
+enum package_inventory_type {
+  inventory_file,
+  inventory_folder_start,
+  inventory_folder_end
+};
+
+//file or folder found in the package source folder (folders are listed before and after their contents)
+struct package_inventory_entry_struct {
+  enum package_inventory_type type;
+  char* fullpath;
+  char* relativepath;
+  const char* name;
+  const char* extension;
+  uint64_t size;
+  time_t mtime;
+};
+
+//list of all files and folders in the package source folder in the order they were found (traversed only once)
+struct package_inventory_struct {
+  struct package_inventory_entry_struct* entries;
+  size_t count;
+  size_t allocated;
+};
+
+typedef int (*package_inventory_callback_fn)(const struct package_inventory_entry_struct* entry, void* callbackdata);
+
+int package_inventory_add (struct package_inventory_struct* inventory, enum package_inventory_type type, dirtrav_entry info)
+{
+  struct package_inventory_entry_struct* entry;
+  char* p;
+  if (inventory->count >= inventory->allocated) {
+    size_t newsize = (inventory->allocated ? inventory->allocated * 2 : 1024);
+    if ((entry = (struct package_inventory_entry_struct*)realloc(inventory->entries, newsize * sizeof(struct package_inventory_entry_struct))) == NULL)
+      return 1;
+    inventory->entries = entry;
+    inventory->allocated = newsize;
+  }
+  entry = &inventory->entries[inventory->count];
+  entry->type = type;
+  if ((entry->fullpath = strdup(dirtrav_prop_get_path(info))) == NULL || (entry->relativepath = strdup(dirtrav_prop_get_relative_path(info))) == NULL) {
+    free(entry->fullpath);
+    return 1;
+  }
+  //determine name and extension (pointing inside the relative path)
+  entry->name = entry->relativepath;
+  for (p = entry->relativepath; *p; p++) {
+    if ((*p == '/' || *p == '\\') && *(p + 1))
+      entry->name = p + 1;
+  }
+  entry->extension = strrchr(entry->name, '.');
+  entry->size = (type == inventory_file ? dirtrav_prop_get_size(info) : 0);
+  entry->mtime = dirtrav_prop_get_modify_time(info);
+  inventory->count++;
+  return 0;
+}
+
+int package_inventory_file_callback (dirtrav_entry info)
+{
+  return package_inventory_add((struct package_inventory_struct*)info->callbackdata, inventory_file, info);
+}
+
+int package_inventory_before_folder_callback (dirtrav_entry info)
+{
+  return package_inventory_add((struct package_inventory_struct*)info->callbackdata, inventory_folder_start, info);
+}
+
+int package_inventory_after_folder_callback (dirtrav_entry info)
+{
+  return package_inventory_add((struct package_inventory_struct*)info->callbackdata, inventory_folder_end, info);
+}
+
+//file or folder (including its contents) in the inventory, used for sorting
+struct package_inventory_item_struct {
+  const char* name;
+  size_t first;
+  size_t count;
+};
+
+static int package_inventory_item_cmp (const void* item1, const void* item2)
+{
+  return strcmp(((const struct package_inventory_item_struct*)item1)->name, ((const struct package_inventory_item_struct*)item2)->name);
+}
+
+//sort the entries in the specified range (contents of one folder) by name, including the contents of subfolders
+static int package_inventory_sort_range (struct package_inventory_entry_struct* entries, size_t first, size_t count, struct package_inventory_entry_struct* tmp)
+{
+  size_t i;
+  size_t j;
+  size_t depth;
+  size_t itemcount = 0;
+  struct package_inventory_item_struct* items;
+  if (count < 2)
+    return 0;
+  if ((items = (struct package_inventory_item_struct*)malloc(count * sizeof(struct package_inventory_item_struct))) == NULL)
+    return 1;
+  //determine items (a folder item includes everything up to the matching end of folder entry)
+  i = first;
+  while (i < first + count) {
+    j = i + 1;
+    if (entries[i].type == inventory_folder_start) {
+      depth = 1;
+      while (j < first + count && depth > 0) {
+        if (entries[j].type == inventory_folder_start)
+          depth++;
+        else if (entries[j].type == inventory_folder_end)
+          depth--;
+        j++;
+      }
+      //sort folder contents
+      if (j - i > 3 && package_inventory_sort_range(entries, i + 1, j - i - 2, tmp) != 0) {
+        free(items);
+        return 1;
+      }
+    }
+    items[itemcount].name = entries[i].name;
+    items[itemcount].first = i;
+    items[itemcount].count = j - i;
+    itemcount++;
+    i = j;
+  }
+  //sort items and put entries in the new order
+  qsort(items, itemcount, sizeof(struct package_inventory_item_struct), package_inventory_item_cmp);
+  j = 0;
+  for (i = 0; i < itemcount; i++) {
+    memcpy(tmp + j, entries + items[i].first, items[i].count * sizeof(struct package_inventory_entry_struct));
+    j += items[i].count;
+  }
+  memcpy(entries + first, tmp, count * sizeof(struct package_inventory_entry_struct));
+  free(items);
+  return 0;
+}
+
+//traverse source folder once and keep the list of files and folders in memory (sorted by name so the result doesn't depend on the order of the file system)
+int package_inventory_load (struct package_inventory_struct* inventory, const char* srcdir)
+{
+  int status;
+  struct package_inventory_entry_struct* tmp;
+  inventory->entries = NULL;
+  inventory->count = 0;
+  inventory->allocated = 0;
+  if ((status = dirtrav_traverse_directory(srcdir, package_inventory_file_callback, package_inventory_before_folder_callback, package_inventory_after_folder_callback, inventory)) != 0)
+    return status;
+  if (inventory->count > 1) {
+    if ((tmp = (struct package_inventory_entry_struct*)malloc(inventory->count * sizeof(struct package_inventory_entry_struct))) == NULL)
+      return 1;
+    status = package_inventory_sort_range(inventory->entries, 0, inventory->count, tmp);
+    free(tmp);
+  }
+  return status;
+}
+
+void package_inventory_free (struct package_inventory_struct* inventory)
+{
+  size_t i;
+  for (i = 0; i < inventory->count; i++) {
+    free(inventory->entries[i].fullpath);
+    free(inventory->entries[i].relativepath);
+  }
+  free(inventory->entries);
+  inventory->entries = NULL;
+  inventory->count = 0;
+  inventory->allocated = 0;
+}
+
+//iterate through the inventory in the order entries were found (stops when a callback returns non-zero, like dirtrav_traverse_directory())
+int package_inventory_iterate (const struct package_inventory_struct* inventory, package_inventory_callback_fn filecallback, package_inventory_callback_fn folderstartcallback, package_inventory_callback_fn folderendcallback, void* callbackdata)
+{
+  size_t i;
+  int status;
+  package_inventory_callback_fn callback;
+  for (i = 0; i < inventory->count; i++) {
+    switch (inventory->entries[i].type) {
+      case inventory_file:
+        callback = filecallback;
+        break;
+      case inventory_folder_start:
+        callback = folderstartcallback;
+        break;
+      default:
+        callback = folderendcallback;
+        break;
+    }
+    if (callback && (status = (*callback)(&inventory->entries[i], callbackdata)) != 0)
+      return status;
+  }
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//get the timestamp stored for an archive entry (-1 if no timestamps are stored, which is the case unless in reproducible mode)
+static time_t get_archive_entry_mtime (time_t mtime, struct packager_callback_struct* callbackdata)
+{
+  if (callbackdata->sourcedateepoch < 0)
+    return -1;
+  if (mtime <= 0 || mtime > (time_t)callbackdata->sourcedateepoch)
+    return (time_t)callbackdata->sourcedateepoch;
+  return mtime;
+}
+
+//set the attributes of an archive entry that don't come from the file itself (same owner for all entries and timestamps only in reproducible mode)
+static void set_archive_entry_attributes (struct archive_entry* entry, time_t mtime, struct packager_callback_struct* callbackdata)
+{
+  archive_entry_set_uid(entry, 0);
+  archive_entry_set_gid(entry, 0);
+  if ((mtime = get_archive_entry_mtime(mtime, callbackdata)) >= 0)
+    archive_entry_set_mtime(entry, mtime, 0);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//file or folder in the previous package file (used for incremental packaging)
+struct previous_package_entry_struct {
+  char* path;                           //path in archive (must be first member, used for sorting)
+  int isfolder;
+  time_t mtime;                         //-1 if not stored
+  char sha256[SHA256_HEX_SIZE];         //empty for folders and for files with a hash in the package information (already compared)
+  int found;
+};
+
+//contents of the previous package file and number of differences found
+struct previous_package_struct {
+  sorted_unique_list* entries;
+  size_t changes;
+  int verbose;
+};
+
+static int previous_package_entry_cmp (const char* data1, const char* data2)
+{
+  return strcmp(((const struct previous_package_entry_struct*)data1)->path, ((const struct previous_package_entry_struct*)data2)->path);
+}
+
+static void previous_package_entry_free (struct previous_package_entry_struct* entry)
+{
+  if (entry) {
+    free(entry->path);
+    free(entry);
+  }
+}
+
+//compare data of the current archive entry with data in memory (returns 0 if identical)
+static int archive_entry_data_cmp (struct archive* a, const char* data, size_t datalen)
+{
+  int status;
+  const void* buf;
+  size_t len;
+  la_int64_t offset;
+  size_t pos = 0;
+  while ((status = archive_read_data_block(a, &buf, &len, &offset)) == ARCHIVE_OK) {
+    if ((size_t)offset != pos || pos + len > datalen || memcmp(data + pos, buf, len) != 0)
+      return 1;
+    pos += len;
+  }
+  return (status == ARCHIVE_EOF && pos == datalen ? 0 : 1);
+}
+
+//calculate SHA-256 hash of the data of the current archive entry (returns 0 on success)
+static int archive_entry_data_sha256 (struct archive* a, char* hex)
+{
+  int status;
+  const void* buf;
+  size_t len;
+  la_int64_t offset;
+  struct sha256_context ctx;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  sha256_init(&ctx);
+  while ((status = archive_read_data_block(a, &buf, &len, &offset)) == ARCHIVE_OK)
+    sha256_update(&ctx, buf, len);
+  if (status != ARCHIVE_EOF)
+    return 1;
+  sha256_final(&ctx, digest);
+  sha256_digest_to_hex(digest, hex);
+  return 0;
+}
+
+//calculate SHA-256 hash of data in memory
+static void memory_sha256 (const void* data, size_t datalen, char* hex)
+{
+  struct sha256_context ctx;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  sha256_init(&ctx);
+  sha256_update(&ctx, data, datalen);
+  sha256_final(&ctx, digest);
+  sha256_digest_to_hex(digest, hex);
+}
+
+//read the list of files and folders in the previous package file, only files without a hash in the new package information are hashed (returns NULL on error or if the package information is different)
+struct previous_package_struct* previous_package_load (const char* packagefilename, const char* metadata, size_t metadatalen, struct package_metadata_struct* pkginfo, int verbose)
+{
+  struct archive* a;
+  struct archive_entry* entry;
+  struct previous_package_struct* previous;
+  struct previous_package_entry_struct* item;
+  const char* path;
+  size_t pathlen;
+  int metadatafound = 0;
+  int status;
+  if ((previous = (struct previous_package_struct*)malloc(sizeof(struct previous_package_struct))) == NULL)
+    return NULL;
+  previous->entries = sorted_unique_list_create(previous_package_entry_cmp, (sorted_unique_free_fn)previous_package_entry_free);
+  previous->changes = 0;
+  previous->verbose = verbose;
+  a = archive_read_new();
+  package_archive_read_setup(a);
+  if ((status = archive_read_open_filename(a, packagefilename, FILE_READ_BUFFER_SIZE)) == ARCHIVE_OK) {
+    while ((status = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+      path = archive_entry_pathname(entry);
+      if (strcmp(path, PACKAGE_INFO_METADATA_FILE) == 0) {
+        //package information (including hashes of all unmodified files) must be identical
+        if (archive_entry_data_cmp(a, metadata, metadatalen) != 0) {
+          if (verbose)
+            printf("Package information differs from previous package file\n");
+          break;
+        }
+        metadatafound = 1;
+        continue;
+      }
+      if ((item = (struct previous_package_entry_struct*)malloc(sizeof(struct previous_package_entry_struct))) == NULL)
+        break;
+      pathlen = strlen(path);
+      if (pathlen > 0 && path[pathlen - 1] == '/')
+        pathlen--;
+      if ((item->path = (char*)malloc(pathlen + 1)) != NULL) {
+        memcpy(item->path, path, pathlen);
+        item->path[pathlen] = 0;
+      }
+      item->isfolder = (archive_entry_filetype(entry) == AE_IFDIR);
+      item->mtime = (archive_entry_mtime_is_set(entry) ? archive_entry_mtime(entry) : -1);
+      item->sha256[0] = 0;
+      item->found = 0;
+      if (!item->isfolder && item->path && !(pkginfo && package_metadata_get_file_info(pkginfo, item->path))) {
+        if (archive_entry_data_sha256(a, item->sha256) != 0) {
+          previous_package_entry_free(item);
+          break;
+        }
+      }
+      if (!item->path || sorted_unique_list_add_allocated(previous->entries, (char*)item) != 0) {
+        previous_package_entry_free(item);
+        break;
+      }
+    }
+  }
+  archive_read_free(a);
+  if (status != ARCHIVE_EOF || !metadatafound) {
+    sorted_unique_list_free(previous->entries);
+    free(previous);
+    return NULL;
+  }
+  return previous;
+}
+
+//report a difference with the previous package file
+static void previous_package_report_change (struct previous_package_struct* previous, const char* status, const char* path)
+{
+  previous->changes++;
+  if (previous->verbose)
+    printf("%s since previous package file: %s\n", status, path);
+}
+
+//check if a file or folder is in the previous package file with the same type, timestamp and hash (sha256 is NULL for folders and for files with a hash in the package information)
+static void previous_package_check_entry (const char* path, int isfolder, time_t mtime, const char* sha256, struct packager_callback_struct* callbackdata)
+{
+  struct previous_package_entry_struct search;
+  struct previous_package_entry_struct* item;
+  search.path = (char*)path;
+  if ((item = (struct previous_package_entry_struct*)sorted_unique_list_search(callbackdata->previous->entries, (const char*)&search)) == NULL) {
+    previous_package_report_change(callbackdata->previous, "Added", path);
+    return;
+  }
+  item->found = 1;
+  //timestamps are only compared in reproducible mode (otherwise none are written, but reading tar and zip files always reports one)
+  if (item->isfolder != isfolder || (callbackdata->sourcedateepoch >= 0 && item->mtime != get_archive_entry_mtime(mtime, callbackdata)) || (sha256 && strcmp(item->sha256, sha256) != 0))
+    previous_package_report_change(callbackdata->previous, "Changed", path);
+}
+
+//count the files and folders in the previous package file that were not found in the new package and return the total number of differences
+size_t previous_package_get_changes (struct previous_package_struct* previous)
+{
+  unsigned int i;
+  const struct previous_package_entry_struct* item;
+  for (i = 0; (item = (const struct previous_package_entry_struct*)sorted_unique_list_get(previous->entries, i)) != NULL; i++) {
+    if (!item->found)
+      previous_package_report_change(previous, "Removed", item->path);
+  }
+  return previous->changes;
+}
+
+void previous_package_free (struct previous_package_struct* previous)
+{
+  if (previous) {
+    sorted_unique_list_free(previous->entries);
+    free(previous);
+  }
+}
+
+////////////////////////////////////////////////////////////////////////
+
+//add folder to archive (mtime is only used in reproducible mode, 0 if unknown)
+int add_folder_to_archive (const char* relativepath, time_t mtime, struct packager_callback_struct* callbackdata)
 {
   struct archive_entry *entry;
   char* path;
@@ -106,12 +508,19 @@ int add_folder_to_archive (const char* relativepath, struct packager_callback_st
     p++;
   }
 #endif
+  //only compare with previous package file
+  if (callbackdata->previous) {
+    previous_package_check_entry(path, 1, mtime, NULL, callbackdata);
+    free(path);
+    return 1;
+  }
   //add directory to archive
   entry = archive_entry_new();
   archive_entry_set_pathname(entry, path);
   archive_entry_set_size(entry, 0);
   archive_entry_set_filetype(entry, AE_IFDIR);
   archive_entry_set_perm(entry, 0644);
+  set_archive_entry_attributes(entry, mtime, callbackdata);
   archive_write_header(callbackdata->arch, entry);
   //archive_entry_clear(entry); //needed if free follows???
   archive_entry_free(entry);
@@ -120,22 +529,39 @@ int add_folder_to_archive (const char* relativepath, struct packager_callback_st
   return 1;
 }
 
-int add_file_to_archive (const char* fullpath, const char* relativepath, struct packager_callback_struct* callbackdata)
+//add file to archive (size is determined if -1 is passed, mtime is only used in reproducible mode, 0 if unknown)
+int add_file_to_archive (const char* fullpath, const char* relativepath, int64_t size, time_t mtime, struct packager_callback_struct* callbackdata)
 {
   int fd;
   int len;
   char buff[8192];
   struct stat st;
   struct archive_entry *entry;
+  //only compare with previous package file (files with a hash in the package information were already compared)
+  if (callbackdata->previous) {
+    char hash[SHA256_HEX_SIZE];
+    if (callbackdata->pkginfo && package_metadata_get_file_info(callbackdata->pkginfo, relativepath)) {
+      previous_package_check_entry(relativepath, 0, mtime, NULL, callbackdata);
+    } else {
+      if (sha256_file(fullpath, hash) != 0)
+        return 0;
+      previous_package_check_entry(relativepath, 0, mtime, hash, callbackdata);
+    }
+    return 1;
+  }
   //get file information
-  if (stat(fullpath, &st) != 0)
-    return 0;
+  if (size < 0) {
+    if (stat(fullpath, &st) != 0)
+      return 0;
+    size = st.st_size;
+  }
   //add file to archive
   entry = archive_entry_new();
   archive_entry_set_pathname(entry, relativepath);
-  archive_entry_set_size(entry, st.st_size);      //required but not always known in advance
+  archive_entry_set_size(entry, size);      //required but not always known in advance
   archive_entry_set_filetype(entry, AE_IFREG);
   archive_entry_set_perm(entry, 0644);
+  set_archive_entry_attributes(entry, mtime, callbackdata);
   archive_write_header(callbackdata->arch, entry);
   if ((fd = open(fullpath, O_RDONLY | O_BINARY)) != -1) {
     len = read(fd, buff, sizeof(buff));
@@ -150,15 +576,24 @@ int add_file_to_archive (const char* fullpath, const char* relativepath, struct
   return 1;
 }
 
-int add_memory_to_archive (const void* data, size_t datalen, const char* relativepath, struct packager_callback_struct* callbackdata)
+//add data from memory as file to archive (mtime is only used in reproducible mode, 0 if unknown)
+int add_memory_to_archive (const void* data, size_t datalen, const char* relativepath, time_t mtime, struct packager_callback_struct* callbackdata)
 {
   struct archive_entry *entry;
+  //only compare with previous package file
+  if (callbackdata->previous) {
+    char hash[SHA256_HEX_SIZE];
+    memory_sha256(data, datalen, hash);
+    previous_package_check_entry(relativepath, 0, mtime, hash, callbackdata);
+    return 1;
+  }
   //add file to archive
   entry = archive_entry_new();
   archive_entry_set_pathname(entry, relativepath);
   archive_entry_set_size(entry, datalen);
   archive_entry_set_filetype(entry, AE_IFREG);
   archive_entry_set_perm(entry, 0644);
+  set_archive_entry_attributes(entry, mtime, callbackdata);
   archive_write_header(callbackdata->arch, entry);
   archive_write_data(callbackdata->arch, data, datalen);
   //archive_entry_clear(entry); //needed if free follows???
@@ -166,11 +601,15 @@ int add_memory_to_archive (const void* data, size_t datalen, const char* relativ
   return 1;
 }
 
+//find/replace matcher for a combination of replace flags (built once and reused for all files needing the same replacements)
 struct find_replace_callback_struct {
   struct pcre2_finder* finder;
   struct packager_callback_struct* folderinfo;
+  unsigned int replace_flags;
+  sorted_unique_list* expressions;
   int nextflags;
   int nextid;
+  struct find_replace_callback_struct* next;
 };
 
 #define PKG_REPLACE_INST_SH         0x01  //replace install paths in shell scripts
@@ -186,7 +625,7 @@ typedef void (*path_callback_fn)(const char* path, void* callbackdata);
 
 static void iterate_path_permutations (const char* path, path_callback_fn callbackfn, struct find_replace_callback_struct* callbackdata, int pcre2_flags, int pcre2_id)
 {
-  int i;
+  size_t i;
   char* s;
   char* p;
   size_t pathlen;
@@ -404,14 +843,24 @@ char* regex_escape_string (const char* data)
   return result;
 }
 
+//add expression to find/replace matcher (path permutations often produce the same expression more than once, these are only compiled once)
+static void add_find_replace_expr (struct find_replace_callback_struct* replacer, const char* expr, unsigned int flags, int matchid)
+{
+  if (replacer->expressions) {
+    if (sorted_unique_list_find(replacer->expressions, expr))
+      return;
+    sorted_unique_list_add(replacer->expressions, expr);
+  }
+  pcre2_finder_add_expr(replacer->finder, expr, flags, package_file_match_found, replacer, matchid);
+}
+
 void inst_path_permutation_libdir_callback (const char* path, void* callbackdata)
 {
   if (callbackdata && path) {
     char* expr;
     if ((expr = regex_escape_string(path)) != NULL) {
       if (add_prefix_suffix(&expr, "^libdir='", NULL) != NULL) {
-/////DLL_EXPORT_PCRE2_FINDER int pcre2_finder_add_expr (struct pcre2_finder* finder, const char* expr, unsigned int flags, pcre2_finder_match_fn matchfn, void* callbackdata, int matchid);
-        pcre2_finder_add_expr(((struct find_replace_callback_struct*)callbackdata)->finder, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, ((struct find_replace_callback_struct*)callbackdata)->nextid);
+        add_find_replace_expr((struct find_replace_callback_struct*)callbackdata, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, ((struct find_replace_callback_struct*)callbackdata)->nextid);
       }
       free(expr);
     }
@@ -425,7 +874,7 @@ void inst_path_permutation_lib_arg_callback (const char* path, void* callbackdat
     if ((expr = regex_escape_string(path)) != NULL) {
       //if (add_prefix_suffix(&expr, NULL, "/lib/lib[^ /]*\\.la") != NULL) {  /////crashes in Hyperscan (avoid slash in square brackets)
       if (add_prefix_suffix(&expr, NULL, "/lib/lib[^ ]*\\.la") != NULL) {
-        pcre2_finder_add_expr(((struct find_replace_callback_struct*)callbackdata)->finder, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, ((struct find_replace_callback_struct*)callbackdata)->nextid);
+        add_find_replace_expr((struct find_replace_callback_struct*)callbackdata, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, ((struct find_replace_callback_struct*)callbackdata)->nextid);
       }
       free(expr);
     }
@@ -438,7 +887,7 @@ void inst_path_permutation_lib_path_callback (const char* path, void* callbackda
     char* expr;
     if ((expr = regex_escape_string(path)) != NULL) {
       if (add_prefix_suffix(&expr, "-L=?", "(/[^ /.]*/\\.\\.)?/lib[ ']") != NULL) {
-        pcre2_finder_add_expr(((struct find_replace_callback_struct*)callbackdata)->finder, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, ((struct find_replace_callback_struct*)callbackdata)->nextid);
+        add_find_replace_expr((struct find_replace_callback_struct*)callbackdata, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, ((struct find_replace_callback_struct*)callbackdata)->nextid);
       }
       free(expr);
     }
@@ -450,7 +899,7 @@ void inst_path_permutation_add_callback (const char* path, void* callbackdata)
   if (callbackdata && path) {
     char* expr;
     if ((expr = regex_escape_string(path)) != NULL) {
-      pcre2_finder_add_expr(((struct find_replace_callback_struct*)callbackdata)->finder, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, ((struct find_replace_callback_struct*)callbackdata)->nextid);
+      add_find_replace_expr((struct find_replace_callback_struct*)callbackdata, expr, ((struct find_replace_callback_struct*)callbackdata)->nextflags, ((struct find_replace_callback_struct*)callbackdata)->nextid);
       free(expr);
     }
   }
@@ -468,131 +917,207 @@ unsigned int* grow_uint_list (unsigned int** list, size_t oldsize, size_t newsiz
   return *list;
 }
 
-#define FILE_READ_BUFFER_SIZE 256
-
 size_t pcre2_finder_output_to_filedescriptor (void* callbackdata, const char* data, size_t datalen)
 {
   return write(*(int*)callbackdata, data, datalen);
 }
 
-int add_modified_file_to_archive (const char* fullpath, const char* relativepath, unsigned int replace_flags, struct packager_callback_struct* callbackdata)
+//growing memory buffer receiving the output of the find/replace matcher
+struct replace_output_buffer_struct {
+  char* data;
+  size_t datalen;
+  size_t allocated;
+};
+
+size_t pcre2_finder_output_to_memory (void* callbackdata, const char* data, size_t datalen)
+{
+  struct replace_output_buffer_struct* output = (struct replace_output_buffer_struct*)callbackdata;
+  if (output->datalen + datalen > output->allocated) {
+    char* newdata;
+    size_t newsize = (output->allocated ? output->allocated * 2 : 4096);
+    while (newsize < output->datalen + datalen)
+      newsize *= 2;
+    if ((newdata = (char*)realloc(output->data, newsize)) == NULL)
+      return 0;
+    output->data = newdata;
+    output->allocated = newsize;
+  }
+  memcpy(output->data + output->datalen, data, datalen);
+  output->datalen += datalen;
+  return datalen;
+}
+
+//get find/replace matcher for the specified replace flags (built on first use)
+static struct find_replace_callback_struct* get_find_replace_matcher (struct packager_callback_struct* callbackdata, unsigned int replace_flags)
 {
+  struct find_replace_callback_struct* replacer;
+  //reuse matcher if it was already built for the same replace flags
+  for (replacer = callbackdata->replacers; replacer; replacer = replacer->next) {
+    if (replacer->replace_flags == replace_flags)
+      return replacer;
+  }
+  //build new matcher
+  if ((replacer = (struct find_replace_callback_struct*)malloc(sizeof(struct find_replace_callback_struct))) == NULL)
+    return NULL;
+  if ((replacer->finder = pcre2_finder_initialize()) == NULL) {
+    free(replacer);
+    return NULL;
+  }
+  replacer->folderinfo = callbackdata;
+  replacer->replace_flags = replace_flags;
+  replacer->expressions = sorted_unique_list_create(strcmp, free);
+  replacer->nextflags = 0;
+  replacer->nextid = 0;
+  if (replace_flags & PKG_REPLACE_LIBDIR) {
+    //add libdir= to be replaced
+    add_find_replace_expr(replacer, "^libdir='\\.\\.(/\\.\\.)*", PCRE2_MULTILINE | PCRE2_CASELESS, PKG_REPLACE_LIBDIR);
+    iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_libdir_callback, replacer, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_LIBDIR);
+  }
+  if (replace_flags & PKG_REPLACE_LIB_ARG) {
+    //add installation paths to be replaced
+    add_find_replace_expr(replacer, "\\$MINGWPREFIX/lib/lib[^ ]*\\.la", PCRE2_MULTILINE, PKG_REPLACE_LIB_ARG);
+    iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_lib_arg_callback, replacer, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_LIB_ARG);
+    iterate_path_permutations(callbackdata->dstdir, inst_path_permutation_lib_arg_callback, replacer, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_LIB_ARG);
+  }
+  if (replace_flags & PKG_REPLACE_LIB_PATH) {
+    //add library include paths to be removed
+    add_find_replace_expr(replacer, "/bin/\\.\\.", PCRE2_MULTILINE, PKG_REPLACE_LIB_PATH);
+    add_find_replace_expr(replacer, "-L=?/?(\\.\\./|lib/)*lib[ ']|-L=?/(mingw|usr/local|usr)/lib[ ']|-L=?[^ ]*/\\.libs[ ']", PCRE2_MULTILINE, PKG_REPLACE_LIB_PATH);
+    iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_lib_path_callback, replacer, PCRE2_MULTILINE, replace_flags & PKG_REPLACE_LIB_PATH);
+    iterate_path_permutations(callbackdata->dstdir, inst_path_permutation_lib_path_callback, replacer, PCRE2_MULTILINE, replace_flags & PKG_REPLACE_LIB_PATH);
+  }
+  if (replace_flags & (PKG_REPLACE_INST_SH | PKG_REPLACE_INST_REL | PKG_REPLACE_INST_REL_PC | PKG_REPLACE_INST_REL_CMAKE)) {
+    //add installation paths to be replaced
+    iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_add_callback, replacer, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & (PKG_REPLACE_INST_SH | PKG_REPLACE_INST_REL | PKG_REPLACE_INST_REL_PC | PKG_REPLACE_INST_REL_CMAKE));
+  }
+  if (replace_flags & PKG_REPLACE_DST_REL) {
+    //add run paths to be replaced
+    iterate_path_permutations(callbackdata->dstdir, inst_path_permutation_add_callback, replacer, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_DST_REL);
+  }
+  if (callbackdata->verbose > 1)
+    printf("Path replacement matcher for flags 0x%02X: %u expressions\n", replace_flags, (replacer->expressions ? sorted_unique_list_size(replacer->expressions) : 0));
+  //the list of expressions is only needed while building
+  sorted_unique_list_free(replacer->expressions);
+  replacer->expressions = NULL;
+  //add to list of matchers
+  replacer->next = callbackdata->replacers;
+  callbackdata->replacers = replacer;
+  return replacer;
+}
+
+//free all find/replace matchers
+static void free_find_replace_matchers (struct packager_callback_struct* callbackdata)
+{
+  struct find_replace_callback_struct* next;
+  while (callbackdata->replacers) {
+    next = callbackdata->replacers->next;
+    pcre2_finder_cleanup(callbackdata->replacers->finder);
+    free(callbackdata->replacers);
+    callbackdata->replacers = next;
+  }
+}
+
+//add file with replacements done in memory (no temporary file is needed)
+static int add_modified_file_to_archive_in_memory (int src, const char* relativepath, uint64_t size, time_t mtime, struct find_replace_callback_struct* replacer, struct packager_callback_struct* callbackdata)
+{
+  char* buf;
+  size_t buflen = 0;
+  int len;
+  int status = 0;
+  struct replace_output_buffer_struct output;
+  //read entire file
+  if ((buf = (char*)malloc(size + 1)) == NULL)
+    return 0;
+  while (buflen < size && (len = read(src, buf + buflen, size - buflen)) > 0)
+    buflen += len;
+  //do replacements
+  output.datalen = 0;
+  output.allocated = buflen + buflen / 8 + 256;
+  if ((output.data = (char*)malloc(output.allocated)) != NULL) {
+    if (pcre2_finder_open(replacer->finder, pcre2_finder_output_to_memory, &output) == PCRE2_SUCCESS) {
+      status = (pcre2_finder_process(replacer->finder, buf, buflen) == PCRE2_SUCCESS);
+      pcre2_finder_close(replacer->finder);
+    }
+    //add modified data
+    if (status)
+      status = add_memory_to_archive(output.data, output.datalen, relativepath, mtime, callbackdata);
+    free(output.data);
+  }
+  free(buf);
+  return status;
+}
+
+//add file with replacements written to a temporary file first (for large files)
+static int add_modified_file_to_archive_via_temporary_file (int src, const char* relativepath, time_t mtime, struct find_replace_callback_struct* replacer, struct packager_callback_struct* callbackdata)
+{
+  int tmp;
+  int len;
+  char* buf;
   char* tempfilename;
-  /////TO DO: use mkstemp()
+  int status = 0;
+  //create temporary file
 #ifdef _WIN32
   if ((tempfilename = _tempnam(NULL, "pckgr")) == NULL) {
+    fprintf(stderr, "Error determining temporary file\n");
+    return 0;
+  }
+  if ((tmp = open(tempfilename, O_CREAT | O_EXCL | O_RDWR | O_BINARY, S_IRUSR | S_IWUSR)) == -1) {
 #else
-  //if ((tempfilename = tempnam("/tmp", "pckgr")) == NULL) {
-  if ((tempfilename = tempnam(NULL, "pckgr")) == NULL) {
+  tempfilename = memory_buffer_free_to_allocated_string(memory_buffer_set_printf(memory_buffer_create(), "%s/pckgrXXXXXX", (getenv("TMPDIR") && *getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp")));
+  if (!tempfilename || (tmp = mkstemp(tempfilename)) == -1) {
 #endif
-    fprintf(stderr, "Error determining temporary file\n");
-  } else {
-    int src;
-    int tmp;
-    char buf[FILE_READ_BUFFER_SIZE];
-    size_t buflen;
-    if ((src = open(fullpath, O_RDONLY | O_BINARY)) != -1) {
-      if ((tmp = open(tempfilename, O_CREAT | O_EXCL | O_WRONLY | O_BINARY, S_IRUSR | S_IWUSR)) == -1) {
-        fprintf(stderr, "Error creating temporary file: %s\n", tempfilename);
-        return 0;
-      } else {
-        struct find_replace_callback_struct pathcallbackdata;
-        //initialize find/replace
-        pathcallbackdata.finder = pcre2_finder_initialize();
-        pathcallbackdata.folderinfo = callbackdata;
-        pathcallbackdata.nextflags = 0;
-        pathcallbackdata.nextid = 0;
-        if (replace_flags & PKG_REPLACE_LIBDIR) {
-          //add libdir= to be replaced
-          pcre2_finder_add_expr(pathcallbackdata.finder, "^libdir='\\.\\.(/\\.\\.)*", PCRE2_MULTILINE | PCRE2_CASELESS, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, PKG_REPLACE_LIBDIR);
-          iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_libdir_callback, &pathcallbackdata, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_LIBDIR);
-        }
-        if (replace_flags & PKG_REPLACE_LIB_ARG) {
-          //add installation paths to be replaced
-          pcre2_finder_add_expr(pathcallbackdata.finder, "\\$MINGWPREFIX/lib/lib[^ ]*\\.la", PCRE2_MULTILINE, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, PKG_REPLACE_LIB_ARG);
-          iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_lib_arg_callback, &pathcallbackdata, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_LIB_ARG);
-          iterate_path_permutations(callbackdata->dstdir, inst_path_permutation_lib_arg_callback, &pathcallbackdata, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_LIB_ARG);
-        }
-        if (replace_flags & PKG_REPLACE_LIB_PATH) {
-          //add library include paths to be removed
-          pcre2_finder_add_expr(pathcallbackdata.finder, "/bin/\\.\\.", PCRE2_MULTILINE, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, PKG_REPLACE_LIB_PATH);
-          pcre2_finder_add_expr(pathcallbackdata.finder, "-L=?/?(\\.\\./|lib/)*lib[ ']|-L=?/(mingw|usr/local|usr)/lib[ ']|-L=?[^ ]*/\\.libs[ ']", PCRE2_MULTILINE, package_file_match_found, (struct find_replace_callback_struct*)callbackdata, PKG_REPLACE_LIB_PATH);
-          iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_lib_path_callback, &pathcallbackdata, PCRE2_MULTILINE, replace_flags & PKG_REPLACE_LIB_PATH);
-          iterate_path_permutations(callbackdata->dstdir, inst_path_permutation_lib_path_callback, &pathcallbackdata, PCRE2_MULTILINE, replace_flags & PKG_REPLACE_LIB_PATH);
-        }
-        if (replace_flags & (PKG_REPLACE_INST_SH | PKG_REPLACE_INST_REL | PKG_REPLACE_INST_REL_PC | PKG_REPLACE_INST_REL_CMAKE)) {
-          //add installation paths to be replaced
-          iterate_path_permutations(callbackdata->srcdir, inst_path_permutation_add_callback, &pathcallbackdata, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & (PKG_REPLACE_INST_SH | PKG_REPLACE_INST_REL | PKG_REPLACE_INST_REL_PC | PKG_REPLACE_INST_REL_CMAKE));
-        }
-        if (replace_flags & PKG_REPLACE_DST_REL) {
-          //add run paths to be replaced
-          iterate_path_permutations(callbackdata->dstdir, inst_path_permutation_add_callback, &pathcallbackdata, PCRE2_MULTILINE | PCRE2_CASELESS, replace_flags & PKG_REPLACE_DST_REL);
-        }
-        //process data
-        if (pcre2_finder_open(pathcallbackdata.finder, pcre2_finder_output_to_filedescriptor, &tmp) == PCRE2_SUCCESS) {
-          int status;
-          //process data and write result
-          while ((buflen = read(src, buf, sizeof(buf))) > 0) {
-            if ((status = pcre2_finder_process(pathcallbackdata.finder, buf, buflen)) != PCRE2_SUCCESS)
-              break;
-          }
-          pcre2_finder_close(pathcallbackdata.finder);
-        }
-        //clean up
-        pcre2_finder_cleanup(pathcallbackdata.finder);
-        close(tmp);
-        //add modified file
-        if (add_file_to_archive(tempfilename, relativepath, callbackdata) == 0) {
-          fprintf(stderr, "Error adding file: %s\n", relativepath);
-          return 0;
+    fprintf(stderr, "Error creating temporary file: %s\n", (tempfilename ? tempfilename : ""));
+    free(tempfilename);
+    return 0;
+  }
+  //process data and write result
+  if ((buf = (char*)malloc(FILE_READ_BUFFER_SIZE)) != NULL) {
+    if (pcre2_finder_open(replacer->finder, pcre2_finder_output_to_filedescriptor, &tmp) == PCRE2_SUCCESS) {
+      status = 1;
+      while ((len = read(src, buf, FILE_READ_BUFFER_SIZE)) > 0) {
+        if (pcre2_finder_process(replacer->finder, buf, len) != PCRE2_SUCCESS) {
+          status = 0;
+          break;
         }
-        //clean up temporary file
-        unlink(tempfilename);
       }
-      close(src);
+      pcre2_finder_close(replacer->finder);
     }
-    free(tempfilename);
+    free(buf);
   }
-  return 1;
+  close(tmp);
+  //add modified file
+  if (status)
+    status = add_file_to_archive(tempfilename, relativepath, -1, mtime, callbackdata);
+  //clean up temporary file
+  unlink(tempfilename);
+  free(tempfilename);
+  return status;
 }
 
-#ifndef NO_PEDEPS
-int check_pe_dependencies (const char* modulename, const char* functionname, void* callbackdata)
+//add file to archive with install paths replaced (returns 0 on error)
+int add_modified_file_to_archive (const char* fullpath, const char* relativepath, uint64_t size, time_t mtime, unsigned int replace_flags, struct packager_callback_struct* callbackdata)
 {
-  struct packager_callback_struct* data = (struct packager_callback_struct*)callbackdata;
-  if (!data->pelastmodule || strcasecmp(modulename, data->pelastmodule) != 0) {
-    if (data->pelastmodule)
-      free(data->pelastmodule);
-    data->pelastmodule = strdup(modulename);
-    sorted_unique_list_add(data->pedeps, modulename);
+  int src;
+  int status;
+  struct find_replace_callback_struct* replacer;
+  //get find/replace matcher
+  if ((replacer = get_find_replace_matcher(callbackdata, replace_flags)) == NULL) {
+    fprintf(stderr, "Error creating find/replace matcher\n");
+    return 0;
   }
-  return 0;
-}
-
-int check_pe_dependencies_callback (dirtrav_entry info)
-{
-  struct packager_callback_struct* callbackdata = (struct packager_callback_struct*)info->callbackdata;
-  const char* srcfile = dirtrav_prop_get_path(info);
-  const char* ext = dirtrav_prop_get_extension(info);
-  //add any other file without changes
-  if (callbackdata->pedeps && ext && (strcasecmp(ext, ".exe") == 0 || strcasecmp(ext, ".dll") == 0)) {
-    pefile_handle pehandle;
-    //add PE file to list of own modules
-    if (strcasecmp(ext, ".exe") != 0) {
-      sorted_unique_list_add(callbackdata->ownpemodules, dirtrav_prop_get_name(info));
-    }
-    //check PE file for dependencies
-    if ((pehandle = pefile_create()) != NULL) {
-      if ((pefile_open_file(pehandle, srcfile)) == 0) {
-        pefile_list_imports(pehandle, check_pe_dependencies, callbackdata);
-        pefile_close(pehandle);
-      }
-      pefile_destroy(pehandle);
-    }
+  //open source file
+  if ((src = open(fullpath, O_RDONLY | O_BINARY)) == -1) {
+    fprintf(stderr, "Error opening file: %s\n", fullpath);
+    return 0;
   }
-  return 0;
+  //process small files in memory and larger files via a temporary file
+  if (size <= MODIFIED_FILE_MEMORY_LIMIT)
+    status = add_modified_file_to_archive_in_memory(src, relativepath, size, mtime, replacer, callbackdata);
+  else
+    status = add_modified_file_to_archive_via_temporary_file(src, relativepath, mtime, replacer, callbackdata);
+  close(src);
+  return status;
 }
-#endif
 
 #if defined(_WIN32) && defined(LIBARCHIVE_7ZIP_AVOID_BACKSLASHES)
 char* strdup_backslash2slash(const char* path)
@@ -611,45 +1136,273 @@ char* strdup_backslash2slash(const char* path)
 }
 #endif
 
-int packager_file_callback (dirtrav_entry info)
+//determine which replacements are needed in a file (0 if the file is added without changes)
+unsigned int get_file_replace_flags (const char* path, const char* ext)
 {
-  struct packager_callback_struct* callbackdata = (struct packager_callback_struct*)info->callbackdata;
-  const char* srcfile = dirtrav_prop_get_path(info);
-#if defined(_WIN32) && defined(LIBARCHIVE_7ZIP_AVOID_BACKSLASHES)
-  char* path = strdup_backslash2slash(dirtrav_prop_get_relative_path(info));
+  size_t pathlen = (path ? strlen(path) : 0);
+  //replace absolute install path with relative path in .la files
+  if (ext && strcasecmp(ext, ".la") == 0)
+    return PKG_REPLACE_INST_REL | PKG_REPLACE_DST_REL | PKG_REPLACE_LIB_PATH | PKG_REPLACE_LIB_ARG | PKG_REPLACE_LIBDIR;
+  //replace absolute install path with relative path in .pc files
+  if (ext && strcasecmp(ext, ".pc") == 0)
+    return PKG_REPLACE_INST_REL_PC | PKG_REPLACE_DST_REL | PKG_REPLACE_LIB_PATH | PKG_REPLACE_LIB_ARG | PKG_REPLACE_LIBDIR;
+  //replace absolute install path with relative path in .cmake files
+  if (ext && strcasecmp(ext, ".cmake") == 0)
+    return PKG_REPLACE_INST_REL_CMAKE;
+  //replace absolute install path with relative path in *-config scripts
+  if (pathlen > 7 && strcasecmp(path + pathlen - 7, "-config") == 0)
+    return PKG_REPLACE_INST_SH;
+  return 0;
+}
+
+//duplicate relative path using forward slashes
+char* strdup_slashed (const char* relativepath)
+{
+  char* path;
+  char* p;
+  if (!relativepath || (path = strdup(relativepath)) == NULL)
+    return NULL;
+  p = path;
+  while ((p = strchr(p, '\\')) != NULL)
+    *p++ = '/';
+  return path;
+}
+
+//add relative path to file or folder list for the repository index (using forward slashes and without trailing slash)
+void add_path_to_list (sorted_unique_list* list, const char* relativepath)
+{
+  char* path;
+  size_t pathlen;
+  if (!list || (path = strdup_slashed(relativepath)) == NULL)
+    return;
+  if ((pathlen = strlen(path)) > 0 && path[pathlen - 1] == '/')
+    path[pathlen - 1] = 0;
+  if (*path)
+    sorted_unique_list_add_allocated(list, path);
+  else
+    free(path);
+}
+
+//information collected about a file before the metadata is written (filled in by worker threads)
+struct package_contents_job_struct {
+  const struct package_inventory_entry_struct* entry;
+  char sha256[SHA256_HEX_SIZE];         //empty if not calculated
+#ifndef NO_PEDEPS
+  char* peimports;                      //newline separated list of imported DLLs (NULL if not a PE file or on error)
+  int pecached;                         //non-zero if peimports was found in the PE import cache
+#endif
+};
+
+struct package_contents_queue_struct {
+  struct package_contents_job_struct* jobs;
+  size_t count;
+  size_t next;
+  int checkdeps;
+#ifndef NO_PEDEPS
+  pecache_handle pecache;
+#endif
+  pthread_mutex_t lock;
+};
+
+#ifndef NO_PEDEPS
+static int is_pe_file (const char* ext)
+{
+  return (ext && (strcasecmp(ext, ".exe") == 0 || strcasecmp(ext, ".dll") == 0));
+}
+
+struct pe_imports_struct {
+  struct memory_buffer* imports;
+  char* lastmodule;
+};
+
+static int collect_pe_import (const char* modulename, const char* functionname, void* callbackdata)
+{
+  struct pe_imports_struct* data = (struct pe_imports_struct*)callbackdata;
+  if (!data->lastmodule || strcasecmp(modulename, data->lastmodule) != 0) {
+    free(data->lastmodule);
+    data->lastmodule = strdup(modulename);
+    memory_buffer_append_printf(data->imports, "%s\n", modulename);
+  }
+  return 0;
+}
+
+//get newline separated list of DLLs imported by PE file (returns NULL on error, caller must free() the result)
+static char* get_pe_imports (const char* path)
+{
+  pefile_handle pehandle;
+  struct pe_imports_struct data;
+  char* result = NULL;
+  if ((pehandle = pefile_create()) != NULL) {
+    if ((pefile_open_file(pehandle, path)) == 0) {
+      data.imports = memory_buffer_create();
+      data.lastmodule = NULL;
+      pefile_list_imports(pehandle, collect_pe_import, &data);
+      free(data.lastmodule);
+      result = memory_buffer_free_to_allocated_string(data.imports);
+      if (!result)
+        result = strdup("");
+      pefile_close(pehandle);
+    }
+    pefile_destroy(pehandle);
+  }
+  return result;
+}
+
+//add each entry of newline separated list to sorted list
+static void add_lines_to_list (sorted_unique_list* list, const char* lines)
+{
+  const char* p;
+  while (lines && *lines) {
+    if ((p = strchr(lines, '\n')) == NULL)
+      p = lines + strlen(lines);
+    if (p > lines)
+      sorted_unique_list_add_buf(list, lines, p - lines);
+    lines = (*p ? p + 1 : p);
+  }
+}
+#endif
+
+//worker thread calculating hashes and listing DLL imports
+static void* package_contents_thread (struct package_contents_queue_struct* queue)
+{
+  struct package_contents_job_struct* job;
+  while (1) {
+    //get next file
+    pthread_mutex_lock(&queue->lock);
+    job = (queue->next < queue->count ? &queue->jobs[queue->next++] : NULL);
+    pthread_mutex_unlock(&queue->lock);
+    if (!job)
+      break;
+    //get hash of files that are added without changes
+    if (get_file_replace_flags(job->entry->relativepath, job->entry->extension) == 0) {
+      if (sha256_file(job->entry->fullpath, job->sha256) != 0)
+        job->sha256[0] = 0;
+    }
+#ifndef NO_PEDEPS
+    //get DLL imports of PE files (from cache if possible)
+    if (queue->checkdeps && is_pe_file(job->entry->extension)) {
+      if (queue->pecache && job->sha256[0]) {
+        pthread_mutex_lock(&queue->lock);
+        job->peimports = pecache_get_imports(queue->pecache, job->sha256);
+        pthread_mutex_unlock(&queue->lock);
+        job->pecached = (job->peimports != NULL);
+      }
+      if (!job->peimports)
+        job->peimports = get_pe_imports(job->entry->fullpath);
+    }
+#endif
+  }
+  return NULL;
+}
+
+//collect information about package contents before the metadata is written (file hashes and DLL dependencies) using multiple threads
+int collect_package_contents (struct package_inventory_struct* inventory, struct packager_callback_struct* callbackdata, int numthreads, const char* pecachepath)
+{
+  size_t i;
+  size_t j;
+  pthread_t* threads;
+  struct package_contents_queue_struct queue;
+  //list files to process
+  if ((queue.jobs = (struct package_contents_job_struct*)calloc(inventory->count + 1, sizeof(struct package_contents_job_struct))) == NULL)
+    return 1;
+  queue.count = 0;
+  for (i = 0; i < inventory->count; i++) {
+    if (inventory->entries[i].type == inventory_file)
+      queue.jobs[queue.count++].entry = &inventory->entries[i];
+  }
+  queue.next = 0;
+#ifndef NO_PEDEPS
+  queue.checkdeps = (callbackdata->pedeps != NULL);
+  queue.pecache = NULL;
+  if (queue.checkdeps && pecachepath && *pecachepath && (queue.pecache = pecache_open(pecachepath)) == NULL)
+    fprintf(stderr, "Error opening PE import cache: %s\n", pecachepath);
 #else
-  const char* path = dirtrav_prop_get_relative_path(info);
+  queue.checkdeps = 0;
 #endif
-  size_t pathlen = (path ? strlen(path) : 0);
-  const char* ext = dirtrav_prop_get_extension(info);
-  int status = 0;
-  if (ext && strcasecmp(ext, ".la") == 0) {
-    //replace absolute install path with relative path in .la files
-    if (callbackdata->verbose) {
-      printf("Adding customized file: %s\n", path);
-      fflush(stdout);
+  pthread_mutex_init(&queue.lock, NULL);
+  //process files
+  if (numthreads <= 0)
+    numthreads = get_processor_count();
+  if ((size_t)numthreads > queue.count)
+    numthreads = (queue.count > 0 ? queue.count : 1);
+  if (numthreads > 1 && (threads = (pthread_t*)malloc(numthreads * sizeof(pthread_t))) != NULL) {
+    for (j = 0; j < (size_t)numthreads; j++) {
+      if (pthread_create(&threads[j], NULL, (void*(*)(void*))package_contents_thread, &queue) != 0)
+        break;
     }
-    status = add_modified_file_to_archive(srcfile, path, PKG_REPLACE_INST_REL | PKG_REPLACE_DST_REL | PKG_REPLACE_LIB_PATH | PKG_REPLACE_LIB_ARG | PKG_REPLACE_LIBDIR, callbackdata);
-  } else if (ext && strcasecmp(ext, ".pc") == 0) {
-    //replace absolute install path with relative path in .pc files
-    if (callbackdata->verbose) {
-      printf("Adding customized file: %s\n", path);
-      fflush(stdout);
+    //process any remaining files in this thread (in case threads couldn't be created)
+    package_contents_thread(&queue);
+    while (j-- > 0)
+      pthread_join(threads[j], NULL);
+    free(threads);
+  } else {
+    package_contents_thread(&queue);
+  }
+  pthread_mutex_destroy(&queue.lock);
+  //store results (in original order)
+#ifndef NO_PEDEPS
+  size_t pefiles = 0;
+  size_t pecached = 0;
+  if (queue.pecache)
+    pecache_begin_update(queue.pecache);
+#endif
+  for (i = 0; i < queue.count; i++) {
+    const struct package_inventory_entry_struct* entry = queue.jobs[i].entry;
+    if (queue.jobs[i].sha256[0]) {
+      char* path;
+      if ((path = strdup_slashed(entry->relativepath)) != NULL) {
+        package_metadata_set_file_info(callbackdata->pkginfo, path, queue.jobs[i].sha256, entry->size);
+        free(path);
+      }
     }
-    status = add_modified_file_to_archive(srcfile, path, PKG_REPLACE_INST_REL_PC | PKG_REPLACE_DST_REL | PKG_REPLACE_LIB_PATH | PKG_REPLACE_LIB_ARG | PKG_REPLACE_LIBDIR, callbackdata);
-  } else if (ext && strcasecmp(ext, ".cmake") == 0) {
-    //replace absolute install path with relative path in .cmake files
-    if (callbackdata->verbose) {
-      printf("Adding customized file: %s\n", path);
-      fflush(stdout);
+#ifndef NO_PEDEPS
+    if (queue.checkdeps && is_pe_file(entry->extension)) {
+      pefiles++;
+      //add PE file to list of own modules
+      if (strcasecmp(entry->extension, ".exe") != 0)
+        sorted_unique_list_add(callbackdata->ownpemodules, entry->name);
+      if (queue.jobs[i].peimports) {
+        add_lines_to_list(callbackdata->pedeps, queue.jobs[i].peimports);
+        if (queue.jobs[i].pecached)
+          pecached++;
+        else if (queue.pecache && queue.jobs[i].sha256[0])
+          pecache_set_imports(queue.pecache, queue.jobs[i].sha256, queue.jobs[i].peimports);
+      }
+      free(queue.jobs[i].peimports);
     }
-    status = add_modified_file_to_archive(srcfile, path, PKG_REPLACE_INST_REL_CMAKE, callbackdata);
-  } else if (pathlen > 7 && strcasecmp(path + pathlen - 7, "-config") == 0) {
-    //replace absolute install path with relative path in *-config scripts
+#endif
+  }
+#ifndef NO_PEDEPS
+  if (queue.pecache) {
+    pecache_end_update(queue.pecache);
+    pecache_close(queue.pecache);
+  }
+  if (callbackdata->verbose && queue.checkdeps)
+    printf("PE files checked for dependencies: %lu (%lu from cache)\n", (unsigned long)pefiles, (unsigned long)pecached);
+#endif
+  free(queue.jobs);
+  return 0;
+}
+
+int packager_file_callback (const struct package_inventory_entry_struct* entry, void* data)
+{
+  struct packager_callback_struct* callbackdata = (struct packager_callback_struct*)data;
+  const char* srcfile = entry->fullpath;
+#if defined(_WIN32) && defined(LIBARCHIVE_7ZIP_AVOID_BACKSLASHES)
+  char* path = strdup_backslash2slash(entry->relativepath);
+#else
+  const char* path = entry->relativepath;
+#endif
+  const char* ext = entry->extension;
+  unsigned int replace_flags;
+  int status = 0;
+  if ((replace_flags = get_file_replace_flags(path, ext)) != 0) {
+    //replace absolute install path with relative path
     if (callbackdata->verbose) {
+      printf("Adding customized file: %s\n", path);
       fflush(stdout);
     }
-    status = add_modified_file_to_archive(srcfile, path, PKG_REPLACE_INST_SH, callbackdata);
+    status = add_modified_file_to_archive(srcfile, path, entry->size, entry->mtime, replace_flags, callbackdata);
   } else {
     //add any other file without changes
 /*
@@ -658,7 +1411,7 @@ int packager_file_callback (dirtrav_entry info)
       pefile_handle pehandle;
       //add PE file to list of own modules
       if (strcasecmp(ext, ".exe") != 0) {
-        sorted_unique_list_add(callbackdata->ownpemodules, dirtrav_prop_get_name(info));
+        sorted_unique_list_add(callbackdata->ownpemodules, entry->name);
       }
       //check PE file for dependencies
       if ((pehandle = pefile_create()) != NULL) {
@@ -675,8 +1428,10 @@ int packager_file_callback (dirtrav_entry info)
       printf("Adding file: %s\n", path);
       fflush(stdout);
     }
-    status = add_file_to_archive(srcfile, path, callbackdata);
+    status = add_file_to_archive(srcfile, path, entry->size, entry->mtime, callbackdata);
   }
+  if (status != 0 && callbackdata->pkginfo)
+    add_path_to_list(callbackdata->pkginfo->filelist, path);
   if (status == 0) {
     fprintf(stderr, "Error adding file: %s\n", path);
 #if defined(_WIN32) && defined(LIBARCHIVE_7ZIP_AVOID_BACKSLASHES)
@@ -691,27 +1446,28 @@ int packager_file_callback (dirtrav_entry info)
   return 0;
 }
 
-int packager_before_folder_callback (dirtrav_entry info)
+int packager_before_folder_callback (const struct package_inventory_entry_struct* entry, void* data)
 {
-  struct packager_callback_struct* callbackdata = (struct packager_callback_struct*)info->callbackdata;
+  struct packager_callback_struct* callbackdata = (struct packager_callback_struct*)data;
   //create folder
-  add_folder_to_archive(dirtrav_prop_get_relative_path(info), callbackdata);
+  if (add_folder_to_archive(entry->relativepath, entry->mtime, callbackdata) > 0 && callbackdata->pkginfo)
+    add_path_to_list(callbackdata->pkginfo->folderlist, entry->relativepath);
   //keep track of nesting level
-  ((struct packager_callback_struct*)info->callbackdata)->level++;
+  callbackdata->level++;
   return 0;
 }
 
-int packager_after_folder_callback (dirtrav_entry info)
+int packager_after_folder_callback (const struct package_inventory_entry_struct* entry, void* data)
 {
   //keep track of nesting level
-  ((struct packager_callback_struct*)info->callbackdata)->level--;
+  ((struct packager_callback_struct*)data)->level--;
   return 0;
 }
 
-int delete_file_callback (dirtrav_entry info)
+int delete_file_callback (const struct package_inventory_entry_struct* entry, void* callbackdata)
 {
 #ifdef _WIN32
-  if (!DeleteFileA(dirtrav_prop_get_path(info))) {
+  if (!DeleteFileA(entry->fullpath)) {
 /*
   const char* fullpath = dirtrav_prop_get_path(info);
   size_t fullpathlen = strlen(fullpath);
@@ -728,23 +1484,23 @@ int delete_file_callback (dirtrav_entry info)
   }
 */
 #else
-  if (unlink(dirtrav_prop_get_path(info)) != 0) {
+  if (unlink(entry->fullpath) != 0) {
 #endif
-    ++*(size_t*)info->callbackdata;
-    fprintf(stderr, "Error deleting file: %s\n", dirtrav_prop_get_path(info));
+    ++*(size_t*)callbackdata;
+    fprintf(stderr, "Error deleting file: %s\n", entry->fullpath);
   }
   return 0;
 }
 
-int delete_after_folder_callback (dirtrav_entry info)
+int delete_after_folder_callback (const struct package_inventory_entry_struct* entry, void* callbackdata)
 {
 #ifdef _WIN32
-  if (!RemoveDirectoryA(dirtrav_prop_get_path(info))) {
+  if (!RemoveDirectoryA(entry->fullpath)) {
 #else
-  if (rmdir(dirtrav_prop_get_path(info)) != 0) {
+  if (rmdir(entry->fullpath) != 0) {
 #endif
-    ++*(size_t*)info->callbackdata;
-    fprintf(stderr, "Error deleting folder: %s\n", dirtrav_prop_get_path(info));
+    ++*(size_t*)callbackdata;
+    fprintf(stderr, "Error deleting folder: %s\n", entry->fullpath);
   }
   return 0;
 }
@@ -972,20 +1728,102 @@ void csv_entries_append (struct memory_buffer* metadata, const char* list, const
   }
 }
 
+void csv_entries_add_to_list (sorted_unique_list* list, const char* csvlist)
+{
+  const char* p;
+  const char* q;
+  char* entry;
+  if (!list)
+    return;
+  p = csvlist;
+  while (p && *p) {
+    q = p;
+    while (*q && *q != ',')
+      q++;
+    if (q > p && (entry = (char*)malloc(q - p + 1)) != NULL) {
+      memcpy(entry, p, q - p);
+      entry[q - p] = 0;
+      sorted_unique_list_add_allocated(list, entry);
+    }
+    p = q;
+    if (*p)
+      p++;
+  }
+}
+
+#ifndef NO_PEDEPS
+//find installed packages providing DLLs imported by the package that are not listed as mandatory or optional dependencies (returns NULL if the package database is not available)
+sorted_unique_list* find_missing_dll_dependencies (struct packager_callback_struct* callbackdata, const char* dstdir, const char* packagename)
+{
+  size_t i;
+  char* owner;
+  const char* modulename;
+  pkgdb_handle db;
+  struct memory_buffer* path;
+  sorted_unique_list* declared;
+  sorted_unique_list* optional;
+  sorted_unique_list* missing;
+  //only use the package database if it exists (don't create it)
+  path = memory_buffer_create();
+  memory_buffer_set_printf(path, "%s%c%s%c%s", dstdir, PATH_SEPARATOR, PACKAGE_DATABASE_PATH, PATH_SEPARATOR, PACKAGE_DATABASE_FILE);
+  if (!file_exists(memory_buffer_get(path)) || (db = pkgdb_open(dstdir)) == NULL) {
+    if (callbackdata->verbose)
+      printf("No package database found, not checking which packages provide the DLL dependencies\n");
+    memory_buffer_free(path);
+    return NULL;
+  }
+  //get dependencies specified for the package
+  declared = sorted_unique_list_create(strcasecmp, free);
+  csv_entries_add_to_list(declared, getenv("DEPENDENCIES"));
+  csv_entries_add_to_list(declared, getenv("DEPENDANCIES"));
+  optional = sorted_unique_list_create(strcasecmp, free);
+  csv_entries_add_to_list(optional, getenv("OPTIONALDEPENDENCIES"));
+  csv_entries_add_to_list(optional, getenv("OPTIONALDEPENDANCIES"));
+  //look up which installed package provides each DLL
+  missing = sorted_unique_list_create(strcasecmp, free);
+  for (i = 0; (modulename = sorted_unique_list_get(callbackdata->pedeps, i)) != NULL; i++) {
+    if (sorted_unique_list_find(callbackdata->ownpemodules, modulename))
+      continue;
+    memory_buffer_set_printf(path, "bin/%s", modulename);
+    if ((owner = pkgdb_find_file_package(db, memory_buffer_get(path))) == NULL) {
+      if (callbackdata->verbose)
+        printf("DLL not provided by any installed package: %s\n", modulename);
+      continue;
+    }
+    if (strcasecmp(owner, packagename) != 0 && !sorted_unique_list_find(declared, owner) && !sorted_unique_list_find(optional, owner)) {
+      if (!sorted_unique_list_find(missing, owner))
+        fprintf(stderr, "Missing dependency: %s (provides %s)\n", owner, modulename);
+      sorted_unique_list_add(missing, owner);
+    } else if (callbackdata->verbose && sorted_unique_list_find(optional, owner)) {
+      printf("DLL %s provided by optional dependency: %s\n", modulename, owner);
+    } else if (callbackdata->verbose) {
+      printf("DLL %s provided by package: %s\n", modulename, owner);
+    }
+    free(owner);
+  }
+  sorted_unique_list_free(declared);
+  sorted_unique_list_free(optional);
+  memory_buffer_free(path);
+  pkgdb_close(db);
+  return missing;
+}
+#endif
+
 struct metadata_envvar_info_struct {
   const char* envvar;
   const char* xmlattr;
+  int index;
 };
 
 struct metadata_envvar_info_struct metadata_envvar_info[] = {
-  {"NAME", "name"},
-  {"DESCRIPTION", "description"},
-  {"URL", "url"},
-  {"DOWNLOADURL", "downloadurl"},
-  {"DOWNLOADSOURCEURL", "downloadsourceurl"},
-  {"CATEGORY", "category"},
-  {"TYPE", "type"},
-  {"VERSIONDATE", "versiondate"},
+  {"NAME", "name", PACKAGE_METADATA_INDEX_NAME},
+  {"DESCRIPTION", "description", PACKAGE_METADATA_INDEX_DESCRIPTION},
+  {"URL", "url", PACKAGE_METADATA_INDEX_URL},
+  {"DOWNLOADURL", "downloadurl", PACKAGE_METADATA_INDEX_DOWNLOADURL},
+  {"DOWNLOADSOURCEURL", "downloadsourceurl", PACKAGE_METADATA_INDEX_DOWNLOADSOURCEURL},
+  {"CATEGORY", "category", PACKAGE_METADATA_INDEX_CATEGORY},
+  {"TYPE", "type", PACKAGE_METADATA_INDEX_TYPE},
+  {"VERSIONDATE", "versiondate", PACKAGE_METADATA_INDEX_VERSIONDATE},
 /*
   {"DEPENDENCIES", "dependencies"},
   {"DEPENDANCIES", "dependencies"},
@@ -996,12 +1834,36 @@ struct metadata_envvar_info_struct metadata_envvar_info[] = {
   {"OPTIONALBUILDDEPENDENCIES", "optionalbuilddependencies"},
   {"OPTIONALBUILDDEPENDANCIES", "optionalbuilddependencies"},
 */
-  {"LICENSEFILE", "licensefile"},
-  {"LICENSETYPE", "licensetype"},
-  {"STATUS", "status"},
-  {NULL, NULL}
+  {"LICENSEFILE", "licensefile", PACKAGE_METADATA_INDEX_LICENSEFILE},
+  {"LICENSETYPE", "licensetype", PACKAGE_METADATA_INDEX_LICENSETYPE},
+  {"STATUS", "status", PACKAGE_METADATA_INDEX_STATUS},
+  {NULL, NULL, -1}
 };
 
+//add license folder and file and the package contents to the archive (or compare them with the previous package file)
+int add_package_contents_to_archive (struct package_inventory_struct* inventory, const char* licfile, const char* packagename, struct packager_callback_struct* callbackdata)
+{
+  //add licence folder and file to archive
+  if (add_folder_to_archive(PACKAGE_INFO_LICENSE_FOLDER, 0, callbackdata) > 0 && licfile && *licfile) {
+    struct memory_buffer* relativepath = memory_buffer_create();
+    memory_buffer_set(relativepath, PACKAGE_INFO_LICENSE_FOLDER "/");
+    memory_buffer_append(relativepath, packagename);
+    memory_buffer_append(relativepath, "/");
+    memory_buffer_append(relativepath, licfile);
+    if (callbackdata->verbose) {
+      printf("Adding license file: %s\n", licfile);
+      fflush(stdout);
+    }
+    if (add_file_to_archive(licfile, memory_buffer_get(relativepath), -1, 0, callbackdata) == 0) {
+      fprintf(stderr, "Error adding license file: %s\n", licfile);
+    }
+    memory_buffer_free(relativepath);
+  }
+
+  //add files to archive
+  return package_inventory_iterate(inventory, packager_file_callback, packager_before_folder_callback, packager_after_folder_callback, callbackdata);
+}
+
 int main (int argc, char** argv, char *envp[])
 {
   //process command line parameters
@@ -1020,9 +1882,20 @@ int main (int argc, char** argv, char *envp[])
   struct fstab_data_struct* fstabdata = NULL;
 #ifndef NO_PEDEPS
   int checkdeps = 0;
+  int adddeps = 0;
 #endif
   int deleteafter = 0;
+  int updateindex = 0;
+  int incremental = 0;
+  int keepprevious = 0;
   int verbose = 0;
+  const char* formatname = NULL;
+  int compressionlevel = -1;
+  int threads = 0;
+  const char* pecachepath = NULL;
+  const char* sourcedateepoch = NULL;
+  int64_t epoch = -1;
+  const struct package_archive_format_struct* format;
   struct strings_linked_list* dst_paths = NULL;
   char* packagefilename = NULL;
   //definition of command line arguments
@@ -1038,8 +1911,15 @@ int main (int argc, char** argv, char *envp[])
     {'l', "license",         "FILE",    miniargv_cb_set_const_str, &licfile,         "relative path of license file\noverrides environment variable LICENSEFILE", NULL},
 #ifndef NO_PEDEPS
     {'c', "dependencies",    NULL,      miniargv_cb_increment_int, &checkdeps,       "check for DLL dependencies and list them", NULL},
+    {'A', "add-dependencies", NULL,     miniargv_cb_increment_int, &adddeps,         "like -c and also add installed packages providing these DLLs to the mandatory dependencies if missing\n(with only -c missing dependencies are reported, packages listed as optional dependencies are not added)", NULL},
+    {'C', "pe-cache",        "FILE",    miniargv_cb_set_const_str, &pecachepath,     "cache file for DLL imports of PE files checked with -c (created if needed)\noverrides environment variable PECACHE", NULL},
 #endif
     {'d', "delete",          NULL,      miniargv_cb_increment_int, &deleteafter,     "delete original package content files after creating package", NULL},
+    {'r', "repository-index", NULL,     miniargv_cb_increment_int, &updateindex,     "add package to repository index in package path (" PACKAGE_REPOSITORY_INDEX_FILE ")", NULL},
+    {'I', "incremental",     NULL,      miniargv_cb_increment_int, &incremental,     "keep existing package file if its contents are identical (compared using the file hashes in its package information)\nif anything changed the entire package file is still created again", NULL},
+    {'F', "format",          "FORMAT",  miniargv_cb_set_const_str, &formatname,      "package file format: " PACKAGE_ARCHIVE_FORMAT_LIST " (default: " PACKAGE_ARCHIVE_DEFAULT_FORMAT ")\noverrides environment variable PACKAGEFORMAT", NULL},
+    {'L', "compression-level", "LEVEL", miniargv_cb_set_int,       &compressionlevel, "compression level (default depends on format)\noverrides environment variable PACKAGECOMPRESSIONLEVEL", NULL},
+    {'j', "threads",         "N",       miniargv_cb_set_int,       &threads,         "number of threads for hashing and checking files and for tar.zst and tar.xz compression (default: 0 = number of processors)\noverrides environment variable PACKAGETHREADS", NULL},
     {'v', "verbose",         NULL,      miniargv_cb_increment_int, &verbose,         "verbose mode", NULL},
     {0,   NULL,              "PACKAGE", miniargv_cb_set_const_str, &packagename,     "package name\noverrides environment variable BASENAME", NULL},
     MINIARGV_DEFINITION_END
@@ -1053,6 +1933,13 @@ int main (int argc, char** argv, char *envp[])
     {0,   "MINGWPREFIX",     NULL,      miniargv_cb_strdup,        &dstdir,          "package installation path", NULL},
     {0,   "RUNPLATFORM",     NULL,      miniargv_cb_strdup,        &arch,            "target architecture (i686-w64-mingw32 / x86_64-w64-mingw32)\nonly the part up to the first \"-\" is used", NULL},
     {0,   "LICENSEFILE",     NULL,      miniargv_cb_set_const_str, &licfile,         "relative path of license file", NULL},
+    {0,   "PACKAGEFORMAT",   NULL,      miniargv_cb_set_const_str, &formatname,      "package file format", NULL},
+    {0,   "PACKAGECOMPRESSIONLEVEL", NULL, miniargv_cb_set_int,    &compressionlevel, "compression level", NULL},
+    {0,   "PACKAGETHREADS",  NULL,      miniargv_cb_set_int,       &threads,         "number of threads", NULL},
+    {0,   "SOURCE_DATE_EPOCH", NULL,    miniargv_cb_set_const_str, &sourcedateepoch, "reproducible mode: timestamp (seconds since 1970-01-01) stored for all files (or their modification time if older)", NULL},
+#ifndef NO_PEDEPS
+    {0,   "PECACHE",         NULL,      miniargv_cb_set_const_str, &pecachepath,     "cache file for DLL imports of PE files", NULL},
+#endif
     MINIARGV_DEFINITION_END
   };
   //parse environment and command line flags
@@ -1134,6 +2021,20 @@ int main (int argc, char** argv, char *envp[])
     pkgdir = strdup(s);
   }
 #endif
+  if ((format = package_archive_get_format(formatname)) == NULL) {
+    fprintf(stderr, "Unsupported package file format: %s (supported formats: %s)\n", formatname, PACKAGE_ARCHIVE_FORMAT_LIST);
+    return 11;
+  }
+  if (sourcedateepoch && *sourcedateepoch) {
+    char* end;
+    epoch = strtoll(sourcedateepoch, &end, 10);
+    if (*end || epoch < 0) {
+      fprintf(stderr, "Invalid value for SOURCE_DATE_EPOCH: %s\n", sourcedateepoch);
+      return 12;
+    }
+    if (verbose)
+      printf("Reproducible mode, timestamps clamped to: %" PRId64 "\n", epoch);
+  }
   if (!fstabpath)
     fstabpath = get_fstab_path();
   if (fstabpath && *fstabpath) {
@@ -1167,10 +2068,11 @@ int main (int argc, char** argv, char *envp[])
     printf("Package installation folder: %s\n", dstdir);
     printf("Package file destination folder: %s\n", pkgdir);
     printf("Full path to fstab file: %s\n", fstabpath);
+    printf("Package file format: %s\n", format->name);
   }
 
   //determine package filename
-  packagefilename = (char*)malloc(strlen(pkgdir) + strlen(packagename) + (packageversion ? strlen(packageversion) + 1 : 0) + strlen(arch) + strlen(PACKAGE_EXTENSION) + 3);
+  packagefilename = (char*)malloc(strlen(pkgdir) + strlen(packagename) + (packageversion ? strlen(packageversion) + 1 : 0) + strlen(arch) + strlen(format->extension) + 3);
   strcpy(packagefilename, pkgdir);
 #ifdef _WIN32
   strcat(packagefilename, "\\");
@@ -1184,60 +2086,40 @@ int main (int argc, char** argv, char *envp[])
   }
   strcat(packagefilename, ".");
   strcat(packagefilename, arch);
-  strcat(packagefilename, PACKAGE_EXTENSION);
+  strcat(packagefilename, format->extension);
   printf("Creating package: %s\n", packagefilename);
 
-  //create archive
+  //get list of files and folders in source folder
   int status;
+  struct package_inventory_struct inventory;
+  if ((status = package_inventory_load(&inventory, srcdir)) != 0) {
+    fprintf(stderr, "Error reading source folder: %s\n", srcdir);
+    package_inventory_free(&inventory);
+    return 1;
+  }
+  if (verbose)
+    printf("Files and folders found: %lu\n", (unsigned long)inventory.count);
+
+  //create archive
   struct packager_callback_struct callbackdata;
   callbackdata.level = 0;
   callbackdata.verbose = verbose;
   callbackdata.srcdir = srcdir;
   callbackdata.dstdir = dstdir;
   callbackdata.fstabdata = fstabdata;
+  callbackdata.replacers = NULL;
+  callbackdata.sourcedateepoch = epoch;
+  callbackdata.previous = NULL;
+  if ((callbackdata.pkginfo = package_metadata_create()) != NULL) {
+    callbackdata.pkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME] = strdup(packagename);
+    callbackdata.pkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION] = strdup(packageversion);
+  }
 #ifndef NO_PEDEPS
+  if (adddeps)
+    checkdeps = 1;
   callbackdata.ownpemodules = (checkdeps ? sorted_unique_list_create(strcasecmp, free) : NULL);
   callbackdata.pedeps = (checkdeps ? sorted_unique_list_create(strcasecmp, free) : NULL);
-  callbackdata.pelastmodule = NULL;
-#endif
-  //delete archive if it already exists
-  unlink(packagefilename);
-  //create archive
-  callbackdata.arch = archive_write_new();
-#if defined(ARCHIVEFORMAT_ZIP)
-  archive_write_set_format_zip(callbackdata.arch);  //zip archive
-#elif defined(ARCHIVEFORMAT_TAR)
-  archive_write_set_format_pax_restricted(callbackdata.arch);  //tar archive
-#elif defined(ARCHIVEFORMAT_TAR_GZ)
-  archive_write_set_format_pax_restricted(callbackdata.arch);  //tar archive
-  archive_write_add_filter_gzip(callbackdata.arch);
-#elif defined(ARCHIVEFORMAT_TAR_BZ2)
-  archive_write_set_format_pax_restricted(callbackdata.arch);  //tar archive
-  archive_write_add_filter_bzip2(callbackdata.arch);
-#elif defined(ARCHIVEFORMAT_TAR_LZ4)
-  archive_write_set_format_pax_restricted(callbackdata.arch);  //tar archive
-  archive_write_add_filter_lz4(callbackdata.arch);  //lz4 compression
-#elif defined(ARCHIVEFORMAT_TAR_XZ)
-  archive_write_set_format_pax_restricted(callbackdata.arch);  //tar archive
-  archive_write_add_filter_xz(callbackdata.arch);
- #if ARCHIVE_VERSION_NUMBER < 3000000
-  archive_write_set_compression_xz(callbackdata.arch); //xz compression
-  archive_compressor_xz_options(callbackdata.arch, "compression-level", "9");
- #else
-  archive_write_add_filter_xz(callbackdata.arch); //xz compression
-  archive_write_set_options(callbackdata.arch, "compression-level=9");
- #endif
-#elif defined(ARCHIVEFORMAT_7Z)
-  archive_write_set_format_7zip(callbackdata.arch);  //7-zip archive
-  archive_write_set_options(callbackdata.arch, "compression-level=9");
-#else
-  archive_write_set_format_filter_by_ext(callbackdata.arch, packagefilename);
 #endif
-  if ((status = archive_write_open_filename(callbackdata.arch, packagefilename)) != 0) {
-    fprintf(stderr, "Error %i opening archive: %s\n", status, archive_error_string(callbackdata.arch));
-    return 1;
-  }
-
 #ifdef CHECK_DEPENDANCIES
   //check dependencies
   struct get_dependencies_imports depsdata;
@@ -1256,11 +2138,11 @@ int main (int argc, char** argv, char *envp[])
   }
 #endif
 
-  //add metadata file to archive
+  //generate metadata file
+  struct memory_buffer* metadata;
   {
     int i;
     struct memory_buffer* t;
-    struct memory_buffer* metadata;
     t = memory_buffer_create();
     metadata = memory_buffer_create();
     memory_buffer_set(metadata, "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n");
@@ -1276,10 +2158,17 @@ int main (int argc, char** argv, char *envp[])
           printf("Attribute[%s]: %s\n", metadata_envvar_info[i].xmlattr, s);
         }
         memory_buffer_append_printf(metadata, " %s=\"%s\"", metadata_envvar_info[i].xmlattr, memory_buffer_get(memory_buffer_xml_special_chars(memory_buffer_set(t, s))));
+        if (callbackdata.pkginfo)
+          callbackdata.pkginfo->datafield[metadata_envvar_info[i].index] = strdup(s);
       }
       i++;
     }
     memory_buffer_append(metadata, ">\n");
+    collect_package_contents(&inventory, &callbackdata, threads, pecachepath);
+#ifndef NO_PEDEPS
+    //check which installed packages provide the DLL dependencies
+    sorted_unique_list* missingdeps = (callbackdata.pedeps ? find_missing_dll_dependencies(&callbackdata, dstdir, packagename) : NULL);
+#endif
     memory_buffer_append(metadata, "\t<dependencies>\n");
     csv_entries_append(metadata, getenv("DEPENDENCIES"), "\t\t<dependency type=\"mandatory\" name=\"", "\"/>\n");
     csv_entries_append(metadata, getenv("DEPENDANCIES"), "\t\t<dependency type=\"mandatory\" name=\"", "\"/>\n");
@@ -1289,9 +2178,31 @@ int main (int argc, char** argv, char *envp[])
     csv_entries_append(metadata, getenv("BUILDDEPENDANCIES"), "\t\t<dependency type=\"build\" name=\"", "\"/>\n");
     csv_entries_append(metadata, getenv("OPTIONALBUILDDEPENDENCIES"), "\t\t<dependency type=\"optionalbuild\" name=\"", "\"/>\n");
     csv_entries_append(metadata, getenv("OPTIONALBUILDDEPENDANCIES"), "\t\t<dependency type=\"optionalbuild\" name=\"", "\"/>\n");
+#ifndef NO_PEDEPS
+    if (missingdeps && adddeps) {
+      unsigned int j;
+      const char* dependency;
+      for (j = 0; (dependency = sorted_unique_list_get(missingdeps, j)) != NULL; j++) {
+        printf("Adding dependency: %s\n", dependency);
+        memory_buffer_append_printf(metadata, "\t\t<dependency type=\"mandatory\" name=\"%s\"/>\n", memory_buffer_get(memory_buffer_xml_special_chars(memory_buffer_set(t, dependency))));
+        if (callbackdata.pkginfo)
+          sorted_unique_list_add(callbackdata.pkginfo->dependencies, dependency);
+      }
+    }
+    sorted_unique_list_free(missingdeps);
+#endif
     memory_buffer_append(metadata, "\t</dependencies>\n");
+    if (callbackdata.pkginfo) {
+      csv_entries_add_to_list(callbackdata.pkginfo->dependencies, getenv("DEPENDENCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->dependencies, getenv("DEPENDANCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->optionaldependencies, getenv("OPTIONALDEPENDENCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->optionaldependencies, getenv("OPTIONALDEPENDANCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->builddependencies, getenv("BUILDDEPENDENCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->builddependencies, getenv("BUILDDEPENDANCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->optionalbuilddependencies, getenv("OPTIONALBUILDDEPENDENCIES"));
+      csv_entries_add_to_list(callbackdata.pkginfo->optionalbuilddependencies, getenv("OPTIONALBUILDDEPENDANCIES"));
+    }
 #ifndef NO_PEDEPS
-    dirtrav_traverse_directory(srcdir, check_pe_dependencies_callback, NULL, NULL, &callbackdata);
     if (callbackdata.pedeps) {
       char* modulename;
       printf("Dependencies:\n");
@@ -1305,49 +2216,86 @@ int main (int argc, char** argv, char *envp[])
       memory_buffer_append(metadata, "\t</dlldependencies>\n");
     }
 #endif
+    if (callbackdata.pkginfo && sorted_unique_list_size(callbackdata.pkginfo->fileinfo) > 0) {
+      unsigned int j;
+      const struct package_file_info_struct* fileinfo;
+      memory_buffer_append(metadata, "\t<files>\n");
+      for (j = 0; (fileinfo = (const struct package_file_info_struct*)sorted_unique_list_get(callbackdata.pkginfo->fileinfo, j)) != NULL; j++)
+        memory_buffer_append_printf(metadata, "\t\t<file name=\"%s\" size=\"%" PRIu64 "\" sha256=\"%s\"/>\n", memory_buffer_get(memory_buffer_xml_special_chars(memory_buffer_set(t, fileinfo->path))), fileinfo->size, fileinfo->sha256);
+      memory_buffer_append(metadata, "\t</files>\n");
+    }
     memory_buffer_append(metadata, "\t<exclude>\n");
     memory_buffer_append(metadata, "\t\t<file name=\".packageinfo.xml\"/>\n");
     memory_buffer_append(metadata, "\t\t<directory name=\"" PACKAGE_INFO_LICENSE_FOLDER "\"/>\n");
     memory_buffer_append(metadata, "\t</exclude>\n");
+    //record compression level if specified so incremental mode creates a new package file when it changes
+    if (compressionlevel >= 0)
+      memory_buffer_append_printf(metadata, "\t<compression level=\"%i\"/>\n", compressionlevel);
 #ifdef METADATA_CONTENTS
     memory_buffer_append(metadata, "<contents>\n");
     status = dirtrav_traverse_directory(srcdir, packagelist_file_callback, packagelist_before_folder_callback, NULL, metadata);
     memory_buffer_append(metadata, "</contents>\n");
 #endif
     memory_buffer_append(metadata, "</package>\n");
-    add_memory_to_archive(memory_buffer_get(metadata), memory_buffer_length(metadata), ".packageinfo.xml", &callbackdata);
     memory_buffer_free(t);
-    memory_buffer_free(metadata);
   }
 
-  //add licence folder and file to archive
-  if (add_folder_to_archive(PACKAGE_INFO_LICENSE_FOLDER, &callbackdata) > 0 && licfile && *licfile) {
-    struct memory_buffer* relativepath = memory_buffer_create();
-    memory_buffer_set(relativepath, PACKAGE_INFO_LICENSE_FOLDER "/");
-    memory_buffer_append(relativepath, packagename);
-    memory_buffer_append(relativepath, "/");
-    memory_buffer_append(relativepath, licfile);
-    if (callbackdata.verbose) {
-      printf("Adding license file: %s\n", licfile);
-      fflush(stdout);
-    }
-    if (add_file_to_archive(licfile, memory_buffer_get(relativepath), &callbackdata) == 0) {
-      fprintf(stderr, "Error adding license file: %s\n", licfile);
+  //compare with existing package file and keep it if nothing changed
+  if (incremental) {
+    struct stat st;
+    struct previous_package_struct* previous;
+    if (stat(packagefilename, &st) == 0) {
+      if ((previous = previous_package_load(packagefilename, memory_buffer_get(metadata), memory_buffer_length(metadata), callbackdata.pkginfo, verbose)) != NULL) {
+        callbackdata.previous = previous;
+        callbackdata.verbose = 0;
+        status = add_package_contents_to_archive(&inventory, licfile, packagename, &callbackdata);
+        callbackdata.verbose = verbose;
+        callbackdata.previous = NULL;
+        if (status == 0 && previous_package_get_changes(previous) == 0)
+          keepprevious = 1;
+        previous_package_free(previous);
+      }
+      if (keepprevious)
+        printf("Package contents unchanged, keeping existing package file\n");
+      else if (verbose)
+        printf("Package contents changed, creating new package file\n");
     }
-    memory_buffer_free(relativepath);
   }
 
-  //add files to archive
-  status = dirtrav_traverse_directory(srcdir, packager_file_callback, packager_before_folder_callback, packager_after_folder_callback, &callbackdata);
+  if (!keepprevious) {
+    //delete archive if it already exists
+    unlink(packagefilename);
+    //create archive
+    callbackdata.arch = archive_write_new();
+    if (package_archive_write_setup(callbackdata.arch, format, compressionlevel, threads) != 0) {
+      fprintf(stderr, "Error setting up %s archive: %s\n", format->name, archive_error_string(callbackdata.arch));
+      return 1;
+    }
+    if ((status = archive_write_open_filename(callbackdata.arch, packagefilename)) != 0) {
+      fprintf(stderr, "Error %i opening archive: %s\n", status, archive_error_string(callbackdata.arch));
+      return 1;
+    }
+
+    //add metadata file to archive
+    add_memory_to_archive(memory_buffer_get(metadata), memory_buffer_length(metadata), PACKAGE_INFO_METADATA_FILE, 0, &callbackdata);
 
-  //close archive
-  if (archive_write_close(callbackdata.arch) != ARCHIVE_OK)
-    fprintf(stderr, "There was an error writing to the archive\n");
+    //add license and files to archive
+    status = add_package_contents_to_archive(&inventory, licfile, packagename, &callbackdata);
+
+    //close archive
+    if (archive_write_close(callbackdata.arch) != ARCHIVE_OK) {
+      fprintf(stderr, "There was an error writing to the archive\n");
+      if (status == 0)
+        status = 1;
+    }
 #if ARCHIVE_VERSION_NUMBER < 3000000
-  archive_write_finish(callbackdata.arch);
+    archive_write_finish(callbackdata.arch);
 #else
-  archive_write_free(callbackdata.arch);
+    archive_write_free(callbackdata.arch);
 #endif
+  }
+  memory_buffer_free(metadata);
+  free_find_replace_matchers(&callbackdata);
 
 /*
   //list dependencies
@@ -1367,12 +2315,31 @@ int main (int argc, char** argv, char *envp[])
   if (verbose)
     printf("Done creating archive, status code: %i\n", status);
 
+  //add package to repository index (not if the package file may be incomplete)
+  if (updateindex && callbackdata.pkginfo && status == 0) {
+    struct stat st;
+    pkgrepo_handle repo;
+    char hash[SHA256_HEX_SIZE];
+    if (stat(packagefilename, &st) != 0 || sha256_file(packagefilename, hash) != 0) {
+      fprintf(stderr, "Error reading package file for repository index: %s\n", packagefilename);
+    } else if ((repo = pkgrepo_open(pkgdir)) == NULL) {
+      fprintf(stderr, "Error opening repository index in: %s\n", pkgdir);
+    } else {
+      if (verbose)
+        printf("Adding package to repository index\n");
+      if (pkgrepo_add_package(repo, packagefilename + strlen(pkgdir) + 1, arch, callbackdata.pkginfo, st.st_size, st.st_mtime, hash) != 0)
+        fprintf(stderr, "Error adding package to repository index: %s\n", packagefilename);
+      pkgrepo_close(repo);
+    }
+  }
+  package_metadata_free(callbackdata.pkginfo);
+
   //delete source files and directories
   if (deleteafter) {
     size_t errors = 0;
     if (verbose)
       printf("Deleting folder: %s\n", srcdir);
-    status = dirtrav_traverse_directory(srcdir, delete_file_callback, NULL, delete_after_folder_callback, &errors);
+    status = package_inventory_iterate(&inventory, delete_file_callback, NULL, delete_after_folder_callback, &errors);
 #ifdef _WIN32
     if (!RemoveDirectoryA(srcdir)) {
 #else
@@ -1386,12 +2353,11 @@ int main (int argc, char** argv, char *envp[])
   }
 
   //clean up
+  package_inventory_free(&inventory);
 #ifndef NO_PEDEPS
   if (callbackdata.pedeps) {
     sorted_unique_list_free(callbackdata.ownpemodules);
     sorted_unique_list_free(callbackdata.pedeps);
-    if (callbackdata.pelastmodule)
-      free(callbackdata.pelastmodule);
   }
 #endif
   free(arch);
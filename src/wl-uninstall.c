@@ -7,9 +7,12 @@
 #include <ctype.h>
 #include <dirent.h>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <miniargv.h>
 #include "memory_buffer.h"
 #include "filesystem.h"
+#include "sorted_unique_list.h"
 #include "pkgdb.h"
 
 #define PROGRAM_NAME    "wl-uninstall"
@@ -18,22 +21,170 @@
 #if defined(_WIN32) && !defined(__MINGW64_VERSION_MAJOR)
 #define strcasecmp _stricmp
 #endif
+#if !defined(_WIN32) && defined(AT_FDCWD)
+#define USE_UNLINKAT
+#endif
+#define DEFAULT_THREADS 4
+
+#define STRINGIZE_(value) #value
+#define STRINGIZE(value) STRINGIZE_(value)
+
+//files in the same folder are deleted together as one batch
+struct delete_batch_struct {
+  size_t first;
+  size_t count;
+  size_t folderlen;
+};
 
-void delete_file_verbose (const char* filepath, int verbose)
+struct delete_queue_struct {
+  const char* basepath;
+  const sorted_unique_list* filelist;
+  struct delete_batch_struct* batches;
+  size_t batchcount;
+  size_t nextbatch;
+  pthread_mutex_t lock;
+  int verbose;
+};
+
+//get length of folder part of relative path (0 if in root folder)
+size_t get_folder_length (const char* path)
 {
-  if (verbose >= 2)
-    printf("Deleting file: %s\n", filepath);
-  if (unlink(filepath) != 0 && verbose) {
-    fprintf(stderr, "Error deleting file: %s\n", filepath);
-  }
+  const char* p;
+  if ((p = strrchr(path, '/')) == NULL)
+    return 0;
+  return p - path;
 }
 
-int package_file_iteration_delete (pkgdb_handle handle, const char* path, void* callbackdata)
+void delete_batch (struct delete_queue_struct* queue, struct delete_batch_struct* batch)
 {
+  size_t i;
+  const char* path;
   struct memory_buffer* filepath = memory_buffer_create();
-  delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%c%s", pkgdb_get_rootpath(handle), PATH_SEPARATOR, path)), *(int*)callbackdata);
+#ifdef USE_UNLINKAT
+  //open the folder once and delete the files relative to it
+  int dirfd;
+  path = sorted_unique_list_get(queue->filelist, batch->first);
+  if (batch->folderlen)
+    memory_buffer_set_printf(filepath, "%s%c%.*s", queue->basepath, PATH_SEPARATOR, (int)batch->folderlen, path);
+  else
+    memory_buffer_set(filepath, queue->basepath);
+  if ((dirfd = open(memory_buffer_get(filepath), O_RDONLY | O_DIRECTORY)) == -1) {
+    if (queue->verbose)
+      fprintf(stderr, "Error opening folder: %s\n", memory_buffer_get(filepath));
+    memory_buffer_free(filepath);
+    return;
+  }
+#endif
+  for (i = batch->first; i < batch->first + batch->count; i++) {
+    path = sorted_unique_list_get(queue->filelist, i);
+    if (queue->verbose >= 2)
+      printf("Deleting file: %s%c%s\n", queue->basepath, PATH_SEPARATOR, path);
+#ifdef USE_UNLINKAT
+    if (unlinkat(dirfd, path + batch->folderlen + (batch->folderlen ? 1 : 0), 0) != 0 && queue->verbose)
+#else
+    if (delete_file(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%c%s", queue->basepath, PATH_SEPARATOR, path))) != 0 && queue->verbose)
+#endif
+      fprintf(stderr, "Error deleting file: %s%c%s\n", queue->basepath, PATH_SEPARATOR, path);
+  }
+#ifdef USE_UNLINKAT
+  close(dirfd);
+#endif
   memory_buffer_free(filepath);
-  return 0;
+}
+
+void* delete_thread (struct delete_queue_struct* queue)
+{
+  size_t index;
+  while (1) {
+    //take next batch from the queue
+    pthread_mutex_lock(&queue->lock);
+    index = queue->nextbatch++;
+    pthread_mutex_unlock(&queue->lock);
+    if (index >= queue->batchcount)
+      break;
+    delete_batch(queue, &queue->batches[index]);
+  }
+  return NULL;
+}
+
+//delete files using multiple threads (each thread deletes a batch of files in the same folder at a time)
+void delete_files (const char* basepath, const sorted_unique_list* filelist, int numthreads, int verbose)
+{
+  int i;
+  size_t j;
+  size_t n;
+  size_t folderlen;
+  const char* path;
+  const char* batchpath = NULL;
+  pthread_t* threads;
+  struct delete_queue_struct queue;
+  if ((n = sorted_unique_list_size(filelist)) == 0)
+    return;
+  if ((queue.batches = (struct delete_batch_struct*)malloc(n * sizeof(struct delete_batch_struct))) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    return;
+  }
+  //group consecutive files in the same folder (file list is sorted)
+  queue.batchcount = 0;
+  for (j = 0; j < n; j++) {
+    path = sorted_unique_list_get(filelist, j);
+    folderlen = get_folder_length(path);
+    if (!batchpath || folderlen != queue.batches[queue.batchcount - 1].folderlen || strncmp(path, batchpath, folderlen) != 0) {
+      batchpath = path;
+      queue.batches[queue.batchcount].first = j;
+      queue.batches[queue.batchcount].count = 0;
+      queue.batches[queue.batchcount].folderlen = folderlen;
+      queue.batchcount++;
+    }
+    queue.batches[queue.batchcount - 1].count++;
+  }
+  queue.basepath = basepath;
+  queue.filelist = filelist;
+  queue.nextbatch = 0;
+  queue.verbose = verbose;
+  pthread_mutex_init(&queue.lock, NULL);
+  if (numthreads > (int)queue.batchcount)
+    numthreads = (int)queue.batchcount;
+  if (numthreads <= 1 || (threads = (pthread_t*)malloc(numthreads * sizeof(pthread_t))) == NULL) {
+    delete_thread(&queue);
+  } else {
+    for (i = 0; i < numthreads; i++) {
+      if (pthread_create(&threads[i], NULL, (void*(*)(void*))delete_thread, &queue) != 0) {
+        fprintf(stderr, "Error creating thread\n");
+        numthreads = i;
+        break;
+      }
+    }
+    //process remaining batches in this thread if no threads could be created
+    if (numthreads == 0)
+      delete_thread(&queue);
+    for (i = 0; i < numthreads; i++)
+      pthread_join(threads[i], NULL);
+    free(threads);
+  }
+  pthread_mutex_destroy(&queue.lock);
+  free(queue.batches);
+}
+
+//delete folders that are empty, deepest first (a subfolder always sorts after its parent folder)
+void delete_empty_folders (const char* basepath, const sorted_unique_list* folderlist, int verbose)
+{
+  unsigned int i;
+  const char* path;
+  struct memory_buffer* folderpath = memory_buffer_create();
+  i = sorted_unique_list_size(folderlist);
+  while (i-- > 0) {
+    if ((path = sorted_unique_list_get(folderlist, i)) == NULL)
+      continue;
+    memory_buffer_set_printf(folderpath, "%s%c%s", basepath, PATH_SEPARATOR, path);
+    if (rmdir(memory_buffer_get(folderpath)) == 0) {
+      if (verbose >= 2)
+        printf("Deleted folder: %s\n", memory_buffer_get(folderpath));
+    } else if (verbose && folder_exists(memory_buffer_get(folderpath))) {
+      printf("Folder not empty, not deleted: %s\n", memory_buffer_get(folderpath));
+    }
+  }
+  memory_buffer_free(folderpath);
 }
 
 int main (int argc, char** argv, char *envp[])
@@ -44,12 +195,15 @@ int main (int argc, char** argv, char *envp[])
   int showversion = 0;
   int showhelp = 0;
   int verbose = 0;
+  int numthreads = DEFAULT_THREADS;
   const char* basepath = NULL;
+  sorted_unique_list* orphanedfolders;
   //definition of command line arguments
   const miniargv_definition argdef[] = {
     {'h', "help",         NULL,      miniargv_cb_increment_int, &showhelp,        "show command line help", NULL},
     {0,   "version",         NULL,   miniargv_cb_increment_int, &showversion,     "show version information", NULL},
     {'i', "install-path", "PATH",    miniargv_cb_set_const_str, &basepath,        "package installation path\noverrides environment variable MINGWPREFIX", NULL},
+    {'j', "threads",      "N",       miniargv_cb_set_int,       &numthreads,      "number of threads used to delete files (default: " STRINGIZE(DEFAULT_THREADS) ")", NULL},
     {'v', "verbose",      NULL,      miniargv_cb_increment_int, &verbose,         "verbose mode", NULL},
     {0,   NULL,           "PACKAGE", miniargv_cb_error,         NULL,             "package(s) to uninstall", NULL},
     MINIARGV_DEFINITION_END
@@ -117,8 +271,6 @@ int main (int argc, char** argv, char *envp[])
   i = 0;
   while ((i = miniargv_get_next_arg_param(i, argv, argdef, NULL)) > 0) {
     struct package_metadata_struct* installedpkginfo;
-    struct memory_buffer* pkginfopath = memory_buffer_create();
-    struct memory_buffer* filepath = memory_buffer_create();
     //get information about already installed package
     if ((installedpkginfo = pkgdb_read_package(db, argv[i])) == NULL) {
       fprintf(stderr, "Package not found: %s\n", argv[i]);
@@ -131,38 +283,25 @@ int main (int argc, char** argv, char *envp[])
       printf("Destination: %s\n", basepath);
     }
 
-    //determine package information path
-    memory_buffer_set_printf(pkginfopath, "%s%s%c%s%c", basepath, PACKAGE_INFO_PATH, PATH_SEPARATOR, installedpkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], PATH_SEPARATOR);
-    //delete version file
-    delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_VERSION_FILE)), verbose);
-    //delete file list
-    delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_CONTENT_FILE)), verbose);
-    //delete folder list
-    delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_FOLDERS_FILE)), verbose);
-    //delete dependency files
-    delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_DEPENDENCIES_FILE)), verbose);
-    delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_OPTIONALDEPENDENCIES_FILE)), verbose);
-    delete_file_verbose(memory_buffer_get(memory_buffer_set_printf(filepath, "%s%s", memory_buffer_get(pkginfopath), PACKAGE_INFO_BUILDDEPENDENCIES_FILE)), verbose);
-    //delete package information folder
-    rmdir(memory_buffer_get(pkginfopath));
-
     //delete files
-    pkgdb_interate_package_files(db, installedpkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], package_file_iteration_delete, &verbose);
-    //delete from package database
-    if ((status = pkgdb_uninstall_package(db, installedpkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME])) != 0) {
+    delete_files(pkgdb_get_rootpath(db), installedpkginfo->filelist, numthreads, verbose);
+    //delete from package database (including package information files) and get folders not used by other packages
+    orphanedfolders = sorted_unique_list_create(strcmp, free);
+    if ((status = pkgdb_uninstall_package(db, installedpkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], orphanedfolders)) != 0) {
       fprintf(stderr, "Error removing package %s from package database in: %s\n", installedpkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], basepath);
+    } else {
+      //delete folders no longer used (unless they still contain other files)
+      delete_empty_folders(pkgdb_get_rootpath(db), orphanedfolders, verbose);
     }
+    sorted_unique_list_free(orphanedfolders);
 
     //show information
     printf("Finished uninstalling %s %s\n", installedpkginfo->datafield[PACKAGE_METADATA_INDEX_BASENAME], installedpkginfo->datafield[PACKAGE_METADATA_INDEX_VERSION]);
 
     //clean up
-    memory_buffer_free(pkginfopath);
-    memory_buffer_free(filepath);
     package_metadata_free(installedpkginfo);
   }
   //clean up
   pkgdb_close(db);
   return 0;
 }
-/////TO DO: delete folders not used by any other package (what if they are not empty?)
@@ -0,0 +1,466 @@
+#include "winlibs_common.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <miniargv.h>
+#include <dirtrav.h>
+#include <pthread.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+#include "filesystem.h"
+#include "memory_buffer.h"
+#include "pkgdb.h"
+#include "sha256.h"
+
+#define PROGRAM_NAME    "wl-verify"
+#define PROGRAM_DESC    "Command line utility to verify installed files against the package database"
+
+#if defined(_WIN32) && !defined(__MINGW64_VERSION_MAJOR)
+#define strcasecmp _stricmp
+#endif
+#ifdef _WIN32
+#define pathcmp strcasecmp
+#else
+#define pathcmp strcmp
+#endif
+#define DEFAULT_THREADS 4
+
+#define STRINGIZE_(value) #value
+#define STRINGIZE(value) STRINGIZE_(value)
+
+#define SQL_SELECT_FILES "SELECT path, package, sha256, size FROM package_path WHERE type = 0"
+
+////////////////////////////////////////////////////////////////////////
+
+enum verify_status {
+  verify_unchecked,
+  verify_ok,
+  verify_unverified,
+  verify_modified,
+  verify_missing,
+  verify_error
+};
+
+struct verify_entry_struct {
+  char* path;
+  char* package;
+  char* sha256;
+  int64_t size;
+  uint64_t fileid;
+  enum verify_status status;
+};
+
+struct verify_queue_struct {
+  struct verify_entry_struct** entries;
+  size_t count;
+  size_t next;
+  pthread_mutex_t lock;
+  int hashpass;
+  const char* basepath;
+};
+
+//calculate SHA-256 hash of a file by mapping it to memory (falls back to reading the file if it can't be mapped)
+int sha256_file_mapped (const char* path, char* hex)
+{
+  struct sha256_context ctx;
+  unsigned char digest[SHA256_DIGEST_SIZE];
+  const void* data;
+  uint64_t size;
+#ifdef _WIN32
+  HANDLE src;
+  HANDLE mapping;
+  LARGE_INTEGER srcsize;
+  if ((src = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL)) == INVALID_HANDLE_VALUE)
+    return 1;
+  if (!GetFileSizeEx(src, &srcsize)) {
+    CloseHandle(src);
+    return 1;
+  }
+  size = srcsize.QuadPart;
+#else
+  int src;
+  struct stat srcinfo;
+  if ((src = open(path, O_RDONLY)) == -1)
+    return 1;
+  if (fstat(src, &srcinfo) != 0) {
+    close(src);
+    return 1;
+  }
+  size = srcinfo.st_size;
+#endif
+  sha256_init(&ctx);
+  //empty files can't be mapped
+  if (size == 0) {
+#ifdef _WIN32
+    CloseHandle(src);
+#else
+    close(src);
+#endif
+    sha256_final(&ctx, digest);
+    sha256_digest_to_hex(digest, hex);
+    return 0;
+  }
+  //map file to memory (mapping stays valid after the file is closed)
+  data = NULL;
+  if (size <= SIZE_MAX) {
+#ifdef _WIN32
+    if ((mapping = CreateFileMappingA(src, NULL, PAGE_READONLY, 0, 0, NULL)) != NULL) {
+      data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+      CloseHandle(mapping);
+    }
+#else
+    if ((data = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, src, 0)) == MAP_FAILED)
+      data = NULL;
+#ifdef MADV_SEQUENTIAL
+    else
+      madvise((void*)data, (size_t)size, MADV_SEQUENTIAL);
+#endif
+#endif
+  }
+#ifdef _WIN32
+  CloseHandle(src);
+#else
+  close(src);
+#endif
+  //read the file instead if it can't be mapped (e.g. larger than the address space)
+  if (!data)
+    return sha256_file(path, hex);
+  sha256_update(&ctx, data, (size_t)size);
+#ifdef _WIN32
+  UnmapViewOfFile(data);
+#else
+  munmap((void*)data, (size_t)size);
+#endif
+  sha256_final(&ctx, digest);
+  sha256_digest_to_hex(digest, hex);
+  return 0;
+}
+
+//check installed file: first pass checks existence and size, second pass checks content
+void verify_entry (struct verify_entry_struct* entry, const char* basepath, int hashpass)
+{
+  struct memory_buffer* fullpath = memory_buffer_create();
+  memory_buffer_set_printf(fullpath, "%s%c%s", basepath, PATH_SEPARATOR, entry->path);
+  if (!hashpass) {
+    struct stat statbuf;
+    if (stat(memory_buffer_get(fullpath), &statbuf) != 0 || !S_ISREG(statbuf.st_mode)) {
+      entry->status = verify_missing;
+    } else if (entry->size >= 0 && (uint64_t)statbuf.st_size != (uint64_t)entry->size) {
+      entry->status = verify_modified;
+    } else if (!entry->sha256) {
+      entry->status = verify_unverified;
+    } else {
+      //remember file identifier to read files in the order they are stored on disk
+      entry->fileid = statbuf.st_ino;
+    }
+  } else {
+    char hash[SHA256_HEX_SIZE];
+    if (sha256_file_mapped(memory_buffer_get(fullpath), hash) != 0)
+      entry->status = verify_error;
+    else if (strcasecmp(hash, entry->sha256) != 0)
+      entry->status = verify_modified;
+    else
+      entry->status = verify_ok;
+  }
+  memory_buffer_free(fullpath);
+}
+
+void* verify_thread (struct verify_queue_struct* queue)
+{
+  size_t index;
+  while (1) {
+    //take next file from the queue
+    pthread_mutex_lock(&queue->lock);
+    index = queue->next++;
+    pthread_mutex_unlock(&queue->lock);
+    if (index >= queue->count)
+      break;
+    verify_entry(queue->entries[index], queue->basepath, queue->hashpass);
+  }
+  return NULL;
+}
+
+//process all entries in the queue using multiple threads (entries are taken from the queue in order)
+void verify_queue_run (struct verify_queue_struct* queue, int numthreads)
+{
+  int i;
+  pthread_t* threads;
+  queue->next = 0;
+  if (numthreads > (int)queue->count)
+    numthreads = (int)queue->count;
+  if (numthreads <= 1 || (threads = (pthread_t*)malloc(numthreads * sizeof(pthread_t))) == NULL) {
+    verify_thread(queue);
+    return;
+  }
+  for (i = 0; i < numthreads; i++) {
+    if (pthread_create(&threads[i], NULL, (void*(*)(void*))verify_thread, queue) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      numthreads = i;
+      break;
+    }
+  }
+  //process remaining entries in this thread if no threads could be created
+  if (numthreads == 0)
+    verify_thread(queue);
+  for (i = 0; i < numthreads; i++)
+    pthread_join(threads[i], NULL);
+  free(threads);
+}
+
+int verify_entry_cmp_path (const void* a, const void* b)
+{
+  int result;
+  if ((result = pathcmp(((const struct verify_entry_struct*)a)->path, ((const struct verify_entry_struct*)b)->path)) != 0)
+    return result;
+  return strcmp(((const struct verify_entry_struct*)a)->package, ((const struct verify_entry_struct*)b)->package);
+}
+
+int verify_entry_cmp_fileid (const void* a, const void* b)
+{
+  const struct verify_entry_struct* entry1 = *(const struct verify_entry_struct**)a;
+  const struct verify_entry_struct* entry2 = *(const struct verify_entry_struct**)b;
+  if (entry1->fileid != entry2->fileid)
+    return (entry1->fileid < entry2->fileid ? -1 : 1);
+  return pathcmp(entry1->path, entry2->path);
+}
+
+int verify_entry_cmp_search (const void* key, const void* entry)
+{
+  return pathcmp((const char*)key, ((const struct verify_entry_struct*)entry)->path);
+}
+
+////////////////////////////////////////////////////////////////////////
+
+struct unowned_callback_struct {
+  struct verify_entry_struct* entries;
+  size_t count;
+  size_t unowned;
+};
+
+//check if relative path is in a folder used for package management (package database, staging and package information)
+int is_package_management_path (const char* path)
+{
+  static const char* folders[] = {PACKAGE_DATABASE_PATH, PACKAGE_INFO_PATH, NULL};
+  const char* p;
+  const char* q;
+  int i;
+  for (i = 0; folders[i]; i++) {
+    p = path;
+    q = folders[i] + 1;
+    while (*q && (*p == *q || ((*p == '/' || *p == '\\') && (*q == '/' || *q == '\\')))) {
+      p++;
+      q++;
+    }
+    if (!*q && (*p == '/' || *p == '\\'))
+      return 1;
+  }
+  return 0;
+}
+
+int unowned_file_callback (dirtrav_entry info)
+{
+  char* path;
+  char* p;
+  struct unowned_callback_struct* data = (struct unowned_callback_struct*)info->callbackdata;
+  if ((path = strdup(dirtrav_prop_get_relative_path(info))) == NULL)
+    return 0;
+  p = path;
+  while ((p = strchr(p, '\\')) != NULL)
+    *p++ = '/';
+  if (!is_package_management_path(path) && !bsearch(path, data->entries, data->count, sizeof(struct verify_entry_struct), verify_entry_cmp_search)) {
+    printf("unowned:  %s\n", path);
+    data->unowned++;
+  }
+  free(path);
+  return 0;
+}
+
+////////////////////////////////////////////////////////////////////////
+
+int main (int argc, char** argv, char *envp[])
+{
+  int showversion = 0;
+  int showhelp = 0;
+  int unowned = 0;
+  int quick = 0;
+  int verbose = 0;
+  int numthreads = DEFAULT_THREADS;
+  const char* basepath = NULL;
+  pkgdb_handle db;
+  sqlite3_stmt* sqlresult;
+  struct verify_entry_struct* entries = NULL;
+  size_t entrycount = 0;
+  size_t entryalloc = 0;
+  size_t i;
+  size_t counts[verify_error + 1];
+  size_t unownedcount = 0;
+  struct verify_queue_struct queue;
+  //definition of command line arguments
+  const miniargv_definition argdef[] = {
+    {'h', "help",         NULL,      miniargv_cb_increment_int, &showhelp,        "show command line help", NULL},
+    {0,   "version",      NULL,      miniargv_cb_increment_int, &showversion,     "show version information", NULL},
+    {'i', "install-path", "PATH",    miniargv_cb_set_const_str, &basepath,        "package installation path\noverrides environment variable MINGWPREFIX", NULL},
+    {'u', "unowned",      NULL,      miniargv_cb_increment_int, &unowned,         "also report files that don't belong to any installed package", NULL},
+    {'q', "quick",        NULL,      miniargv_cb_increment_int, &quick,           "only check if files exist and have the correct size (don't check contents)", NULL},
+    {'j', "threads",      "N",       miniargv_cb_set_int,       &numthreads,      "number of files to check simultaneously (default: " STRINGIZE(DEFAULT_THREADS) ")", NULL},
+    {'v', "verbose",      NULL,      miniargv_cb_increment_int, &verbose,         "verbose mode (also list unchanged files)", NULL},
+    MINIARGV_DEFINITION_END
+  };
+  //definition of environment variables
+  const miniargv_definition envdef[] = {
+    {0,   "MINGWPREFIX",  NULL,      miniargv_cb_set_const_str, &basepath,        "package installation path", NULL},
+    MINIARGV_DEFINITION_END
+  };
+  //parse environment and command line flags
+  if (miniargv_process(argv, envp, argdef, envdef, NULL, NULL) != 0)
+    return 1;
+  //show help if requested
+  if (showhelp) {
+    printf(
+      PROGRAM_NAME " - version " WINLIBS_VERSION_STRING " - " WINLIBS_LICENSE " - " WINLIBS_CREDITS "\n"
+      PROGRAM_DESC "\n"
+      "Usage: " PROGRAM_NAME " "
+    );
+    miniargv_arg_list(argdef, 1);
+    printf("\n");
+    miniargv_help(argdef, envdef, 24, 0);
+#ifdef PORTCOLCON_VERSION
+    printf(WINLIBS_HELP_COLOR);
+#endif
+    return 0;
+  }
+  //show version information if requested
+  if (showversion) {
+    printf(PROGRAM_NAME " - version " WINLIBS_VERSION_STRING " - " WINLIBS_LICENSE " - " WINLIBS_CREDITS "\n");
+    return 0;
+  }
+  //check parameters
+  if (!basepath || !*basepath) {
+    fprintf(stderr, "Missing -i parameter or MINGWPREFIX environment variable\n");
+    return 2;
+  }
+  if (!folder_exists(basepath)) {
+    fprintf(stderr, "Path does not exist: %s\n", basepath);
+    return 3;
+  }
+  //open package database (without creating it if it doesn't exist)
+  if (!pkgdb_exists(basepath) || (db = pkgdb_open(basepath)) == NULL) {
+    fprintf(stderr, "No valid package database found for: %s\n", basepath);
+    return 4;
+  }
+  //load all installed files with their expected size and hash
+  if (sqlite3_prepare_v2(pkgdb_get_sqlite3_handle(db), SQL_SELECT_FILES, -1, &sqlresult, NULL) != SQLITE_OK) {
+    fprintf(stderr, "Error reading package database\n");
+    pkgdb_close(db);
+    return 5;
+  }
+  while (pkgdb_sql_query_next_row(sqlresult) == SQLITE_ROW) {
+    if (entrycount >= entryalloc) {
+      struct verify_entry_struct* newentries;
+      entryalloc = (entryalloc ? entryalloc * 2 : 1024);
+      if ((newentries = (struct verify_entry_struct*)realloc(entries, entryalloc * sizeof(struct verify_entry_struct))) == NULL) {
+        fprintf(stderr, "Memory allocation error\n");
+        break;
+      }
+      entries = newentries;
+    }
+    entries[entrycount].path = strdup((const char*)sqlite3_column_text(sqlresult, 0));
+    entries[entrycount].package = strdup((const char*)sqlite3_column_text(sqlresult, 1));
+    entries[entrycount].sha256 = (sqlite3_column_type(sqlresult, 2) == SQLITE_NULL ? NULL : strdup((const char*)sqlite3_column_text(sqlresult, 2)));
+    entries[entrycount].size = (sqlite3_column_type(sqlresult, 3) == SQLITE_NULL ? -1 : sqlite3_column_int64(sqlresult, 3));
+    entries[entrycount].fileid = 0;
+    entries[entrycount].status = verify_unchecked;
+    entrycount++;
+  }
+  sqlite3_finalize(sqlresult);
+  pkgdb_close(db);
+  //sort by path (results are listed in this order and files in the same folder are checked together)
+  qsort(entries, entrycount, sizeof(struct verify_entry_struct), verify_entry_cmp_path);
+  //check existence and size of all files
+  if (verbose)
+    printf("Checking %lu files using %i threads\n", (unsigned long)entrycount, numthreads);
+  pthread_mutex_init(&queue.lock, NULL);
+  queue.basepath = basepath;
+  if ((queue.entries = (struct verify_entry_struct**)malloc((entrycount ? entrycount : 1) * sizeof(struct verify_entry_struct*))) == NULL) {
+    fprintf(stderr, "Memory allocation error\n");
+    return 5;
+  }
+  for (i = 0; i < entrycount; i++)
+    queue.entries[i] = &entries[i];
+  queue.count = entrycount;
+  queue.hashpass = 0;
+  verify_queue_run(&queue, numthreads);
+  //check contents of remaining files in the order they are stored on disk
+  queue.count = 0;
+  for (i = 0; i < entrycount; i++) {
+    if (entries[i].status == verify_unchecked) {
+      if (quick)
+        entries[i].status = verify_unverified;
+      else
+        queue.entries[queue.count++] = &entries[i];
+    }
+  }
+  qsort(queue.entries, queue.count, sizeof(struct verify_entry_struct*), verify_entry_cmp_fileid);
+  queue.hashpass = 1;
+  verify_queue_run(&queue, numthreads);
+  free(queue.entries);
+  pthread_mutex_destroy(&queue.lock);
+  //report results
+  memset(counts, 0, sizeof(counts));
+  for (i = 0; i < entrycount; i++) {
+    counts[entries[i].status]++;
+    switch (entries[i].status) {
+      case verify_modified:
+        printf("modified: %s (%s)\n", entries[i].path, entries[i].package);
+        break;
+      case verify_missing:
+        printf("missing:  %s (%s)\n", entries[i].path, entries[i].package);
+        break;
+      case verify_error:
+        printf("error:    %s (%s)\n", entries[i].path, entries[i].package);
+        break;
+      case verify_ok:
+        if (verbose)
+          printf("ok:       %s (%s)\n", entries[i].path, entries[i].package);
+        break;
+      case verify_unverified:
+        if (verbose)
+          printf("exists:   %s (%s)\n", entries[i].path, entries[i].package);
+        break;
+      default:
+        break;
+    }
+  }
+  //report files that are not in the package database
+  if (unowned) {
+    struct unowned_callback_struct unowneddata;
+    unowneddata.entries = entries;
+    unowneddata.count = entrycount;
+    unowneddata.unowned = 0;
+    dirtrav_traverse_directory(basepath, unowned_file_callback, NULL, NULL, &unowneddata);
+    unownedcount = unowneddata.unowned;
+  }
+  printf("%lu files checked: %lu ok, %lu modified, %lu missing", (unsigned long)entrycount, (unsigned long)counts[verify_ok], (unsigned long)counts[verify_modified], (unsigned long)counts[verify_missing]);
+  if (counts[verify_unverified])
+    printf(", %lu only checked for existence and size", (unsigned long)counts[verify_unverified]);
+  if (counts[verify_error])
+    printf(", %lu unreadable", (unsigned long)counts[verify_error]);
+  if (unowned)
+    printf(", %lu unowned", (unsigned long)unownedcount);
+  printf("\n");
+  //clean up
+  for (i = 0; i < entrycount; i++) {
+    free(entries[i].path);
+    free(entries[i].package);
+    free(entries[i].sha256);
+  }
+  free(entries);
+  return (counts[verify_modified] || counts[verify_missing] || counts[verify_error] || unownedcount ? 10 : 0);
+}
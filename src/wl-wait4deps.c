@@ -12,33 +12,25 @@
 #include <miniargv.h>
 #include <portcolcon.h>
 #include "filesystem.h"
+#include "pkgdb.h"
 #include "handle_interrupts.h"
 
 #define PROGRAM_NAME    "wl-wait4deps"
 #define PROGRAM_DESC    "Command line utility to wait for package dependencies to be installed"
 #define DEFAULT_WAIT_SECONDS 3
 
-#define PACKAGE_INFO_PATH_LEN (sizeof(PACKAGE_INFO_PATH) - 1)
-#define PACKAGE_INFO_VERSION_FILE_LEN (sizeof(PACKAGE_INFO_VERSION_FILE) - 1)
-
 #define STRINGIZE_(value) #value
 #define STRINGIZE(value) STRINGIZE_(value)
 
-int is_installed (const char* packagename, size_t packagenamelen, const char* basepath)
+int is_installed (const char* packagename, size_t packagenamelen, pkgdb_handle db)
 {
-  char* path;
-  size_t basepathlen = strlen(basepath);
+  char* name;
   int result = 0;
-  if ((path = (char*)malloc(basepathlen + PACKAGE_INFO_PATH_LEN + 1 + packagenamelen + 1 + PACKAGE_INFO_VERSION_FILE_LEN + 1)) != NULL) {
-    memcpy(path, basepath, basepathlen);
-    memcpy(path + basepathlen, PACKAGE_INFO_PATH, PACKAGE_INFO_PATH_LEN);
-    path[basepathlen + PACKAGE_INFO_PATH_LEN] = PATH_SEPARATOR;
-    memcpy(path + basepathlen + PACKAGE_INFO_PATH_LEN + 1, packagename, packagenamelen);
-    path[basepathlen + PACKAGE_INFO_PATH_LEN + 1 + packagenamelen] = PATH_SEPARATOR;
-    memcpy(path + basepathlen + PACKAGE_INFO_PATH_LEN + 1 + packagenamelen + 1, PACKAGE_INFO_VERSION_FILE, PACKAGE_INFO_VERSION_FILE_LEN);
-    path[basepathlen + PACKAGE_INFO_PATH_LEN + 1 + packagenamelen + 1 + PACKAGE_INFO_VERSION_FILE_LEN] = 0;
-    result = file_exists(path);
-    free(path);
+  if ((name = (char*)malloc(packagenamelen + 1)) != NULL) {
+    memcpy(name, packagename, packagenamelen);
+    name[packagenamelen] = 0;
+    result = pkgdb_package_is_installed(db, name);
+    free(name);
   }
   return result;
 }
@@ -75,7 +67,7 @@ size_t iterate_list (const char* list, iterate_list_callback_fn callbackfn, void
 
 struct list_dependency_callbackdata_struct {
   portcolconhandle con;
-  const char* basepath;
+  pkgdb_handle db;
   size_t countmissing;
   char itemfoundbullet;
   char itemmissingbullet;
@@ -85,7 +77,7 @@ struct list_dependency_callbackdata_struct {
 int list_dependency (const char* item, size_t itemlen, void* callbackdata)
 {
   struct list_dependency_callbackdata_struct* data = (struct list_dependency_callbackdata_struct*)callbackdata;
-  if (is_installed(item, itemlen, data->basepath)) {
+  if (is_installed(item, itemlen, data->db)) {
     portcolcon_set_foreground(data->con, (!data->isoptional ? PORTCOLCON_COLOR_GREEN : PORTCOLCON_COLOR_CYAN));
     portcolcon_printf(data->con, " %c ", data->itemfoundbullet);
   } else {
@@ -109,7 +101,7 @@ int list_dependency (const char* item, size_t itemlen, void* callbackdata)
 int list_missing_dependency (const char* item, size_t itemlen, void* callbackdata)
 {
   struct list_dependency_callbackdata_struct* data = (struct list_dependency_callbackdata_struct*)callbackdata;
-  if (!is_installed(item, itemlen, data->basepath)) {
+  if (!is_installed(item, itemlen, data->db)) {
     if (data->countmissing++)
       portcolcon_write(data->con, ",");
     portcolcon_set_foreground(data->con, PORTCOLCON_COLOR_WHITE);
@@ -123,7 +115,7 @@ int count_missing_dependency (const char* item, size_t itemlen, void* callbackda
 {
   struct list_dependency_callbackdata_struct* data = (struct list_dependency_callbackdata_struct*)callbackdata;
   if (!data->isoptional) {
-    if (!is_installed(item, itemlen, data->basepath)) {
+    if (!is_installed(item, itemlen, data->db)) {
       data->countmissing++;
     }
   }
@@ -142,6 +134,7 @@ int main (int argc, char *argv[], char *envp[])
 {
   int i;
   portcolconhandle con;
+  pkgdb_handle db;
   struct list_dependency_callbackdata_struct list_dependency_data;
   const char* basename = NULL;
   const char* basepath = NULL;
@@ -216,6 +209,11 @@ int main (int argc, char *argv[], char *envp[])
     fprintf(stderr, "Path does not exist: %s\n", basepath);
     return 3;
   }
+  //open package database (without creating it if it doesn't exist)
+  if (!pkgdb_exists(basepath) || (db = pkgdb_open(basepath)) == NULL) {
+    fprintf(stderr, "No valid package database found for: %s\n", basepath);
+    return 3;
+  }
   //install signal handler
   INSTALL_INTERRUPT_HANDLER(handle_break_signal)
   //initialize color console library
@@ -242,7 +240,7 @@ int main (int argc, char *argv[], char *envp[])
   }
   portcolcon_write(con, "\n");
   list_dependency_data.con = con;
-  list_dependency_data.basepath = basepath;
+  list_dependency_data.db = db;
   list_dependency_data.countmissing = 0;
   list_dependency_data.itemmissingbullet = '-';
   list_dependency_data.itemfoundbullet = '+';
@@ -289,7 +287,9 @@ int main (int argc, char *argv[], char *envp[])
   portcolcon_set_title(con, "Dependancies found");
   //clean up color console library
   portcolcon_cleanup(con);
+  //close package database
+  pkgdb_close(db);
   return 0;
 }
 
-/////TO DO: hook into sqlite3 database to get notified of changes
+/////TO DO: hook into sqlite3 database to get notified of changes instead of polling
@@ -0,0 +1,42 @@
+#!/bin/sh
+# test wl-makepackage -I: running twice on the same content must keep the package file, changing a file must create a new one
+# usage: wl-makepackage-incremental.sh path/to/wl-makepackage [format]
+
+MAKEPACKAGE=${1:-./wl-makepackage}
+FORMAT=${2:-tar.zst}
+TESTDIR=$(mktemp -d) || exit 1
+trap 'rm -rf "$TESTDIR"' EXIT
+mkdir -p "$TESTDIR/src/bin" "$TESTDIR/src/share/doc" "$TESTDIR/pkg" "$TESTDIR/prefix"
+echo "$TESTDIR $TESTDIR none binary 0 0" > "$TESTDIR/fstab"
+echo "test" > "$TESTDIR/src/bin/test.txt"
+echo "test documentation" > "$TESTDIR/src/share/doc/test.txt"
+echo "test license" > "$TESTDIR/src/LICENSE"
+
+makepackage () {
+  env -u SOURCE_DATE_EPOCH VERSION=1.0 RUNPLATFORM=x86_64-w64-mingw32 "$MAKEPACKAGE" -f "$TESTDIR/fstab" -s "$TESTDIR/src" -p "$TESTDIR/pkg" -i "$TESTDIR/prefix" -F "$FORMAT" -I test > "$TESTDIR/output.txt" 2>&1
+}
+
+fail () {
+  echo "FAILED ($FORMAT): $1"
+  cat "$TESTDIR/output.txt"
+  exit 1
+}
+
+#first run creates the package file
+makepackage || fail "error creating package"
+PACKAGEFILE=$(ls "$TESTDIR/pkg/"test-1.0.*)
+[ -f "$PACKAGEFILE" ] || fail "package file not created"
+cp "$PACKAGEFILE" "$TESTDIR/previous"
+
+#second run with the same contents keeps the package file
+makepackage || fail "error on second run"
+grep -q "Package contents unchanged" "$TESTDIR/output.txt" || fail "unchanged package was created again"
+cmp -s "$PACKAGEFILE" "$TESTDIR/previous" || fail "unchanged package file was modified"
+
+#third run after changing a file creates a new package file
+echo "changed" > "$TESTDIR/src/bin/test.txt"
+makepackage || fail "error on third run"
+grep -q "Package contents unchanged" "$TESTDIR/output.txt" && fail "changed package was not created again"
+
+echo "OK ($FORMAT)"
+exit 0